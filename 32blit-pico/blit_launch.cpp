@@ -546,6 +546,54 @@ const char *get_launch_path() {
 
 #ifdef BUILD_LOADER
 
+class PicoInstallerFlash final : public InstallerFlash {
+public:
+  uint32_t get_erase_size() const override {
+    return FLASH_SECTOR_SIZE;
+  }
+
+  uint32_t get_program_size() const override {
+    return FLASH_PAGE_SIZE;
+  }
+
+  bool erase(uint32_t offset) override {
+    auto status = save_and_disable_interrupts();
+
+    if(core1_started)
+      multicore_lockout_start_blocking(); // pause core1
+
+    flash_range_erase(offset, FLASH_SECTOR_SIZE);
+
+    if(core1_started)
+      multicore_lockout_end_blocking(); // resume core1
+
+    restore_interrupts(status);
+    return true;
+  }
+
+  bool program(uint32_t offset, const uint8_t *data, uint32_t len) override {
+    auto status = save_and_disable_interrupts();
+
+    if(core1_started)
+      multicore_lockout_start_blocking(); // pause core1
+
+    flash_range_program(offset, data, len);
+
+    if(core1_started)
+      multicore_lockout_end_blocking(); // resume core1
+
+    restore_interrupts(status);
+    return true;
+  }
+
+  bool read(uint32_t offset, uint8_t *data, uint32_t len) override {
+    memcpy(data, (const uint8_t *)(FLASH_BASE + offset), len);
+    return true;
+  }
+};
+
+static PicoInstallerFlash pico_installer_flash;
+
 // .blit file writer
 void BlitWriter::init(uint32_t file_len) {
   this->file_len = file_len;
@@ -561,19 +609,9 @@ bool BlitWriter::write(const uint8_t *buf, uint32_t len) {
   if(file_offset >= file_len)
     return false;
 
-  // write page
-  auto status = save_and_disable_interrupts();
-
-  if(core1_started)
-    multicore_lockout_start_blocking(); // pause core1
-
-  // assuming len <= page size and buf size == page size
-  flash_range_program(flash_offset + file_offset, buf, FLASH_PAGE_SIZE);
-
-  if(core1_started)
-    multicore_lockout_end_blocking(); // resume core1
-
-  restore_interrupts(status);
+  // erases as needed, writes and verifies
+  if(!installer.write(buf, len))
+    return false;
 
   file_offset += len;
 
@@ -628,19 +666,10 @@ bool BlitWriter::prepare_write(const uint8_t *buf) {
 
   disable_user_code();
 
-  // erase flash
-  auto status = save_and_disable_interrupts();
-
-  if(core1_started)
-    multicore_lockout_start_blocking(); // pause core1
-
-  auto erase_size = ((file_len - 1) / FLASH_SECTOR_SIZE) + 1;
-  flash_range_erase(flash_offset, erase_size * FLASH_SECTOR_SIZE);
-
-  if(core1_started)
-    multicore_lockout_end_blocking(); // resume core1
-
-  restore_interrupts(status);
+  // erasing is done as the file is written
+  installer.init(pico_installer_flash, buffer, sizeof(buffer), file_len, false, 0, [this](uint32_t) {
+    return flash_offset;
+  });
 
   return true;
 }
@@ -2,7 +2,10 @@
 
 #include <functional>
 
+#include "hardware/flash.h"
+
 #include "executable.hpp"
+#include "installer.hpp"
 #include "engine/api_private.hpp"
 
 // this is the 32blit's flash erase size, some parts of the API depend on this...
@@ -45,4 +48,7 @@ private:
   uint32_t file_offset;
 
   uint32_t flash_offset;
+
+  BlitInstaller installer;
+  uint8_t buffer[FLASH_PAGE_SIZE];
 };
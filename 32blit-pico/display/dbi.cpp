@@ -2,6 +2,7 @@
 #include <math.h>
 
 #include "display.hpp"
+#include "graphics/compositor.hpp"
 #include "display_commands.hpp"
 
 #include "hardware/clocks.h"
@@ -576,6 +577,7 @@ void update_display(uint32_t time) {
     }
 
     ::render(time);
+    blit::composite_screen_layers(blit::screen);
 
     if(!have_vsync) {
       while(dma_is_busy()) {} // may need to wait for lores.
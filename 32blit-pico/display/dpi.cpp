@@ -8,6 +8,7 @@
 #include "pico/time.h"
 
 #include "display.hpp"
+#include "graphics/compositor.hpp"
 #include "display_commands.hpp"
 
 #include "config.h"
@@ -510,6 +511,7 @@ void init_display() {
 void update_display(uint32_t time) {
   if(do_render) {
     blit::render(time);
+    blit::composite_screen_layers(blit::screen);
 
     // start dma/pio after first render
     if(!started && blit::screen.data) {
@@ -1,4 +1,5 @@
 #include "display.hpp"
+#include "graphics/compositor.hpp"
 
 #include "hardware/clocks.h"
 #include "hardware/dma.h"
@@ -52,6 +53,7 @@ void init_display() {
 void update_display(uint32_t time) {
   if(do_render) {
     ::render(time);
+    blit::composite_screen_layers(blit::screen);
     do_render = false;
   }
 }
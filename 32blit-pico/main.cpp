@@ -24,6 +24,7 @@
 #include "usb.hpp"
 
 #include "engine/api_private.hpp"
+#include "graphics/compositor.hpp"
 
 using namespace blit;
 
@@ -190,6 +191,8 @@ static const blit::APIConst blit_api_const {
 
   ::get_screen_data,
   ::set_framebuffer,
+
+  blit::compositor_set_layers,
 };
 
 [[gnu::section(".bss.api_data")]]
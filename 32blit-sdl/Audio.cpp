@@ -7,12 +7,17 @@
 #include "audio/audio.hpp"
 #include "engine/api_private.hpp"
 
+#ifdef VIDEO_CAPTURE
+#include "VideoCapture.hpp"
+extern VideoCapture *blit_capture;
+#endif
+
 static void _audio_callback(void *userdata, uint8_t *stream, int len);
 
 Audio::Audio() {
     SDL_AudioSpec desired = {}, audio_spec = {};
 
-    desired.freq = _sample_rate;
+    desired.freq = sample_rate;
     desired.format = AUDIO_S16LSB;
     desired.channels = 1;
 
@@ -43,4 +48,9 @@ static void _audio_bufferfill(short *buffer, int buffer_size){
 
 static void _audio_callback(void *userdata, uint8_t *stream, int len){
     _audio_bufferfill((short *)stream, len / 2);
+
+#ifdef VIDEO_CAPTURE
+    if(blit_capture)
+        blit_capture->add_audio((const int16_t *)stream, len / 2);
+#endif
 }
@@ -3,8 +3,8 @@ class Audio {
 		Audio();
 		~Audio();
 
-	private:
-        const unsigned int _sample_rate = 22050;
+		static const unsigned int sample_rate = 22050;
 
+	private:
         SDL_AudioDeviceID audio_device;
 };
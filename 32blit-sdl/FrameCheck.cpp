@@ -0,0 +1,141 @@
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+
+#include "FrameCheck.hpp"
+
+#include "graphics/surface.hpp"
+
+FrameCheck::~FrameCheck() {
+  if(hash_file.is_open())
+    hash_file.close();
+}
+
+// write the hash of every frame to a file, one "frame hash" line each
+bool FrameCheck::write_hashes(const std::string &filename) {
+  hash_file.open(filename, std::ios::out | std::ios::trunc);
+
+  if(!hash_file.is_open()) {
+    std::cerr << "Failed to open " << filename << " for writing" << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+// compare each frame against the hashes from a previous run
+bool FrameCheck::load_golden(const std::string &filename) {
+  std::ifstream file(filename);
+
+  if(!file.is_open()) {
+    std::cerr << "Failed to open " << filename << std::endl;
+    return false;
+  }
+
+  std::string line;
+  while(std::getline(file, line)) {
+    uint32_t index;
+    uint64_t hash;
+
+    if(line.empty())
+      continue;
+
+    if(sscanf(line.c_str(), "%" SCNu32 " %" SCNx64, &index, &hash) != 2 || index != golden.size()) {
+      std::cerr << "Invalid frame hash list " << filename << " at line " << golden.size() + 1 << std::endl;
+      return false;
+    }
+
+    golden.push_back(hash);
+  }
+
+  has_golden = true;
+  return true;
+}
+
+// comma separated list of frames to save as images
+void FrameCheck::add_dump_frames(const std::string &list) {
+  std::stringstream stream(list);
+  std::string item;
+
+  while(std::getline(stream, item, ',')) {
+    char *end;
+    auto frame = strtoul(item.c_str(), &end, 10);
+
+    if(end != item.c_str())
+      dump_frames.push_back(uint32_t(frame));
+  }
+}
+
+void FrameCheck::frame(uint32_t index, blit::Surface &screen) {
+  auto hash = hash_surface(screen);
+
+  frames = index + 1;
+
+  if(hash_file.is_open()) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%" PRIu32 " %016" PRIx64 "\n", index, hash);
+    hash_file << buf;
+  }
+
+  if(has_golden && (index >= golden.size() || golden[index] != hash)) {
+    if(!mismatches)
+      first_mismatch = index;
+
+    mismatches++;
+  }
+
+  if(std::find(dump_frames.begin(), dump_frames.end(), index) != dump_frames.end()) {
+    auto filename = "frame-" + std::to_string(index) + ".bmp";
+
+    if(!screen.save(filename))
+      std::cerr << "Failed to save " << filename << std::endl;
+  }
+}
+
+bool FrameCheck::finish() {
+  if(!has_golden)
+    return true;
+
+  // stopping early is also a failure
+  if(frames < golden.size()) {
+    if(!mismatches)
+      first_mismatch = frames;
+
+    mismatches += golden.size() - frames;
+  }
+
+  auto checked = std::max(frames, uint32_t(golden.size()));
+
+  if(mismatches)
+    std::cout << "Frame check failed: " << mismatches << " of " << checked << " frames differ, first at frame " << first_mismatch << std::endl;
+  else
+    std::cout << "Frame check passed: " << checked << " frames match" << std::endl;
+
+  return mismatches == 0;
+}
+
+// 64-bit FNV-1a of the visible pixels, and the palette for paletted surfaces
+uint64_t FrameCheck::hash_surface(const blit::Surface &surface) {
+  uint64_t hash = 0xCBF29CE484222325;
+
+  auto add = [&hash](const uint8_t *p, size_t len) {
+    for(size_t i = 0; i < len; i++) {
+      hash ^= p[i];
+      hash *= 0x100000001B3;
+    }
+  };
+
+  uint32_t header[3] = {uint32_t(surface.bounds.w), uint32_t(surface.bounds.h), uint32_t(surface.format)};
+  add((const uint8_t *)header, sizeof(header));
+
+  for(int y = 0; y < surface.bounds.h; y++)
+    add(surface.data + y * surface.row_stride, surface.bounds.w * surface.pixel_stride);
+
+  if(surface.format == blit::PixelFormat::P && surface.palette)
+    add((const uint8_t *)surface.palette, 256 * sizeof(blit::Pen));
+
+  return hash;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace blit {
+  struct Surface;
+}
+
+// Hashes each rendered frame to check that rendering changes don't change the output
+class FrameCheck final {
+    public:
+        FrameCheck() = default;
+        ~FrameCheck();
+
+        bool write_hashes(const std::string &filename);
+        bool load_golden(const std::string &filename);
+        void add_dump_frames(const std::string &list);
+
+        bool is_enabled() const {return hash_file.is_open() || has_golden || !dump_frames.empty();}
+
+        void frame(uint32_t index, blit::Surface &screen);
+
+        // print the comparison result, returns false if any frame didn't match
+        bool finish();
+
+        static uint64_t hash_surface(const blit::Surface &surface);
+
+    private:
+        std::ofstream hash_file;
+
+        bool has_golden = false;
+        std::vector<uint64_t> golden;
+
+        std::vector<uint32_t> dump_frames;
+
+        uint32_t frames = 0;
+        uint32_t mismatches = 0;
+        uint32_t first_mismatch = 0;
+};
@@ -0,0 +1,144 @@
+#include <cstring>
+#include <iostream>
+
+#include "InputLog.hpp"
+
+// file header, followed by one record for each tick the input changed on
+static const char log_magic[4] = {'3', '2', 'B', 'I'};
+static const uint32_t log_version = 1;
+
+static void write_float(SDL_RWops *file, float f) {
+  uint32_t u;
+  memcpy(&u, &f, sizeof(u));
+  SDL_WriteLE32(file, u);
+}
+
+static float read_float(SDL_RWops *file) {
+  uint32_t u = SDL_ReadLE32(file);
+  float f;
+  memcpy(&f, &u, sizeof(f));
+  return f;
+}
+
+InputLog::InputLog(Mode mode, const std::string &filename) : mode(mode) {
+  file = SDL_RWFromFile(filename.c_str(), mode == Mode::Record ? "wb" : "rb");
+
+  if(!file) {
+    std::cerr << "Failed to open input log " << filename << ": " << SDL_GetError() << std::endl;
+    return;
+  }
+
+  if(mode == Mode::Record) {
+    seed = uint32_t(SDL_GetPerformanceCounter() ^ (SDL_GetPerformanceCounter() >> 32));
+
+    SDL_RWwrite(file, log_magic, sizeof(log_magic), 1);
+    SDL_WriteLE32(file, log_version);
+    SDL_WriteLE32(file, seed);
+
+    // write the initial state on the first tick
+    state.buttons = ~0u;
+  } else {
+    char magic[4];
+
+    if(SDL_RWread(file, magic, sizeof(magic), 1) != 1 || memcmp(magic, log_magic, sizeof(magic)) != 0 || SDL_ReadLE32(file) != log_version) {
+      std::cerr << "Invalid input log " << filename << std::endl;
+      SDL_RWclose(file);
+      file = nullptr;
+      return;
+    }
+
+    seed = SDL_ReadLE32(file);
+    read_record();
+  }
+}
+
+InputLog::~InputLog() {
+  if(!file)
+    return;
+
+  // mark where the recording stopped so a replay runs for the same number of ticks
+  if(mode == Mode::Record)
+    write_record(EndRecord, last_tick + 1);
+
+  SDL_RWclose(file);
+}
+
+bool InputLog::update(uint32_t tick, uint32_t &buttons, float joystick[2], float tilt[3]) {
+  if(!file)
+    return true;
+
+  last_tick = tick;
+
+  if(mode == Mode::Record) {
+    if(buttons != state.buttons || memcmp(joystick, state.joystick, sizeof(state.joystick)) != 0 || memcmp(tilt, state.tilt, sizeof(state.tilt)) != 0) {
+      state.buttons = buttons;
+      memcpy(state.joystick, joystick, sizeof(state.joystick));
+      memcpy(state.tilt, tilt, sizeof(state.tilt));
+
+      write_record(StateRecord, tick);
+    }
+
+    return true;
+  }
+
+  // apply every change up to this tick
+  while(next_tick <= tick) {
+    if(next_type == EndRecord)
+      return false;
+
+    state = next_state;
+
+    if(!read_record()) {
+      std::cerr << "Input log ended unexpectedly" << std::endl;
+      return false;
+    }
+  }
+
+  buttons = state.buttons;
+  memcpy(joystick, state.joystick, sizeof(state.joystick));
+  memcpy(tilt, state.tilt, sizeof(state.tilt));
+
+  return true;
+}
+
+void InputLog::write_record(RecordType type, uint32_t tick) {
+  SDL_WriteU8(file, type);
+  SDL_WriteLE32(file, tick);
+
+  if(type != StateRecord)
+    return;
+
+  SDL_WriteLE32(file, state.buttons);
+
+  for(auto &f : state.joystick)
+    write_float(file, f);
+
+  for(auto &f : state.tilt)
+    write_float(file, f);
+}
+
+bool InputLog::read_record() {
+  uint8_t type;
+
+  // treat a truncated file as ending here
+  if(SDL_RWread(file, &type, 1, 1) != 1) {
+    next_type = EndRecord;
+    return false;
+  }
+
+  next_type = RecordType(type);
+  next_tick = SDL_ReadLE32(file);
+
+  if(next_type != StateRecord)
+    return true;
+
+  next_state.buttons = SDL_ReadLE32(file);
+
+  for(auto &f : next_state.joystick)
+    f = read_float(file);
+
+  for(auto &f : next_state.tilt)
+    f = read_float(file);
+
+  return true;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+#include "SDL.h"
+
+// Records the input state seen by each update tick, or replays a recording
+// in place of live input
+class InputLog final {
+    public:
+        enum class Mode {
+            Record,
+            Replay
+        };
+
+        InputLog(Mode mode, const std::string &filename);
+        ~InputLog();
+
+        bool is_open() const {return file;}
+        bool is_replaying() const {return mode == Mode::Replay;}
+
+        uint32_t get_seed() const {return seed;}
+
+        // record the state for this tick, or replace it with the recorded state
+        // returns false once a replay has run out
+        bool update(uint32_t tick, uint32_t &buttons, float joystick[2], float tilt[3]);
+
+    private:
+        struct State {
+            uint32_t buttons = 0;
+            float joystick[2] = {0.0f, 0.0f};
+            float tilt[3] = {0.0f, 0.0f, 0.0f};
+        };
+
+        enum RecordType : uint8_t {
+            StateRecord = 0,
+            EndRecord = 1
+        };
+
+        void write_record(RecordType type, uint32_t tick);
+        bool read_record();
+
+        Mode mode;
+        SDL_RWops *file = nullptr;
+
+        uint32_t seed = 0;
+        uint32_t last_tick = 0;
+
+        State state;
+
+        // replay: next change, and the tick it applies from
+        State next_state;
+        RecordType next_type = EndRecord;
+        uint32_t next_tick = 0;
+};
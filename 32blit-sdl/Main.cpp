@@ -9,7 +9,9 @@
 #include "SDL.h"
 #include <iostream>
 
+#include "FrameCheck.hpp"
 #include "Input.hpp"
+#include "InputLog.hpp"
 #include "Multiplayer.hpp"
 #include "System.hpp"
 #include "Renderer.hpp"
@@ -31,11 +33,13 @@ Input *blit_input;
 Multiplayer *blit_multiplayer;
 Renderer *blit_renderer;
 Audio *blit_audio;
+InputLog *blit_input_log = nullptr;
+FrameCheck *blit_frame_check = nullptr;
 
 const char *launch_path = nullptr;
 
 #ifdef VIDEO_CAPTURE
-VideoCapture *blit_capture;
+VideoCapture *blit_capture = nullptr;
 unsigned int last_record_startstop = 0;
 #endif
 
@@ -113,11 +117,12 @@ void handle_event(SDL_Event &event) {
 		default:
 			if(event.type == System::loop_event) {
 				blit_renderer->update(blit_system);
-				blit_system->notify_redraw();
-				blit_renderer->present();
 #ifdef VIDEO_CAPTURE
-				if (blit_capture->recording()) blit_capture->capture(blit_renderer);
+				// before the update thread is allowed to start drawing the next frame
+				if (blit_capture->recording()) blit_capture->capture(blit_system->renderer_draws_layers());
 #endif
+				blit_system->notify_redraw();
+				blit_renderer->present();
 			} else if (event.type == System::timer_event) {
 				switch(event.user.code) {
 					case 0:
@@ -152,6 +157,8 @@ void em_loop() {
 int main(int argc, char *argv[]) {
   int x = SDL_WINDOWPOS_UNDEFINED, y = SDL_WINDOWPOS_UNDEFINED;
   bool fullscreen = false;
+  bool headless = false, uncapped = false;
+  unsigned int frame_limit = 0;
 
   std::cout << metadata_title << " " << metadata_version << std::endl;
   std::cout << "Powered by 32Blit SDL2 runtime - github.com/32blit/32blit-sdk" << std::endl << std::endl;
@@ -159,6 +166,11 @@ int main(int argc, char *argv[]) {
 	auto mp_mode = Multiplayer::Mode::Auto;
 	std::string mp_address = "localhost";
 
+	auto input_log_mode = InputLog::Mode::Record;
+	std::string input_log_file;
+
+	std::string hash_frames_file, check_frames_file, dump_frames;
+
 	for(int i = 1; i < argc; i++) {
 		std::string arg_str(argv[i]);
 		if(arg_str == "--connect" && i + 1 < argc) {
@@ -171,6 +183,10 @@ int main(int argc, char *argv[]) {
 		}
 		else if(arg_str == "--listen")
 			mp_mode = Multiplayer::Mode::Listen;
+		else if((arg_str == "--record-input" || arg_str == "--replay-input") && i + 1 < argc) {
+			input_log_mode = arg_str == "--record-input" ? InputLog::Mode::Record : InputLog::Mode::Replay;
+			input_log_file = argv[++i];
+		}
 		else if(arg_str == "--position") {
 			SDL_sscanf(argv[i+1], "%d,%d", &x, &y);
 		}	else if(arg_str == "--size" && i + 1 < argc) {
@@ -184,6 +200,20 @@ int main(int argc, char *argv[]) {
       i++;
 		} else if(arg_str == "--fullscreen")
 			fullscreen = true;
+		else if(arg_str == "--headless")
+			headless = true;
+		else if(arg_str == "--uncapped")
+			uncapped = true;
+		else if(arg_str == "--frames" && i + 1 < argc) {
+			SDL_sscanf(argv[i+1], "%u", &frame_limit);
+			i++;
+		}
+		else if(arg_str == "--hash-frames" && i + 1 < argc)
+			hash_frames_file = argv[++i];
+		else if(arg_str == "--check-frames" && i + 1 < argc)
+			check_frames_file = argv[++i];
+		else if(arg_str == "--dump-frames" && i + 1 < argc)
+			dump_frames = argv[++i];
     else if(arg_str == "--credits") {
 			std::cout << "32Blit was made possible by:" << std::endl;
 			std::cout << std::endl;
@@ -219,6 +249,14 @@ int main(int argc, char *argv[]) {
 			std::cout << " --position x,y       -- Set window position." << std::endl;
       std::cout << " --size w,h           -- Set display size. (max 320x240)" << std::endl;
 			std::cout << " --launch_path <file> -- Emulates the file associations on the console." << std::endl;
+			std::cout << " --record-input <file> -- Record input for each update to a file." << std::endl;
+			std::cout << " --replay-input <file> -- Replay recorded input and exit when it ends." << std::endl;
+			std::cout << " --headless           -- Run without a window and print frame timings." << std::endl;
+			std::cout << " --frames <n>         -- Exit after rendering n frames." << std::endl;
+			std::cout << " --uncapped           -- Run as fast as possible, with simulated time." << std::endl;
+			std::cout << " --hash-frames <file> -- Write a hash of each frame to a file." << std::endl;
+			std::cout << " --check-frames <file> -- Compare each frame to hashes from --hash-frames." << std::endl;
+			std::cout << " --dump-frames <n,...> -- Save the listed frames as frame-<n>.bmp." << std::endl;
 			std::cout << " --credits            -- Print contributor credits and exit." << std::endl;
 			std::cout << " --info               -- Print metadata info and exit." << std::endl << std::endl;
 			SDL_DestroyWindow(window);
@@ -227,11 +265,62 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
-	if (SDL_Init(SDL_INIT_VIDEO|SDL_INIT_GAMECONTROLLER|SDL_INIT_AUDIO) < 0) {
+	if (SDL_Init(headless ? SDL_INIT_EVENTS : SDL_INIT_VIDEO|SDL_INIT_GAMECONTROLLER|SDL_INIT_AUDIO) < 0) {
 		std::cerr << "could not initialize SDL2: " << SDL_GetError() << std::endl;
 		return 1;
 	}
 
+	blit_system = new System();
+	blit_input = new Input(blit_system);
+	blit_multiplayer = new Multiplayer(mp_mode, mp_address);
+
+	blit_system->set_uncapped(uncapped);
+	blit_system->set_frame_limit(frame_limit);
+
+	if(!input_log_file.empty()) {
+		blit_input_log = new InputLog(input_log_mode, input_log_file);
+
+		if(!blit_input_log->is_open())
+			return 1;
+
+		blit_system->set_input_log(blit_input_log);
+	}
+
+	if(!hash_frames_file.empty() || !check_frames_file.empty() || !dump_frames.empty()) {
+		blit_frame_check = new FrameCheck();
+
+		if(!hash_frames_file.empty() && !blit_frame_check->write_hashes(hash_frames_file))
+			return 1;
+
+		if(!check_frames_file.empty() && !blit_frame_check->load_golden(check_frames_file))
+			return 1;
+
+		if(!dump_frames.empty())
+			blit_frame_check->add_dump_frames(dump_frames);
+
+		// frames can only match if random numbers do
+		if(!blit_input_log)
+			blit_system->set_random_seed(0);
+
+		blit_system->set_frame_check(blit_frame_check);
+	}
+
+	if (headless) {
+		blit_system->run_headless();
+		blit_system->stop();
+
+		bool frames_ok = !blit_frame_check || blit_frame_check->finish();
+
+		delete blit_system;
+		delete blit_input_log;
+		delete blit_frame_check;
+		delete blit_input;
+		delete blit_multiplayer;
+
+		SDL_Quit();
+		return frames_ok ? 0 : 1;
+	}
+
 	window = SDL_CreateWindow(
 		metadata_title,
 		x, y,
@@ -245,16 +334,14 @@ int main(int argc, char *argv[]) {
 	}
 	SDL_SetWindowMinimumSize(window, System::width, System::height);
 
-  blit_system = new System();
-  blit_input = new Input(blit_system);
-	blit_multiplayer = new Multiplayer(mp_mode, mp_address);
 	blit_renderer = new Renderer(window, System::width, System::height);
-	blit_audio = new Audio();
 
 #ifdef VIDEO_CAPTURE
 	blit_capture = new VideoCapture(argv[0]);
 #endif
 
+	blit_audio = new Audio();
+
 	blit_system->run();
 
 #ifdef __EMSCRIPTEN__
@@ -273,17 +360,27 @@ int main(int argc, char *argv[]) {
 	}
 
 #ifdef VIDEO_CAPTURE
+	// stop the audio callback feeding the capture before it goes away
+	delete blit_audio;
+	blit_audio = nullptr;
+
 	if (blit_capture->recording()) blit_capture->stop();
 	delete blit_capture;
+	blit_capture = nullptr;
 #endif
 
 	blit_system->stop();
+
+	bool frames_ok = !blit_frame_check || blit_frame_check->finish();
+
 	delete blit_system;
+	delete blit_input_log;
+	delete blit_frame_check;
   delete blit_input;
 	delete blit_multiplayer;
 	delete blit_renderer;
 
 	SDL_DestroyWindow(window);
 	SDL_Quit();
-	return 0;
+	return frames_ok ? 0 : 1;
 }
@@ -4,6 +4,7 @@
 #include <iostream>
 #include "SDL.h"
 
+#include "graphics/compositor.hpp"
 #include "graphics/surface.hpp"
 
 #include "Renderer.hpp"
@@ -30,9 +31,19 @@ Renderer::Renderer(SDL_Window *window, int width, int height) : sys_width(width)
 
   fb_texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGB24, SDL_TEXTUREACCESS_STREAMING, sys_width, sys_height);
   fb_565_texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_BGR565, SDL_TEXTUREACCESS_STREAMING, sys_width, sys_height);
+
+  // screen drawn over layers
+  keyed_texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING, sys_width, sys_height);
+  SDL_SetTextureBlendMode(keyed_texture, SDL_BLENDMODE_BLEND);
 }
 
 Renderer::~Renderer() {
+	for(auto &layer : layers) {
+		if(layer.texture)
+			SDL_DestroyTexture(layer.texture);
+	}
+
+	SDL_DestroyTexture(keyed_texture);
 	SDL_DestroyTexture(fb_texture);
 	SDL_DestroyTexture(fb_565_texture);
 	SDL_DestroyRenderer(renderer);
@@ -63,23 +74,130 @@ void Renderer::resize(int width, int height) {
 	  set_mode(mode);
 }
 
+// called on the main thread while the update thread waits, so the layers can be read
 void Renderer::update(System *sys) {
   auto format = blit::PixelFormat(sys->format());
 
-	current = format == blit::PixelFormat::RGB565 ? fb_565_texture : fb_texture;
-
   if(is_lores != (sys->mode() == 0)) {
     is_lores = sys->mode() == 0;
     set_mode(mode);
   }
 
-	sys->update_texture(current);
+  uint8_t layer_count = 0;
+  blit::Pen screen_key;
+  const blit::ScreenLayer *screen_layers = nullptr;
+
+  if(sys->renderer_draws_layers())
+    screen_layers = blit::get_screen_layers(layer_count, screen_key);
+
+  if(layer_count) {
+    current = keyed_texture;
+    sys->update_keyed_texture(current, screen_key);
+
+    auto colour = blit::get_screen_key_colour(format, blit::screen.palette);
+    key_colour[0] = colour.r;
+    key_colour[1] = colour.g;
+    key_colour[2] = colour.b;
+  } else {
+    current = format == blit::PixelFormat::RGB565 ? fb_565_texture : fb_texture;
+    sys->update_texture(current);
+  }
+
+  update_layers(sys, screen_layers, layer_count);
+}
+
+// uploads the layers that changed and copies the offsets for present
+void Renderer::update_layers(System *sys, const blit::ScreenLayer *screen_layers, int count) {
+  auto format = blit::PixelFormat(sys->format());
+
+  // the pixels are only uploaded again if the layers are set again (or the palette changes)
+  auto generation = blit::get_screen_layers_generation();
+  bool reload = generation != layers_generation || (format == blit::PixelFormat::P && sys->palette_version() != layers_palette);
+  layers_generation = generation;
+  layers_palette = sys->palette_version();
+
+  for(size_t i = count; i < layers.size(); i++) {
+    if(layers[i].texture)
+      SDL_DestroyTexture(layers[i].texture);
+  }
+  layers.resize(count);
+
+  for(int i = 0; i < count; i++) {
+    auto &layer = screen_layers[i];
+    auto &tex = layers[i];
+
+    tex.visible = blit::is_screen_layer_visible(layer, format);
+    if(!tex.visible)
+      continue;
+
+    auto &bounds = layer.bounds;
+    if(!tex.texture || tex.w != bounds.w || tex.h != bounds.h) {
+      if(tex.texture)
+        SDL_DestroyTexture(tex.texture);
+
+      tex.texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING, bounds.w, bounds.h);
+      SDL_SetTextureBlendMode(tex.texture, SDL_BLENDMODE_BLEND);
+      tex.w = bounds.w;
+      tex.h = bounds.h;
+      tex.data = nullptr;
+    }
+
+    Uint32 key = layer.key.r | layer.key.g << 8 | layer.key.b << 16 | layer.key.a << 24;
+
+    if(reload || tex.data != layer.data || tex.use_key != layer.use_key || tex.key != key) {
+      sys->update_layer_texture(tex.texture, layer);
+      tex.data = layer.data;
+      tex.use_key = layer.use_key;
+      tex.key = key;
+    }
+
+    tex.offset_x = layer.offset.x;
+    tex.offset_y = layer.offset.y;
+    SDL_SetTextureAlphaMod(tex.texture, format == blit::PixelFormat::P ? 255 : layer.alpha);
+  }
+}
+
+static int wrap(int v, int size) {
+  v %= size;
+  return v < 0 ? v + size : v;
+}
+
+// repeats each layer over the screen, destination is where the whole screen texture goes
+void Renderer::render_layers(const SDL_Rect &destination) {
+  int screen_w = is_lores ? sys_width / 2 : sys_width;
+  int screen_h = is_lores ? sys_height / 2 : sys_height;
+
+  auto to_dest_x = [&destination, this](int x) {return destination.x + x * destination.w / sys_width;};
+  auto to_dest_y = [&destination, this](int y) {return destination.y + y * destination.h / sys_height;};
+
+  // the screen keeps its key colour where every layer is keyed
+  SDL_Rect screen_rect{destination.x, destination.y, to_dest_x(screen_w) - destination.x, to_dest_y(screen_h) - destination.y};
+  SDL_SetRenderDrawColor(renderer, key_colour[0], key_colour[1], key_colour[2], 255);
+  SDL_RenderFillRect(renderer, &screen_rect);
+
+  for(auto &layer : layers) {
+    if(!layer.visible)
+      continue;
+
+    for(int y = -wrap(layer.offset_y, layer.h); y < screen_h; y += layer.h) {
+      for(int x = -wrap(layer.offset_x, layer.w); x < screen_w; x += layer.w) {
+        SDL_Rect rect{to_dest_x(x), to_dest_y(y), 0, 0};
+        rect.w = to_dest_x(x + layer.w) - rect.x;
+        rect.h = to_dest_y(y + layer.h) - rect.y;
+        SDL_RenderCopy(renderer, layer.texture, nullptr, &rect);
+      }
+    }
+  }
 }
 
 void Renderer::_render(SDL_Texture *target, SDL_Rect *destination) {
 	SDL_SetRenderTarget(renderer, target);
 	SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
 	SDL_RenderClear(renderer);
+
+	if(current == keyed_texture)
+		render_layers(destination ? *destination : SDL_Rect{0, 0, sys_width, sys_height});
+
 	SDL_RenderCopy(renderer, current, nullptr, destination);
 }
 
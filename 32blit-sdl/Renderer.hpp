@@ -1,5 +1,13 @@
+#include <vector>
+
 class System;
 
+namespace blit {
+  struct Pen;
+  struct ScreenLayer;
+  struct Surface;
+}
+
 class Renderer {
 	public:
 		Renderer(SDL_Window *window, int width, int height);
@@ -14,8 +22,25 @@ class Renderer {
 		void read_pixels(int width, int height, Uint32 format, Uint8 *buffer);
 
 	private:
+		// a screen layer uploaded to a texture
+		struct LayerTexture {
+			SDL_Texture *texture = nullptr;
+			int w = 0, h = 0;
+
+			// what was uploaded
+			const uint8_t *data = nullptr;
+			bool use_key = false;
+			Uint32 key = 0;
+
+			bool visible = false;
+			int offset_x = 0, offset_y = 0;
+		};
+
 		void _render(SDL_Texture *target, SDL_Rect *destination);
 
+		void update_layers(System *sys, const blit::ScreenLayer *screen_layers, int count);
+		void render_layers(const SDL_Rect &destination);
+
 		int sys_width, sys_height;
 		int win_width, win_height;
 
@@ -26,4 +51,9 @@ class Renderer {
 		SDL_Texture *fb_texture = nullptr;
 		SDL_Texture *fb_565_texture = nullptr;
 		SDL_Texture *current = nullptr;
+
+		SDL_Texture *keyed_texture = nullptr;
+		std::vector<LayerTexture> layers;
+		Uint8 key_colour[3]{};
+		Uint32 layers_generation = 0, layers_palette = 0;
 };
@@ -1,20 +1,29 @@
+#include <algorithm>
 #include <chrono>
 #include <iostream>
 #include <random>
 #include "SDL.h"
 
 #include "File.hpp"
+#include "FrameCheck.hpp"
 #include "System.hpp"
 #include "Input.hpp"
+#include "InputLog.hpp"
 #include "32blit.hpp"
 #include "UserCode.hpp"
 #include "JPEG.hpp"
 #include "Multiplayer.hpp"
 
 #include "engine/api_private.hpp"
+#include "graphics/compositor.hpp"
 
 extern Input *blit_input;
 
+#ifdef VIDEO_CAPTURE
+#include "VideoCapture.hpp"
+extern VideoCapture *blit_capture;
+#endif
+
 // blit audio channels
 static blit::AudioChannel channels[CHANNEL_COUNT];
 
@@ -24,6 +33,7 @@ int System::height = System::max_height;
 // blit framebuffer memory
 static uint8_t framebuffer[System::max_width * System::max_height * 3];
 static blit::Pen palette[256];
+static Uint32 palette_changes = 0;
 
 // blit debug callback
 void blit_debug(const char *message) {
@@ -40,6 +50,7 @@ blit::SurfaceInfo cur_surf_info;
 
 static void set_screen_palette(const blit::Pen *colours, int num_cols) {
 	memcpy(palette, colours, num_cols * sizeof(blit::Pen));
+	palette_changes++;
 }
 
 static bool set_screen_mode_format(blit::ScreenMode new_mode, blit::SurfaceTemplate &new_surf_template) {
@@ -99,7 +110,18 @@ blit::SurfaceInfo &set_screen_mode(blit::ScreenMode new_mode) {
 
 // blit timer callback
 std::chrono::steady_clock::time_point start;
+
+// advanced by exactly 10ms each loop when recording/replaying input, so updates happen on the same ticks
+static bool fixed_timestep = false;
+static uint32_t fixed_time = 0;
+
+// also used for the us timer when recording/replaying input or benchmarking, real timings are measured separately
+static bool virtual_us_timer = false;
+
 uint32_t now() {
+	if (fixed_timestep)
+		return fixed_time;
+
 	auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
 	return (uint32_t)elapsed.count();
 }
@@ -128,6 +150,9 @@ void enable_us_timer()
 
 uint32_t get_us_timer()
 {
+	if (virtual_us_timer)
+		return fixed_time * 1000;
+
 	// get current time in us
 	uint64_t ticksPerUs = SDL_GetPerformanceFrequency() / 1000000;
 	return SDL_GetPerformanceCounter() / ticksPerUs;
@@ -234,6 +259,8 @@ static const blit::APIConst blit_api_const {
 
   nullptr, // get_screen_data
   nullptr, // set_framebuffer
+
+  blit::compositor_set_layers,
 };
 
 static blit::APIData blit_api_data;
@@ -294,10 +321,47 @@ void System::run() {
 	::init();
 #else
 	t_system_loop = SDL_CreateThread(system_loop_thread, "Loop", (void *)this);
-	t_system_timer = SDL_CreateThread(system_timer_thread, "Timer", (void *)this);
+
+	// the loop doesn't wait for the timer if uncapped
+	if(!uncapped)
+		t_system_timer = SDL_CreateThread(system_timer_thread, "Timer", (void *)this);
 #endif
 }
 
+// Run the loop on this thread without a window until quit
+void System::run_headless() {
+	running = true;
+	headless = true;
+	fixed_timestep = true;
+	virtual_us_timer = true;
+
+	start = std::chrono::steady_clock::now();
+
+	blit::update = ::update;
+	blit::render = ::render;
+
+	setup_base_path();
+
+	blit::set_screen_mode(blit::lores);
+
+	::init();
+
+	auto freq = SDL_GetPerformanceFrequency();
+
+	while (running) {
+		auto loop_start = SDL_GetPerformanceCounter();
+
+		loop();
+
+		// keep to real time unless uncapped
+		if(!uncapped) {
+			auto elapsed_ms = (SDL_GetPerformanceCounter() - loop_start) * 1000 / freq;
+			if(elapsed_ms < 10)
+				SDL_Delay(Uint32(10 - elapsed_ms));
+		}
+	}
+}
+
 int System::timer_thread() {
 	// Signal the system loop every 10 msec.
 	int dropped = 0;
@@ -333,7 +397,8 @@ int System::update_thread() {
   ::init(); // Run init here because the user can make it hang.
 
   while (true) {
-    SDL_SemWait(s_loop_update);
+    if(!uncapped)
+      SDL_SemWait(s_loop_update);
     if(!running) break;
     bool rendered = loop();
     if(!running) break;
@@ -348,7 +413,18 @@ int System::update_thread() {
 }
 
 bool System::loop() {
+  if(fixed_timestep)
+    fixed_time += 10;
+
   SDL_LockMutex(m_input);
+  if(input_log && !input_log->update(tick_count, shadow_buttons, shadow_joystick, shadow_tilt) && !replay_ended) {
+    replay_ended = true;
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    std::cout << "Replay finished after " << tick_count << " ticks in " << elapsed.count() << "ms" << std::endl;
+
+    quit();
+  }
   blit::buttons = shadow_buttons;
   blit::tilt.x = shadow_tilt[0];
   blit::tilt.y = shadow_tilt[1];
@@ -368,9 +444,36 @@ bool System::loop() {
   if(time_now - last_render_time >= 20)
 #endif
   {
+    auto render_start = SDL_GetPerformanceCounter();
+
     blit::render(time_now);
+
+    layers_composited = needs_layers_in_screen();
+    if(layers_composited)
+      blit::composite_screen_layers(blit::screen);
     last_render_time = time_now;
 
+    auto render_time = SDL_GetPerformanceCounter() - render_start;
+
+    // updates since the last frame count towards this one
+    total_update_time += frame_update_time;
+    total_render_time += render_time;
+    max_update_time = std::max(max_update_time, frame_update_time);
+    max_render_time = std::max(max_render_time, render_time);
+
+    if(headless) {
+      auto freq = SDL_GetPerformanceFrequency();
+      std::cout << "frame " << frame_count << " update " << frame_update_time * 1000000 / freq << "us render " << render_time * 1000000 / freq << "us\n";
+    }
+
+    frame_update_time = 0;
+
+    if(frame_check)
+      frame_check->frame(frame_count, blit::screen);
+
+    if(++frame_count == frame_limit)
+      quit();
+
     if(_mode != requested_mode || cur_format != requested_format) {
       _mode = requested_mode;
       cur_format = requested_format;
@@ -379,11 +482,16 @@ bool System::loop() {
     rendered = true;
   }
 
+  auto update_start = SDL_GetPerformanceCounter();
   blit::tick(::now());
+  frame_update_time += SDL_GetPerformanceCounter() - update_start;
+
   blit_input->rumble_controllers(blit::vibration);
 
   blit_multiplayer->update();
 
+  tick_count++;
+
   return rendered;
 }
 
@@ -419,6 +527,54 @@ void System::update_texture(SDL_Texture *texture) {
     SDL_UpdateTexture(texture, &dest_rect, framebuffer, stride);
 }
 
+// screen with the keyed pixels transparent for the renderer to draw over the layers
+void System::update_keyed_texture(SDL_Texture *texture, const blit::Pen &key) {
+  bool is_lores = _mode == blit::ScreenMode::lores;
+
+  SDL_Rect dest_rect{0, 0, is_lores ? width / 2 : width, is_lores ? height / 2 : height};
+  blit::Surface surface(framebuffer, cur_format, blit::Size(dest_rect.w, dest_rect.h));
+
+  void *pixels;
+  int pitch;
+  if(SDL_LockTexture(texture, &dest_rect, &pixels, &pitch) == 0) {
+    blit::screen_layer_to_rgba(surface, palette, true, key, (uint8_t *)pixels, pitch);
+    SDL_UnlockTexture(texture);
+  }
+}
+
+void System::update_layer_texture(SDL_Texture *texture, const blit::ScreenLayer &layer) {
+  void *pixels;
+  int pitch;
+  if(SDL_LockTexture(texture, nullptr, &pixels, &pitch) == 0) {
+    blit::Surface surface(const_cast<uint8_t *>(layer.data), layer.format, layer.bounds);
+    blit::screen_layer_to_rgba(surface, palette, layer.use_key, layer.key, (uint8_t *)pixels, pitch);
+    SDL_UnlockTexture(texture);
+  }
+}
+
+Uint32 System::palette_version() {
+  return palette_changes;
+}
+
+// the renderer draws the layers as textures, unless something needs them in the screen surface
+bool System::needs_layers_in_screen() {
+  if(headless || frame_check)
+    return true;
+
+#ifdef VIDEO_CAPTURE
+  // recordings are copied from the screen
+  if(blit_capture && blit_capture->recording())
+    return true;
+#endif
+
+  return cur_format != blit::PixelFormat::RGB && cur_format != blit::PixelFormat::RGB565 && cur_format != blit::PixelFormat::P;
+}
+
+// decided at render, so it still matches the screen if recording starts before the frame is presented
+bool System::renderer_draws_layers() {
+  return !layers_composited;
+}
+
 void System::notify_redraw() {
 	SDL_SemPost(s_loop_redraw);
 }
@@ -449,20 +605,86 @@ void System::set_button(int button, bool state) {
 	SDL_UnlockMutex(m_input);
 }
 
+// must be called before run
+void System::set_input_log(InputLog *log) {
+	input_log = log;
+
+	// games reading now_us() would see different times on replay without the virtual us timer
+	fixed_timestep = true;
+	virtual_us_timer = true;
+	set_random_seed(log->get_seed());
+}
+
+// must be called before run
+void System::set_frame_check(FrameCheck *check) {
+	frame_check = check;
+
+	// frames can only match if time does, even in a capped window
+	fixed_timestep = true;
+	virtual_us_timer = true;
+}
+
+void System::set_random_seed(uint32_t seed) {
+	random_generator.seed(seed);
+}
+
+void System::set_uncapped(bool uncapped) {
+	this->uncapped = uncapped;
+
+	if(uncapped) {
+		fixed_timestep = true;
+		virtual_us_timer = true;
+	}
+}
+
+// quit after this many frames have been rendered
+void System::set_frame_limit(uint32_t frames) {
+	frame_limit = frames;
+}
+
+void System::quit() {
+	if(headless) {
+		running = false;
+		return;
+	}
+
+	SDL_Event event = {};
+	event.type = SDL_QUIT;
+	SDL_PushEvent(&event);
+}
+
+void System::print_timings() {
+	if(!frame_count)
+		return;
+
+	auto freq = SDL_GetPerformanceFrequency();
+	auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+
+	std::cout << frame_count << " frames in " << elapsed.count() << "ms" << std::endl;
+	std::cout << " update avg " << total_update_time * 1000000 / freq / frame_count << "us max " << max_update_time * 1000000 / freq << "us" << std::endl;
+	std::cout << " render avg " << total_render_time * 1000000 / freq / frame_count << "us max " << max_render_time * 1000000 / freq << "us" << std::endl;
+}
+
 void System::stop() {
   int returnValue;
   running = false;
 
-  // make sure the update thread is not waiting for a render to complete
-  SDL_SemPost(s_loop_redraw);
+  // headless runs on the main thread
+  if(!headless) {
+    // make sure the update thread is not waiting for a render to complete
+    SDL_SemPost(s_loop_redraw);
+
+    if(SDL_SemWaitTimeout(s_loop_ended, 500)) {
+      std::cerr << "User code appears to have frozen. Detaching thread." << std::endl;
+      SDL_DetachThread(t_system_loop);
+    } else {
+      SDL_WaitThread(t_system_loop, &returnValue);
+    }
 
-  if(SDL_SemWaitTimeout(s_loop_ended, 500)) {
-    std::cerr << "User code appears to have frozen. Detaching thread." << std::endl;
-    SDL_DetachThread(t_system_loop);
-  } else {
-    SDL_WaitThread(t_system_loop, &returnValue);
+    SDL_SemPost(s_timer_stop);
+    SDL_WaitThread(t_system_timer, &returnValue);
   }
 
-  SDL_SemPost(s_timer_stop);
-  SDL_WaitThread(t_system_timer, &returnValue);
+  if(headless || uncapped || frame_limit)
+    print_timings();
 }
@@ -1,3 +1,11 @@
+class FrameCheck;
+class InputLog;
+
+namespace blit {
+  struct Pen;
+  struct ScreenLayer;
+}
+
 class System {
 	public:
 		static const Uint32 timer_event;
@@ -13,6 +21,7 @@ class System {
 		~System();
 
 		void run();
+		void run_headless();
 		void stop();
 
 		int update_thread();
@@ -26,11 +35,28 @@ class System {
 		void update_texture(SDL_Texture *);
 		void notify_redraw();
 
+		// screen layers drawn by the renderer
+		bool renderer_draws_layers();
+		void update_keyed_texture(SDL_Texture *texture, const blit::Pen &key);
+		void update_layer_texture(SDL_Texture *texture, const blit::ScreenLayer &layer);
+		Uint32 palette_version();
+
 		void set_joystick(int axis, float value);
 		void set_tilt(int axis, float value);
 		void set_button(int button, bool state);
 
+		void set_input_log(InputLog *log);
+		void set_frame_check(FrameCheck *check);
+		void set_random_seed(uint32_t seed);
+
+		// benchmarking options, set before run
+		void set_uncapped(bool uncapped);
+		void set_frame_limit(uint32_t frames);
+
 	private:
+		void quit();
+		void print_timings();
+		bool needs_layers_in_screen();
 
 		SDL_Thread *t_system_timer = nullptr;
 		SDL_Thread *t_system_loop = nullptr;
@@ -43,8 +69,24 @@ class System {
 		SDL_sem *s_loop_ended = nullptr;
 
 		bool running = false;
+		bool headless = false;
+		bool uncapped = false;
 
 		Uint32 last_render_time = 0;
+		bool layers_composited = false; // into the screen by the last render
+
+		InputLog *input_log = nullptr;
+		uint32_t tick_count = 0;
+		bool replay_ended = false;
+
+		FrameCheck *frame_check = nullptr;
+
+		// frame timings
+		uint32_t frame_limit = 0;
+		uint32_t frame_count = 0;
+		Uint64 frame_update_time = 0;
+		Uint64 total_update_time = 0, total_render_time = 0;
+		Uint64 max_update_time = 0, max_render_time = 0;
 
 		// shadow input
 		Uint32 shadow_buttons = 0;
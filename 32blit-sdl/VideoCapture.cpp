@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cstring>
 #include <iomanip>
 #include <sstream>
 #include <iostream>
@@ -5,9 +7,12 @@
 
 #include "VideoCapture.hpp"
 
-#include "Renderer.hpp"
+#include "Audio.hpp"
 #include "System.hpp"
 
+#include "engine/engine.hpp"
+#include "graphics/compositor.hpp"
+
 #include "VideoCaptureFfmpeg.hpp"
 
 inline std::tm localtime_xp(std::time_t timer)
@@ -27,19 +32,59 @@ inline std::tm localtime_xp(std::time_t timer)
 }
 
 VideoCapture::VideoCapture(const char *name) : name(name) {
-	;
+	m_frames = SDL_CreateMutex();
+	m_audio = SDL_CreateMutex();
+	s_queued = SDL_CreateSemaphore(0);
+
+	for (auto &frame : frames)
+		frame.data.resize(System::max_width * System::max_height * 3);
 }
 
 VideoCapture::~VideoCapture() {
-	if (buffer) {
+	if (active) {
 		std::cerr << "Warning: recording was not stopped before exiting." << std::endl;
 		stop();
 	}
+
+	SDL_DestroySemaphore(s_queued);
+	SDL_DestroyMutex(m_audio);
+	SDL_DestroyMutex(m_frames);
 }
 
 void VideoCapture::start(const char *filename) {
-	buffer = (Uint8 *)malloc(System::width * System::height * SDL_BYTESPERPIXEL(SDL_PIXELFORMAT_RGB24));
-	ffmpeg_open_stream(filename, System::width, System::height, buffer);
+	if (ffmpeg_open_stream(filename, System::width, System::height, Audio::sample_rate) != 0) {
+		std::cerr << "Failed to start recording to " << filename << std::endl;
+		return;
+	}
+
+	free_frames.clear();
+	queued_frames.clear();
+	for (auto &frame : frames)
+		free_frames.push_back(&frame);
+
+	frame_index = 0;
+	dropped = 0;
+	max_queued = 0;
+	stopping = false;
+
+	SDL_LockMutex(m_audio);
+	audio_in.clear();
+	active = true;
+	SDL_UnlockMutex(m_audio);
+
+	t_encode = SDL_CreateThread(encode_thread, "VideoCapture", (void *)this);
+
+	if (!t_encode) {
+		std::cerr << "Failed to start the encoder thread: " << SDL_GetError() << std::endl;
+
+		SDL_LockMutex(m_audio);
+		active = false;
+		SDL_UnlockMutex(m_audio);
+
+		ffmpeg_close_stream();
+		return;
+	}
+
 	std::cerr << "Started with filename " << filename << std::endl;
 }
 
@@ -51,18 +96,159 @@ void VideoCapture::start() {
 	start(filename.str().c_str());
 }
 
-void VideoCapture::capture(Renderer *source) {
-	if (buffer) {
-		source->read_pixels(System::width, System::height, SDL_PIXELFORMAT_RGB24, buffer);
-		ffmpeg_capture();
-	} else {
+// copies the screen to the queue, this needs to happen while the game can't draw to it
+void VideoCapture::capture(bool composite_layers) {
+	if (!active) {
 		std::cerr << "Not recording" << std::endl;
+		return;
 	}
+
+	auto &screen = blit::screen;
+	auto index = frame_index++;
+
+	SDL_LockMutex(m_frames);
+	Frame *frame = nullptr;
+	if (!free_frames.empty()) {
+		frame = free_frames.front();
+		free_frames.pop_front();
+	}
+	SDL_UnlockMutex(m_frames);
+
+	// encoder is behind, skip this one rather than blocking the game
+	if (!frame) {
+		dropped++;
+		return;
+	}
+
+	frame->index = index;
+	frame->bounds = screen.bounds;
+	frame->format = screen.format;
+	frame->stride = screen.bounds.w * screen.pixel_stride;
+
+	for (int y = 0; y < screen.bounds.h; y++)
+		memcpy(frame->data.data() + y * frame->stride, screen.data + y * screen.row_stride, frame->stride);
+
+	if (screen.format == blit::PixelFormat::P && screen.palette)
+		memcpy(frame->palette, screen.palette, sizeof(frame->palette));
+
+	// layers drawn by the renderer aren't in the screen, only for the frame rendered before recording started
+	if (composite_layers) {
+		blit::Surface copy(frame->data.data(), frame->format, frame->bounds);
+		blit::composite_screen_layers(copy);
+	}
+
+	SDL_LockMutex(m_frames);
+	queued_frames.push_back(frame);
+	max_queued = std::max(max_queued, queued_frames.size());
+	SDL_UnlockMutex(m_frames);
+
+	SDL_SemPost(s_queued);
+}
+
+// called from the audio callback
+void VideoCapture::add_audio(const int16_t *samples, int count) {
+	SDL_LockMutex(m_audio);
+	if (active)
+		audio_in.insert(audio_in.end(), samples, samples + count);
+	SDL_UnlockMutex(m_audio);
 }
 
 void VideoCapture::stop() {
+	if (!active)
+		return;
+
+	SDL_LockMutex(m_audio);
+	active = false;
+	SDL_UnlockMutex(m_audio);
+
+	// let the encoder finish what's already queued
+	SDL_LockMutex(m_frames);
+	stopping = true;
+	SDL_UnlockMutex(m_frames);
+
+	SDL_WaitThread(t_encode, nullptr);
+	t_encode = nullptr;
+
 	ffmpeg_close_stream();
-	free(buffer);
-	buffer = NULL;
-	std::cerr << "Stopped." << std::endl;
+
+	std::cerr << "Stopped. " << frame_index - dropped << " frames captured, " << dropped << " dropped, max " << max_queued << "/" << num_frames << " queued." << std::endl;
+}
+
+int VideoCapture::encode_thread(void *arg) {
+	auto capture = (VideoCapture *)arg;
+
+	while (true) {
+		bool have_frame = SDL_SemWaitTimeout(capture->s_queued, 20) == 0;
+
+		capture->encode_audio();
+
+		SDL_LockMutex(capture->m_frames);
+		Frame *frame = nullptr;
+		if (have_frame) {
+			frame = capture->queued_frames.front();
+			capture->queued_frames.pop_front();
+		}
+		bool done = !have_frame && capture->stopping;
+		SDL_UnlockMutex(capture->m_frames);
+
+		if (done)
+			break;
+
+		if (!frame)
+			continue;
+
+		capture->encode_frame(*frame);
+
+		SDL_LockMutex(capture->m_frames);
+		capture->free_frames.push_back(frame);
+		SDL_UnlockMutex(capture->m_frames);
+	}
+
+	return 0;
+}
+
+void VideoCapture::encode_frame(Frame &frame) {
+	auto w = frame.bounds.w, h = frame.bounds.h;
+
+	switch (frame.format) {
+		case blit::PixelFormat::RGB:
+			ffmpeg_write_video(frame.data.data(), w, h, frame.stride, false, frame.index);
+			break;
+
+		case blit::PixelFormat::RGB565:
+			ffmpeg_write_video(frame.data.data(), w, h, frame.stride, true, frame.index);
+			break;
+
+		case blit::PixelFormat::P: {
+			rgb_buffer.resize(w * h * 3);
+
+			auto in = frame.data.data();
+			auto out = rgb_buffer.data();
+
+			for (int i = 0; i < w * h; i++) {
+				auto &col = frame.palette[*in++];
+				*out++ = col.r;
+				*out++ = col.g;
+				*out++ = col.b;
+			}
+
+			ffmpeg_write_video(rgb_buffer.data(), w, h, w * 3, false, frame.index);
+			break;
+		}
+
+		default:
+			break;
+	}
+}
+
+void VideoCapture::encode_audio() {
+	// swap the buffers so the audio callback isn't waiting on the encoder
+	SDL_LockMutex(m_audio);
+	audio_out.swap(audio_in);
+	SDL_UnlockMutex(m_audio);
+
+	if (!audio_out.empty())
+		ffmpeg_write_audio(audio_out.data(), int(audio_out.size()));
+
+	audio_out.clear();
 }
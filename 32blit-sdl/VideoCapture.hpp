@@ -1,4 +1,8 @@
-class Renderer;
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "graphics/surface.hpp"
 
 class VideoCapture {
 	public:
@@ -7,11 +11,45 @@ class VideoCapture {
 
 		void start(const char *filename);
 		void start();
-		void capture(Renderer *source);
+		void capture(bool composite_layers);
+		void add_audio(const int16_t *samples, int count);
 		void stop();
-		bool recording() {return buffer;}
+		bool recording() {return active;}
 
 	private:
+		// a copy of the screen waiting to be encoded
+		struct Frame {
+			uint32_t index;
+			blit::Size bounds;
+			blit::PixelFormat format;
+			int stride;
+			std::vector<uint8_t> data;
+			blit::Pen palette[256];
+		};
+
+		static const int num_frames = 8;
+
+		static int encode_thread(void *arg);
+		void encode_frame(Frame &frame);
+		void encode_audio();
+
 		const char *name;
-		Uint8 *buffer = NULL;
+		bool active = false;
+		bool stopping = false;
+
+		// frames cycle from free_frames to queued_frames and back once encoded
+		Frame frames[num_frames];
+		std::deque<Frame *> free_frames, queued_frames;
+		SDL_mutex *m_frames;
+		SDL_sem *s_queued;
+		SDL_Thread *t_encode = nullptr;
+
+		// mixer output since the last time the encoder got to it
+		std::vector<int16_t> audio_in, audio_out;
+		SDL_mutex *m_audio;
+
+		std::vector<uint8_t> rgb_buffer;
+
+		uint32_t frame_index = 0, dropped = 0;
+		size_t max_queued = 0;
 };
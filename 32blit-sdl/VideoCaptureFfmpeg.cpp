@@ -34,7 +34,7 @@
 
 extern "C" {
 #include <libavcodec/avcodec.h>
-#include <libavutil/avassert.h>
+#include <libavutil/audio_fifo.h>
 #include <libavutil/channel_layout.h>
 #include <libavutil/opt.h>
 #include <libavutil/mathematics.h>
@@ -58,19 +58,15 @@ typedef struct OutputStream {
 	int samples_count;
 	AVFrame *frame;
 	AVFrame *tmp_frame;
-	float t, tincr, tincr2;
 	struct SwsContext *sws_ctx;
 	struct SwrContext *swr_ctx;
+	AVAudioFifo *fifo;
 } OutputStream;
 
 
 OutputStream video_st, audio_st;
 AVFormatContext *oc;
-AVPixelFormat source_format = AV_PIX_FMT_RGB24;
-uint8_t *picture_source;
-int source_width = 0, source_height = 0;
 int have_video = 0, have_audio = 0;
-int encode_video = 0, encode_audio = 0;
 
 char *_av_err2str(int errnum) {
 	/* C++ friendly alternate to av_err2str */
@@ -143,7 +139,7 @@ static void add_stream(OutputStream *ost, AVFormatContext *oc,
 
     if ((*codec)->ch_layouts) {
       auto chan_layout = (*codec)->ch_layouts;
-      for (;chan_layout; chan_layout++) {
+      for (;chan_layout->nb_channels; chan_layout++) {
         if(chan_layout->nb_channels == 2) {
           av_channel_layout_copy(&c->ch_layout, chan_layout);
           break;
@@ -156,6 +152,7 @@ static void add_stream(OutputStream *ost, AVFormatContext *oc,
     }
 
 		ost->st->time_base = { 1, c->sample_rate };
+		c->time_base = ost->st->time_base;
 		break;
 	case AVMEDIA_TYPE_VIDEO:
 		c->codec_id = codec_id;
@@ -214,7 +211,7 @@ static AVFrame *alloc_audio_frame(enum AVSampleFormat sample_fmt,
 	}
 	return frame;
 }
-static void open_audio(AVFormatContext *oc, const AVCodec *codec, OutputStream *ost, AVDictionary *opt_arg)
+static void open_audio(AVFormatContext *oc, const AVCodec *codec, OutputStream *ost, AVDictionary *opt_arg, int source_rate)
 {
 	AVCodecContext *c;
 	int nb_samples;
@@ -229,19 +226,13 @@ static void open_audio(AVFormatContext *oc, const AVCodec *codec, OutputStream *
 		fprintf(stderr, "Could not open audio codec: %s\n", _av_err2str(ret));
 		exit(1);
 	}
-	/* init signal generator */
-	ost->t = 0;
-	ost->tincr = 2 * M_PI * 110.0 / c->sample_rate;
-	/* increment frequency by 110 Hz per second */
-	ost->tincr2 = 2 * M_PI * 110.0 / c->sample_rate / c->sample_rate;
 	if (c->codec->capabilities & AV_CODEC_CAP_VARIABLE_FRAME_SIZE)
 		nb_samples = 10000;
 	else
 		nb_samples = c->frame_size;
 	ost->frame = alloc_audio_frame(c->sample_fmt, &c->ch_layout,
 		c->sample_rate, nb_samples);
-	ost->tmp_frame = alloc_audio_frame(AV_SAMPLE_FMT_S16, &c->ch_layout,
-		c->sample_rate, nb_samples);
+	ost->tmp_frame = NULL;
 	/* copy the stream parameters to the muxer */
 	ret = avcodec_parameters_from_context(ost->st->codecpar, c);
 	if (ret < 0) {
@@ -254,11 +245,12 @@ static void open_audio(AVFormatContext *oc, const AVCodec *codec, OutputStream *
 		fprintf(stderr, "Could not allocate resampler context\n");
 		exit(1);
 	}
-	/* set options */
-	av_opt_set_int(ost->swr_ctx, "in_channel_count", c->ch_layout.nb_channels, 0);
-	av_opt_set_int(ost->swr_ctx, "in_sample_rate", c->sample_rate, 0);
+	/* mono 16 bit from the mixer, to whatever the encoder wants */
+	AVChannelLayout mono_layout = AV_CHANNEL_LAYOUT_MONO;
+	av_opt_set_chlayout(ost->swr_ctx, "in_chlayout", &mono_layout, 0);
+	av_opt_set_int(ost->swr_ctx, "in_sample_rate", source_rate, 0);
 	av_opt_set_sample_fmt(ost->swr_ctx, "in_sample_fmt", AV_SAMPLE_FMT_S16, 0);
-	av_opt_set_int(ost->swr_ctx, "out_channel_count", c->ch_layout.nb_channels, 0);
+	av_opt_set_chlayout(ost->swr_ctx, "out_chlayout", &c->ch_layout, 0);
 	av_opt_set_int(ost->swr_ctx, "out_sample_rate", c->sample_rate, 0);
 	av_opt_set_sample_fmt(ost->swr_ctx, "out_sample_fmt", c->sample_fmt, 0);
 	/* initialize the resampling context */
@@ -266,94 +258,89 @@ static void open_audio(AVFormatContext *oc, const AVCodec *codec, OutputStream *
 		fprintf(stderr, "Failed to initialize the resampling context\n");
 		exit(1);
 	}
-}
-/* Prepare a 16 bit dummy audio frame of 'frame_size' samples and
- * 'nb_channels' channels. */
-static AVFrame *get_audio_frame(OutputStream *ost)
-{
-	AVFrame *frame = ost->tmp_frame;
-	int j, i, v;
-	int16_t *q = (int16_t*)frame->data[0];
-	/* check if we want to generate more frames */
-	/*if (av_compare_ts(ost->next_pts, ost->enc->time_base,
-		(int64_t)STREAM_DURATION, { 1, 1 }) >= 0)
-		return NULL;*/
-	for (j = 0; j < frame->nb_samples; j++) {
-		v = (int)(sin(ost->t) * 10000);
-		for (i = 0; i < ost->enc->ch_layout.nb_channels; i++)
-			*q++ = v;
-		ost->t += ost->tincr;
-		ost->tincr += ost->tincr2;
+	/* the encoder takes fixed size frames, but samples arrive in whatever size the mixer was asked for */
+	ost->fifo = av_audio_fifo_alloc(c->sample_fmt, c->ch_layout.nb_channels, nb_samples);
+	if (!ost->fifo) {
+		fprintf(stderr, "Could not allocate audio FIFO\n");
+		exit(1);
 	}
-	frame->pts = ost->next_pts;
-	ost->next_pts += frame->nb_samples;
-	return frame;
 }
 /*
- * encode one audio frame and send it to the muxer
- * return 1 when encoding is finished, 0 otherwise
+ * send a frame to the encoder (NULL to flush it) and write any packets
+ * that come out to the muxer
  */
-static int write_audio_frame(AVFormatContext *oc, OutputStream *ost)
+static int encode_frame(AVFormatContext *oc, OutputStream *ost, AVFrame *frame)
 {
-	AVCodecContext *c;
-	AVPacket pkt = {}; // data and size must be 0;
-	AVFrame *frame;
-	int ret;
-	//int got_packet;
-	int dst_nb_samples;
-	av_init_packet(&pkt);
-	c = ost->enc;
-	frame = get_audio_frame(ost);
-	if (frame) {
-		/* convert samples from native format to destination codec format, using the resampler */
-			/* compute destination number of samples */
-		dst_nb_samples = av_rescale_rnd(swr_get_delay(ost->swr_ctx, c->sample_rate) + frame->nb_samples,
-			c->sample_rate, c->sample_rate, AV_ROUND_UP);
-		av_assert0(dst_nb_samples == frame->nb_samples);
-		/* when we pass a frame to the encoder, it may keep a reference to it
-		 * internally;
-		 * make sure we do not overwrite it here
-		 */
-		ret = av_frame_make_writable(ost->frame);
-		if (ret < 0)
-			exit(1);
-		/* convert to destination format */
-		ret = swr_convert(ost->swr_ctx,
-			ost->frame->data, dst_nb_samples,
-			(const uint8_t **)frame->data, frame->nb_samples);
-		if (ret < 0) {
-			fprintf(stderr, "Error while converting: %s\n", _av_err2str(ret));
-			exit(1);
-		}
-		frame = ost->frame;
-		frame->pts = av_rescale_q(ost->samples_count, { 1, c->sample_rate }, c->time_base);
-		ost->samples_count += dst_nb_samples;
-	}
-	ret = avcodec_send_frame(c, frame);
+	AVCodecContext *c = ost->enc;
+	int ret = avcodec_send_frame(c, frame);
 	if (ret < 0) {
 		fprintf(stderr, "error sending frame for encoding: %s\n", _av_err2str(ret));
-		return -1;
+		return ret;
 	}
 
+	AVPacket *pkt = av_packet_alloc();
+
 	while (ret >= 0) {
-		ret = avcodec_receive_packet(c, &pkt);
+		ret = avcodec_receive_packet(c, pkt);
 		if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-			return 0;
+			ret = 0;
+			break;
 		}
 		else if (ret < 0) {
 			fprintf(stderr, "Error during encoding: %s\n", _av_err2str(ret));
-			return ret;
+			break;
 		}
 
-		printf("Encoded frame %3" PRId64 " (size=%5d)\n", pkt.pts, pkt.size);
-		ret = write_frame(oc, &c->time_base, ost->st, &pkt);
+		ret = write_frame(oc, &c->time_base, ost->st, pkt);
 		if (ret != 0) {
 			fprintf(stderr, "Error writing frame: %s\n", _av_err2str(ret));
 		}
-		av_packet_unref(&pkt);
+		av_packet_unref(pkt);
+	}
+
+	av_packet_free(&pkt);
+	return ret;
+}
+/*
+ * resample mixer output and encode every full frame of it
+ */
+static int write_audio(AVFormatContext *oc, OutputStream *ost, const int16_t *samples, int count)
+{
+	AVCodecContext *c = ost->enc;
+	uint8_t **converted = NULL;
+	int ret;
+
+	int max_out = swr_get_out_samples(ost->swr_ctx, count);
+	if (max_out > 0) {
+		ret = av_samples_alloc_array_and_samples(&converted, NULL, c->ch_layout.nb_channels, max_out, c->sample_fmt, 0);
+		if (ret < 0)
+			return ret;
+
+		ret = swr_convert(ost->swr_ctx, converted, max_out, (const uint8_t **)&samples, count);
+		if (ret > 0)
+			av_audio_fifo_write(ost->fifo, (void **)converted, ret);
+
+		av_freep(&converted[0]);
+		av_freep(&converted);
 	}
 
-	return 1;
+	while (av_audio_fifo_size(ost->fifo) >= ost->frame->nb_samples) {
+		/* the encoder may still hold a reference to the last frame */
+		ret = av_frame_make_writable(ost->frame);
+		if (ret < 0)
+			return ret;
+
+		av_audio_fifo_read(ost->fifo, (void **)ost->frame->data, ost->frame->nb_samples);
+
+		ost->frame->pts = ost->samples_count;
+		ost->samples_count += ost->frame->nb_samples;
+
+		ret = encode_frame(oc, ost, ost->frame);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
 }
 /**************************************************************/
 /* video output */
@@ -394,18 +381,8 @@ static void open_video(AVFormatContext *oc, const AVCodec *codec, OutputStream *
 		fprintf(stderr, "Could not allocate video frame\n");
 		exit(1);
 	}
-	/* If the output format is not YUV420P, then a temporary YUV420P
-	 * picture is needed too. It is then converted to the required
-	 * output format. */
+	/* frames are converted straight from the captured data */
 	ost->tmp_frame = NULL;
-	if (c->pix_fmt != source_format) {
-		//ost->tmp_frame = alloc_picture(AV_PIX_FMT_YUV420P, c->width, c->height);
-		ost->tmp_frame = alloc_picture(source_format, source_width, source_height);
-		if (!ost->tmp_frame) {
-			fprintf(stderr, "Could not allocate temporary picture\n");
-			exit(1);
-		}
-	}
 	/* copy the stream parameters to the muxer */
 	ret = avcodec_parameters_from_context(ost->st->codecpar, c);
 	if (ret < 0) {
@@ -414,17 +391,10 @@ static void open_video(AVFormatContext *oc, const AVCodec *codec, OutputStream *
 	}
 }
 
-static void fill_from_source(AVFrame *pict, int frame_index, int width, int height) {
-  int bpp = 3;
-
-  for(int y = 0; y < height; y++) {
-    for(int i = 0; i < width * bpp; i++) {
-      pict->data[0][y * pict->linesize[0] + i] = picture_source[y * width * bpp + i];
-    }
-  }
-}
-
-static AVFrame *get_video_frame(OutputStream *ost)
+/*
+ * scale and convert a captured frame and encode it
+ */
+static int write_video(AVFormatContext *oc, OutputStream *ost, const uint8_t *data, int width, int height, int stride, AVPixelFormat format, int64_t pts)
 {
 	AVCodecContext *c = ost->enc;
 	/* when we pass a frame to the encoder, it may keep a reference to it
@@ -432,8 +402,9 @@ static AVFrame *get_video_frame(OutputStream *ost)
 	if (av_frame_make_writable(ost->frame) < 0)
 		exit(1);
 
-	ost->sws_ctx = sws_getCachedContext(ost->sws_ctx, ost->tmp_frame->width, ost->tmp_frame->height,
-		source_format,
+	/* the screen can change size and format between frames */
+	ost->sws_ctx = sws_getCachedContext(ost->sws_ctx, width, height,
+		format,
 		c->width, c->height,
 		c->pix_fmt,
 		SCALE_FLAGS, NULL, NULL, NULL);
@@ -443,52 +414,14 @@ static AVFrame *get_video_frame(OutputStream *ost)
 		exit(1);
 	}
 
-	fill_from_source(ost->tmp_frame, (int)ost->next_pts, ost->tmp_frame->width, ost->tmp_frame->height);
-	sws_scale(ost->sws_ctx, (const uint8_t * const *)ost->tmp_frame->data,
-		ost->tmp_frame->linesize, 0, ost->tmp_frame->height, ost->frame->data,
+	sws_scale(ost->sws_ctx, &data, &stride, 0, height, ost->frame->data,
 		ost->frame->linesize);
 
-	ost->frame->pts = ost->next_pts++;
-	return ost->frame;
-}
-/*
- * encode one video frame and send it to the muxer
- * return 1 when encoding is finished, 0 otherwise
- */
-static int write_video_frame(AVFormatContext *oc, OutputStream *ost)
-{
-	int ret;
-	AVCodecContext *c;
-	AVFrame *frame;
-	AVPacket pkt = {};
-	c = ost->enc;
-	frame = get_video_frame(ost);
-	av_init_packet(&pkt);
-	/* encode the image */
-	ret = avcodec_send_frame(c, frame);
-	if (ret < 0) {
-		fprintf(stderr, "error sending frame for encoding!\n");
-		return -1;
-	}
+	/* skipped frames leave a gap in the timestamps rather than shifting everything after them */
+	ost->frame->pts = pts;
+	ost->next_pts = pts + 1;
 
-	while (ret >= 0) {
-		ret = avcodec_receive_packet(c, &pkt);
-		if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-			return 0;
-		}
-		else if (ret < 0) {
-			fprintf(stderr, "Error during encoding: %d\n", ret);
-			return ret;
-		}
-		printf("Encoded frame %3" PRId64 " (size=%5d)\n", pkt.pts, pkt.size);
-		ret = write_frame(oc, &c->time_base, ost->st, &pkt);
-		if (ret != 0) {
-			fprintf(stderr, "Error writing frame!\n");
-		}
-		av_packet_unref(&pkt);
-	}
-
-	return 1;
+	return encode_frame(oc, ost, ost->frame);
 }
 static void close_stream(AVFormatContext *oc, OutputStream *ost)
 {
@@ -497,23 +430,42 @@ static void close_stream(AVFormatContext *oc, OutputStream *ost)
 	av_frame_free(&ost->tmp_frame);
 	sws_freeContext(ost->sws_ctx);
 	swr_free(&ost->swr_ctx);
+	if (ost->fifo)
+		av_audio_fifo_free(ost->fifo);
+	ost->fifo = NULL;
 }
 /**************************************************************/
 /* media file output */
 
+/* frees everything ffmpeg_open_stream allocated, whether it got as far as writing the header or not */
+static void free_output(void)
+{
+	if (have_video)
+		close_stream(oc, &video_st);
+	if (have_audio)
+		close_stream(oc, &audio_st);
+	have_video = have_audio = 0;
+
+	if (!(oc->oformat->flags & AVFMT_NOFILE)) {
+		/* Close the output file. */
+		avio_closep(&oc->pb);
+	}
+
+	audio_st = OutputStream();
+	video_st = OutputStream();
+
+	/* free the stream */
+	avformat_free_context(oc);
+	oc = NULL;
+}
+
 //int main(int argc, char **argv)
-int ffmpeg_open_stream(const char *filename, int width, int height, uint8_t *pic_src) {
+int ffmpeg_open_stream(const char *filename, int width, int height, int audio_rate) {
 
 	const AVOutputFormat *fmt;
 	const AVCodec *audio_codec = NULL, *video_codec = NULL;
 	int ret;
 	AVDictionary *opt = NULL;
-	AVPixelFormat src_fmt = AV_PIX_FMT_RGB24;
-
-	source_format = src_fmt;
-	picture_source = pic_src;
-	source_width = width;
-	source_height = height;
 
 	/* allocate the output media context */
 	avformat_alloc_output_context2(&oc, NULL, NULL, filename);
@@ -529,20 +481,18 @@ int ffmpeg_open_stream(const char *filename, int width, int height, uint8_t *pic
 	if (fmt->video_codec != AV_CODEC_ID_NONE) {
 		add_stream(&video_st, oc, &video_codec, fmt->video_codec, width * 2, height * 2);
 		have_video = 1;
-		encode_video = 1;
 	}
-	/*if (fmt->audio_codec != AV_CODEC_ID_NONE) {
+	if (audio_rate && fmt->audio_codec != AV_CODEC_ID_NONE) {
 		add_stream(&audio_st, oc, &audio_codec, fmt->audio_codec, 0, 0);
 		have_audio = 1;
-		encode_audio = 1;
-	}*/
+	}
 	/* Now that all the parameters are set, we can open the audio and
 	 * video codecs and allocate the necessary encode buffers. */
 	if (have_video)
 		open_video(oc, video_codec, &video_st, opt);
 
 	if (have_audio)
-		open_audio(oc, audio_codec, &audio_st, opt);
+		open_audio(oc, audio_codec, &audio_st, opt, audio_rate);
 
 	av_dump_format(oc, 0, filename, 1);
 	/* open the output file, if needed */
@@ -551,6 +501,7 @@ int ffmpeg_open_stream(const char *filename, int width, int height, uint8_t *pic
 		if (ret < 0) {
 			fprintf(stderr, "Could not open '%s': %s\n", filename,
 				_av_err2str(ret));
+			free_output();
 			return 1;
 		}
 	}
@@ -559,27 +510,28 @@ int ffmpeg_open_stream(const char *filename, int width, int height, uint8_t *pic
 	if (ret < 0) {
 		fprintf(stderr, "Error occurred when opening output file: %s\n",
 			_av_err2str(ret));
+		free_output();
 		return 1;
 	}
 
 	return 0;
 }
 
-int ffmpeg_capture(void)
+// stride is in bytes, rgb565 selects between 16 and 24 bit pixels
+int ffmpeg_write_video(const uint8_t *data, int width, int height, int stride, bool rgb565, int64_t frame_index)
 {
-	if (encode_video || encode_audio) {
-		/* select the stream to encode */
-		if (encode_video &&
-			(!encode_audio || av_compare_ts(video_st.next_pts, video_st.enc->time_base,
-				audio_st.next_pts, audio_st.enc->time_base) <= 0)) {
-			encode_video = !write_video_frame(oc, &video_st);
-		}
-		else {
-			encode_audio = !write_audio_frame(oc, &audio_st);
-		}
-	}
+	if (!have_video)
+		return 0;
 
-	return 0;
+	return write_video(oc, &video_st, data, width, height, stride, rgb565 ? AV_PIX_FMT_RGB565LE : AV_PIX_FMT_RGB24, frame_index);
+}
+
+int ffmpeg_write_audio(const int16_t *samples, int count)
+{
+	if (!have_audio)
+		return 0;
+
+	return write_audio(oc, &audio_st, samples, count);
 }
 
 int ffmpeg_close_stream(void) {
@@ -587,27 +539,16 @@ int ffmpeg_close_stream(void) {
 	 * close the CodecContexts open when you wrote the header; otherwise
 	 * av_write_trailer() may try to use memory that was freed on
 	 * av_codec_close(). */
-	av_write_trailer(oc);
-	/* Close each codec. */
-	if (have_video) {
-		close_stream(oc, &video_st);
-		video_st.next_pts = 0;
-		video_st.samples_count = 0;
-	}
-	if (have_audio) {
-		close_stream(oc, &audio_st);
-		audio_st.next_pts = 0;
-		audio_st.samples_count = 0;
-	}
-	if (!(oc->oformat->flags & AVFMT_NOFILE)) {
-		/* Close the output file. */
-		avio_closep(&oc->pb);
-	}
 
-	audio_st = OutputStream();
-	video_st = OutputStream();
+	/* get the frames still buffered in the encoders */
+	if (have_video)
+		encode_frame(oc, &video_st, NULL);
+	if (have_audio)
+		encode_frame(oc, &audio_st, NULL);
 
-	/* free the stream */
-	avformat_free_context(oc);
+	av_write_trailer(oc);
+
+	/* Close each codec and the output file. */
+	free_output();
 	return 0;
 }
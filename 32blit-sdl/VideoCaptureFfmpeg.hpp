@@ -1,3 +1,6 @@
-int ffmpeg_open_stream(const char *filename, int width, int height, uint8_t *picture_source);
+#include <cstdint>
+
+int ffmpeg_open_stream(const char *filename, int width, int height, int audio_rate);
 int ffmpeg_close_stream(void);
-int ffmpeg_capture(void);
+int ffmpeg_write_video(const uint8_t *data, int width, int height, int stride, bool rgb565, int64_t frame_index);
+int ffmpeg_write_audio(const int16_t *samples, int count);
@@ -1,11 +1,27 @@
 
+#include <algorithm>
+#include <cstring>
+
 #include "ff.h"
 #include "diskio.h"
 
 #include "fatfs_blit_api.hpp"
 
+// file handle with read-ahead cache
+struct CachedFile {
+  FIL fil;
+
+  uint8_t *cache = nullptr;
+  uint32_t cache_offset = 0;
+  uint32_t cache_len = 0;
+
+  uint32_t last_read_end = 0;
+};
+
 std::vector<void *> open_files;
 
+static ReadCacheStats read_cache_stats;
+
 [[gnu::weak]]
 bool is_filesystem_access_disabled() {
   return false;
@@ -24,7 +40,7 @@ void *open_file(const std::string &file, int mode) {
   if(is_filesystem_access_disabled())
     return nullptr;
 
-  FIL *f = new FIL();
+  auto f = new CachedFile();
 
   BYTE ff_mode = 0;
 
@@ -37,7 +53,7 @@ void *open_file(const std::string &file, int mode) {
   if(mode == blit::OpenMode::write)
     ff_mode |= FA_CREATE_ALWAYS;
 
-  FRESULT r = f_open(f, file.c_str(), ff_mode);
+  FRESULT r = f_open(&f->fil, file.c_str(), ff_mode);
 
   if(r == FR_OK) {
     open_files.push_back(f);
@@ -48,9 +64,8 @@ void *open_file(const std::string &file, int mode) {
   return nullptr;
 }
 
-int32_t read_file(void *fh, uint32_t offset, uint32_t length, char *buffer) {
+static int32_t read_uncached(FIL *f, uint32_t offset, uint32_t length, char *buffer) {
   FRESULT r = FR_OK;
-  FIL *f = (FIL *)fh;
 
   if(offset != f_tell(f))
     r = f_lseek(f, offset);
@@ -66,9 +81,68 @@ int32_t read_file(void *fh, uint32_t offset, uint32_t length, char *buffer) {
   return -1;
 }
 
+int32_t read_file(void *fh, uint32_t offset, uint32_t length, char *buffer) {
+  auto f = (CachedFile *)fh;
+
+  // sequential if this read starts where the last one ended
+  bool sequential = offset == f->last_read_end;
+  f->last_read_end = offset + length;
+
+  int32_t total_read = 0;
+
+  while(length) {
+    // serve what we can from the cache
+    if(f->cache_len && offset >= f->cache_offset && offset < f->cache_offset + f->cache_len) {
+      uint32_t cache_pos = offset - f->cache_offset;
+      uint32_t copy_len = std::min(length, f->cache_len - cache_pos);
+
+      memcpy(buffer, f->cache + cache_pos, copy_len);
+      buffer += copy_len;
+      offset += copy_len;
+      length -= copy_len;
+      total_read += copy_len;
+
+      read_cache_stats.hits++;
+      continue;
+    }
+
+    read_cache_stats.misses++;
+
+    // large or random reads go straight to the file
+    if(FATFS_BLIT_READ_CACHE_SIZE == 0 || length >= FATFS_BLIT_READ_CACHE_SIZE || !sequential) {
+      auto bytes_read = read_uncached(&f->fil, offset, length, buffer);
+      if(bytes_read < 0)
+        return total_read ? total_read : -1;
+
+      return total_read + bytes_read;
+    }
+
+    // small sequential read, fill the cache
+    if(!f->cache)
+      f->cache = new uint8_t[FATFS_BLIT_READ_CACHE_SIZE];
+
+    auto bytes_read = read_uncached(&f->fil, offset, FATFS_BLIT_READ_CACHE_SIZE, (char *)f->cache);
+
+    if(bytes_read <= 0) {
+      f->cache_len = 0;
+      return total_read ? total_read : bytes_read;
+    }
+
+    f->cache_offset = offset;
+    f->cache_len = bytes_read;
+  }
+
+  return total_read;
+}
+
 int32_t write_file(void *fh, uint32_t offset, uint32_t length, const char *buffer) {
   FRESULT r = FR_OK;
-  FIL *f = (FIL *)fh;
+  auto cf = (CachedFile *)fh;
+  FIL *f = &cf->fil;
+
+  // invalidate anything cached
+  cf->cache_len = 0;
+  cf->last_read_end = ~0u;
 
   if(offset != f_tell(f))
     r = f_lseek(f, offset);
@@ -87,7 +161,9 @@ int32_t write_file(void *fh, uint32_t offset, uint32_t length, const char *buffe
 int32_t close_file(void *fh) {
   FRESULT r;
 
-  r = f_close((FIL *)fh);
+  auto f = (CachedFile *)fh;
+
+  r = f_close(&f->fil);
 
   for(auto it = open_files.begin(); it != open_files.end(); ++it) {
     if(*it == fh) {
@@ -96,12 +172,21 @@ int32_t close_file(void *fh) {
     }
   }
 
-  delete (FIL *)fh;
+  delete[] f->cache;
+  delete f;
   return r == FR_OK ? 0 : -1;
 }
 
 uint32_t get_file_length(void *fh) {
-  return f_size((FIL *)fh);
+  return f_size(&((CachedFile *)fh)->fil);
+}
+
+ReadCacheStats get_read_cache_stats() {
+  return read_cache_stats;
+}
+
+void reset_read_cache_stats() {
+  read_cache_stats = {};
 }
 
 void list_files(const std::string &path, std::function<void(blit::FileInfo &)> callback) {
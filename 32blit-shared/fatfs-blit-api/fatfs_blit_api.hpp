@@ -7,6 +7,16 @@
 
 #include "engine/file.hpp"
 
+// size of the per-file read-ahead buffer, 0 to disable
+#ifndef FATFS_BLIT_READ_CACHE_SIZE
+#define FATFS_BLIT_READ_CACHE_SIZE 2048
+#endif
+
+struct ReadCacheStats {
+  uint32_t hits = 0;
+  uint32_t misses = 0;
+};
+
 bool get_files_open();
 void close_open_files();
 
@@ -21,3 +31,6 @@ bool directory_exists(const std::string &path);
 bool create_directory(const std::string &path);
 bool rename_file(const std::string &old_name, const std::string &new_name);
 bool remove_file(const std::string &path);
+
+ReadCacheStats get_read_cache_stats();
+void reset_read_cache_stats();
@@ -25,6 +25,7 @@ namespace display {
 
   void init();
 
+  bool draws_screen_layers();
   void enable_vblank_interrupt();
 
   SurfaceInfo &set_screen_mode(ScreenMode new_mode);
@@ -25,6 +25,7 @@
 #include "usbd_cdc_if.h"
 
 #include "engine/api_private.hpp"
+#include "graphics/compositor.hpp"
 
 #include "SystemMenu/system_menu_controller.hpp"
 
@@ -184,6 +185,8 @@ static GameMetadata get_metadata() {
 static void do_render() {
   if(display::needs_render) {
     blit::render(blit::now());
+    if(!display::draws_screen_layers())
+      blit::composite_screen_layers(blit::screen);
     display::enable_vblank_interrupt();
   }
 }
@@ -421,6 +424,8 @@ void blit_init() {
   api.cdc_write = cdc_write;
   api.cdc_read = cdc_read;
 
+  api.set_screen_layers = blit::compositor_set_layers;
+
   display::init();
 
   multiplayer::init();
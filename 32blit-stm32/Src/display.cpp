@@ -1,9 +1,11 @@
 #include <stdint.h>
+#include <algorithm>
 #include <cstring>
 
 #include "spi-st7272a.h"
 #include "32blit.hpp"
 #include "engine/api_private.hpp"
+#include "graphics/compositor.hpp"
 
 #include "display.hpp"
 #include "stm32h7xx_ll_dma2d.h"
@@ -23,6 +25,8 @@ namespace display {
   static void dma2d_lores_flip_step3();
   static void dma2d_lores_flip_step4();
 
+  static bool dma2d_composite_step();
+
 	static void update_ltdc_for_mode();
 }
 
@@ -44,6 +48,11 @@ void DMA2D_IRQHandler(void){
   //clear the flag
 
   DMA2D->IFCR = (uint32_t)(0x1F);
+
+  // screen layers are a chain of transfers
+  if(display::dma2d_composite_step())
+    return;
+
 	uint32_t count = display::get_dma2d_count();
 	switch(count){
 		case 3:
@@ -87,6 +96,22 @@ namespace display {
 
   bool need_ltdc_mode_update = false;
 
+  // screen layers composited by DMA2D in flip, copied after render so the
+  // game can change them while the frame is sent
+  static const int max_dma2d_layers = 8;
+  static const int dma2d_band_height = 16;
+
+  static bool dma2d_layers_active = false;
+  static ScreenLayer dma2d_layers[max_dma2d_layers];
+  static int dma2d_layer_count = 0;
+  static uint8_t dma2d_screen_key = 0;
+  static uint32_t dma2d_clut[256];
+
+  // position in the composite, a band at a time so it stays ahead of the LTDC
+  static bool compositing = false;
+  static const uint8_t *composite_screen_data = nullptr;
+  static int composite_band_y, composite_item, composite_x, composite_y;
+
   void init() {
     // TODO: replace interrupt setup with non HAL method
     HAL_NVIC_SetPriority(LTDC_IRQn, 4, 4);
@@ -100,12 +125,60 @@ namespace display {
     needs_render = true;
   }
 
+  /**
+   * Returns true if flip draws the screen layers instead of the CPU.
+   *
+   * DMA2D has no colour key, so this uses the alpha of the CLUT and only
+   * works for paletted screens. Lores would need a second buffer to scale
+   * from and DTCM (where .data is) can't be read by DMA2D.
+   */
+  bool draws_screen_layers() {
+    uint8_t count;
+    Pen key;
+    auto layers = get_screen_layers(count, key);
+
+    if(!count || count > max_dma2d_layers || requested_mode == ScreenMode::lores || requested_format != PixelFormat::P)
+      return false;
+
+    for(int i = 0; i < count; i++) {
+      auto data = (uintptr_t)layers[i].data;
+      if(data >= D1_DTCMRAM_BASE && data < D1_DTCMRAM_BASE + 128 * 1024)
+        return false;
+    }
+
+    return true;
+  }
+
   void enable_vblank_interrupt() {
+    bool use_layers = draws_screen_layers();
+
     // set new mode after rendering first frame in it
-    if(mode != requested_mode || format != requested_format) {
+    if(mode != requested_mode || format != requested_format || use_layers != dma2d_layers_active) {
       mode = requested_mode;
       format = requested_format;
       need_ltdc_mode_update = true;
+
+      // the LTDC CLUT is only used without layers
+      if(dma2d_layers_active && !use_layers) {
+        palette_needs_update = 256;
+        palette_update_delay = 0;
+      }
+    }
+
+    dma2d_layers_active = use_layers;
+    dma2d_layer_count = 0;
+
+    if(use_layers) {
+      uint8_t count;
+      Pen key;
+      auto layers = get_screen_layers(count, key);
+
+      for(int i = 0; i < count; i++) {
+        if(is_screen_layer_visible(layers[i], format))
+          dma2d_layers[dma2d_layer_count++] = layers[i];
+      }
+
+      dma2d_screen_key = key.a;
     }
 
     // trigger interrupt when screen refresh reaches the 252nd scanline
@@ -249,6 +322,148 @@ namespace display {
     }
   }
 
+  static int wrap(int v, int size) {
+    v %= size;
+    return v < 0 ? v + size : v;
+  }
+
+  static void clean_dcache(const void *data, uint32_t size) {
+    auto start = (uintptr_t)data & ~31;
+    SCB_CleanDCache_by_Addr((uint32_t *)start, size + ((uintptr_t)data - start));
+  }
+
+  // loads the foreground CLUT from the palette with one index transparent (or none if -1)
+  static void dma2d_load_clut(int transparent) {
+    if(transparent >= 0)
+      dma2d_clut[transparent] &= 0x00FFFFFF;
+
+    clean_dcache(dma2d_clut, sizeof(dma2d_clut));
+
+    DMA2D->FGCMAR = (uintptr_t)dma2d_clut;
+    MODIFY_REG(DMA2D->FGPFCCR, DMA2D_FGPFCCR_CCM | DMA2D_FGPFCCR_CS, 255 << DMA2D_FGPFCCR_CS_Pos);
+
+    DMA2D->FGPFCCR |= DMA2D_FGPFCCR_START;
+    while(DMA2D->FGPFCCR & DMA2D_FGPFCCR_START);
+
+    if(transparent >= 0)
+      dma2d_clut[transparent] |= 0xFF000000;
+  }
+
+  // sets up a blend of part of an 8-bit image through the CLUT over the LTDC buffer
+  static void dma2d_setup_blend(const uint8_t *fg, int fg_offset, int x, int y, int w, int h) {
+    auto out = (uintptr_t)&__ltdc_start + (y * 320 + x) * 2;
+
+    MODIFY_REG(DMA2D->CR, DMA2D_CR_MODE, LL_DMA2D_MODE_M2M_BLEND);
+    // alpha from the CLUT
+    MODIFY_REG(DMA2D->FGPFCCR, DMA2D_FGPFCCR_CM | DMA2D_FGPFCCR_AM, LL_DMA2D_INPUT_MODE_L8);
+    DMA2D->FGMAR = (uintptr_t)fg;
+    DMA2D->FGOR = fg_offset;
+    MODIFY_REG(DMA2D->BGPFCCR, DMA2D_BGPFCCR_CM, LL_DMA2D_INPUT_MODE_RGB565);
+    DMA2D->BGMAR = out;
+    DMA2D->BGOR = 320 - w;
+    MODIFY_REG(DMA2D->OPFCCR, DMA2D_OPFCCR_CM, LL_DMA2D_OUTPUT_MODE_RGB565);
+    DMA2D->OMAR = out;
+    DMA2D->OOR = 320 - w;
+    DMA2D->NLR = (w << 16) | h;
+  }
+
+  // starts the next transfer of the composite, returns false when there are none left
+  static bool dma2d_composite_next() {
+    const int screen_w = 320, screen_h = 240;
+
+    if(composite_band_y >= screen_h)
+      return false;
+
+    int band_end = std::min(composite_band_y + dma2d_band_height, screen_h);
+
+    if(composite_item < 0) {
+      // key colour for where every layer is keyed
+      auto &key = palette[dma2d_screen_key];
+      MODIFY_REG(DMA2D->CR, DMA2D_CR_MODE, LL_DMA2D_MODE_R2M);
+      MODIFY_REG(DMA2D->OPFCCR, DMA2D_OPFCCR_CM, LL_DMA2D_OUTPUT_MODE_RGB565);
+      DMA2D->OCOLR = (key.b >> 3) << 11 | (key.g >> 2) << 5 | key.r >> 3;
+      DMA2D->OMAR = (uintptr_t)&__ltdc_start + composite_band_y * screen_w * 2;
+      DMA2D->OOR = 0;
+      DMA2D->NLR = (screen_w << 16) | (band_end - composite_band_y);
+
+      composite_item = 0;
+      composite_x = 0;
+      composite_y = composite_band_y;
+    } else if(composite_item < dma2d_layer_count) {
+      // a part of the layer that doesn't wrap
+      auto &layer = dma2d_layers[composite_item];
+
+      if(composite_x == 0 && composite_y == composite_band_y)
+        dma2d_load_clut(layer.use_key ? layer.key.a : -1);
+
+      int lx = wrap(composite_x + layer.offset.x, layer.bounds.w);
+      int ly = wrap(composite_y + layer.offset.y, layer.bounds.h);
+      int w = std::min(screen_w - composite_x, layer.bounds.w - lx);
+      int h = std::min(band_end - composite_y, layer.bounds.h - ly);
+
+      // paletted, so one byte per pixel
+      dma2d_setup_blend(layer.data + ly * layer.bounds.w + lx, layer.bounds.w - w, composite_x, composite_y, w, h);
+
+      composite_x += w;
+      if(composite_x == screen_w) {
+        composite_x = 0;
+        composite_y += h;
+      }
+
+      if(composite_y == band_end) {
+        composite_item++;
+        composite_y = composite_band_y;
+      }
+    } else {
+      // screen on top
+      dma2d_load_clut(dma2d_screen_key);
+      dma2d_setup_blend(composite_screen_data + composite_band_y * screen_w, 0, 0, composite_band_y, screen_w, band_end - composite_band_y);
+
+      composite_band_y = band_end;
+      composite_item = -1;
+    }
+
+    DMA2D->CR |= DMA2D_CR_START;
+    return true;
+  }
+
+  static void dma2d_composite_flip(const Surface &source) {
+    SCB_CleanInvalidateDCache_by_Addr((uint32_t *)(source.data), 320 * 240 * 1);
+
+    for(int i = 0; i < dma2d_layer_count; i++) {
+      auto &layer = dma2d_layers[i];
+      clean_dcache(layer.data, layer.bounds.w * layer.bounds.h);
+    }
+
+    // keys are made transparent as the CLUT is loaded
+    for(int i = 0; i < 256; i++)
+      dma2d_clut[i] = 0xFF000000 | palette[i].b << 16 | palette[i].g << 8 | palette[i].r;
+
+    composite_screen_data = source.data;
+    composite_band_y = 0;
+    composite_item = -1;
+    compositing = true;
+
+    //enable the DMA2D interrupt
+    SET_BIT(DMA2D->CR, DMA2D_CR_TCIE|DMA2D_CR_TEIE|DMA2D_CR_CEIE);
+    dma2d_step_count = 0;
+    dma2d_composite_next();
+  }
+
+  // called from the DMA2D interrupt, returns false if not compositing
+  static bool dma2d_composite_step() {
+    if(!compositing)
+      return false;
+
+    if(!dma2d_composite_next()) {
+      CLEAR_BIT(DMA2D->CR, DMA2D_CR_TCIE|DMA2D_CR_TEIE|DMA2D_CR_CEIE);
+      compositing = false;
+      needs_render = true;
+    }
+
+    return true;
+  }
+
   static void dma2d_lores_flip(const Surface &source) {
     SCB_CleanInvalidateDCache_by_Addr((uint32_t *)(source.data), 160 * 120 * 3);
 
@@ -373,7 +588,9 @@ namespace display {
     if(mode == ScreenMode::lores) {
       dma2d_lores_flip(source);
     } else { // hires(_palette)
-      if(format == PixelFormat::P)
+      if(format == PixelFormat::P && dma2d_layers_active)
+        dma2d_composite_flip(source);
+      else if(format == PixelFormat::P)
         dma2d_hires_pal_flip(source);
       else
         dma2d_hires_flip(source);
@@ -437,8 +654,8 @@ namespace display {
   }
 
   static void update_ltdc_for_mode() {
-    // hires palette is special
-    if(mode != ScreenMode::lores && format == PixelFormat::P) {
+    // hires palette is special, unless DMA2D is compositing layers into RGB565
+    if(mode != ScreenMode::lores && format == PixelFormat::P && !dma2d_layers_active) {
       LTDC_Layer1->PFCR = LTDC_PIXEL_FORMAT_L8;
       LTDC_Layer1->CFBAR  = (uint32_t)&__ltdc_start + 320 * 240 * 1;  // frame buffer start address
       LTDC_Layer1->CFBLR  = ((320 * 1) << LTDC_LxCFBLR_CFBP_Pos) | (((320 * 1) + 7) << LTDC_LxCFBLR_CFBLL_Pos);  // frame buffer line length and pitch
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cmath>
 #include <cstring>
 #include <list>
@@ -9,6 +10,7 @@
 #include "file.hpp"
 #include "executable.hpp"
 #include "dialog.hpp"
+#include "installer.hpp"
 #include "power.hpp"
 #include "quadspi.hpp"
 
@@ -309,104 +311,83 @@ static uint32_t get_flash_offset_for_file(uint32_t file_size) {
   return 0xFFFFFFFF;
 }
 
-static bool flash_buffer(uint32_t offset, uint8_t *buffer, size_t size) {
-  uint8_t verify_buffer[SD_BUFFER_SIZE];
+class QSPIInstallerFlash final : public InstallerFlash {
+public:
+  uint32_t get_erase_size() const override {
+    return qspi_flash_sector_size;
+  }
 
-  if(qspi_write_buffer(offset, buffer, size) != QSPI_OK)
-    return false;
+  uint32_t get_program_size() const override {
+    return PAGE_SIZE;
+  }
 
-  if(qspi_read_buffer(offset, verify_buffer, size) != QSPI_OK)
-    return false;
+  bool erase(uint32_t offset) override {
+    return qspi_sector_erase(offset) == QSPI_OK;
+  }
 
-  // compare buffers
-  bool verified = true;
-  for(size_t i = 0; i < size && verified; i++)
-    verified = buffer[i] == verify_buffer[i];
+  bool program(uint32_t offset, const uint8_t *data, uint32_t len) override {
+    return qspi_write_buffer(offset, data, len) == QSPI_OK;
+  }
 
-  return verified;
-}
+  bool read(uint32_t offset, uint8_t *data, uint32_t len) override {
+    return qspi_read_buffer(offset, data, len) == QSPI_OK;
+  }
+};
 
-// apply relocations to a chunk of a file
-static void apply_relocs(uint32_t file_offset, uint32_t flash_base_offset, uint8_t *buffer, size_t buf_len, const std::vector<uint32_t> &relocation_offsets, size_t &cur_reloc) {
-  if(cur_reloc >= relocation_offsets.size())
-    return;
+static QSPIInstallerFlash qspi_installer_flash;
 
-  for(auto off = file_offset; off < file_offset + buf_len; off += 4) {
-    if(off == relocation_offsets[cur_reloc]) {
-      *(uint32_t *)(buffer + off - file_offset) += flash_base_offset;
-      cur_reloc++;
-    }
-  }
-}
+// shared by the SD and CDC paths, only one can be flashing at a time
+static uint8_t install_buffer[SD_BUFFER_SIZE];
 
 // Flash a file from the SDCard to external flash
-static uint32_t flash_from_sd_to_qspi_flash(FIL &file, uint32_t file_size, uint32_t flash_offset) {
+static uint32_t flash_from_sd_to_qspi_flash(FIL &file, uint32_t flash_offset) {
   FRESULT res;
 
   UINT bytes_read = 0;
-  FSIZE_t bytes_flashed = 0;
-
-  // get prepended relocation info
-  f_lseek(&file, 4);
-  std::vector<uint32_t> relocation_offsets;
-  size_t cur_reloc = 0;
-
-  uint32_t num_relocs;
-  f_read(&file, (void *)&num_relocs, 4, &bytes_read);
-  relocation_offsets.reserve(num_relocs);
+  auto file_size = f_size(&file);
 
-  for(auto i = 0u; i < num_relocs; i++) {
-    uint32_t reloc_offset;
-    f_read(&file, (void *)&reloc_offset, 4, &bytes_read);
-
-    relocation_offsets.push_back(reloc_offset - qspi_flash_address);
-  }
-
-  if(flash_offset == 0xFFFFFFFF)
-    flash_offset = get_flash_offset_for_file(file_size);
-
-  // failed to find offset
-  if(flash_offset == 0xFFFFFFFF)
-    return flash_offset;
-
-  // erase the sectors needed to write the image
-  erase_qspi_flash(flash_offset, file_size);
+  BlitInstaller installer;
+  installer.init(qspi_installer_flash, install_buffer, sizeof(install_buffer), file_size, true, qspi_flash_address, [flash_offset](uint32_t data_len) {
+    return flash_offset == 0xFFFFFFFF ? get_flash_offset_for_file(data_len) : flash_offset;
+  });
 
   progress.show("Copying from SD card to flash...", file_size);
 
-  const uint32_t buffer_size = SD_BUFFER_SIZE;
-  uint8_t buffer[buffer_size];
+  f_lseek(&file, 0);
+
+  uint8_t buffer[SD_BUFFER_SIZE];
 
-  while(bytes_flashed < file_size) {
+  while(!installer.is_complete()) {
     // limited ram so a bit at a time
-    res = f_read(&file, (void *)buffer, std::min(file_size - bytes_flashed, buffer_size), &bytes_read);
+    res = f_read(&file, (void *)buffer, std::min(file_size - installer.get_stream_offset(), FSIZE_t(SD_BUFFER_SIZE)), &bytes_read);
 
-    if(res != FR_OK)
+    if(res != FR_OK || !bytes_read)
       break;
 
-    // relocation patching
-    apply_relocs(bytes_flashed, flash_offset, buffer, bytes_read, relocation_offsets, cur_reloc);
-
-    if(!flash_buffer(bytes_flashed + flash_offset, buffer, bytes_read))
+    // erases, relocates, writes and verifies
+    if(!installer.write(buffer, bytes_read))
       break;
 
-    bytes_flashed += bytes_read;
-
-    progress.update(bytes_flashed);
+    progress.update(installer.get_stream_offset());
   }
 
   progress.hide();
 
+  if(!installer.is_complete())
+    return 0xFFFFFFFF;
+
+  flash_offset = installer.get_flash_offset();
+
   // update free space
   for(auto &space : free_space) {
     if(std::get<0>(space) == flash_offset / qspi_flash_sector_size) {
-      auto size = calc_num_blocks(file_size);
+      auto size = calc_num_blocks(installer.get_data_length());
       std::get<0>(space) += size;
       std::get<1>(space) -= size;
     }
   }
 
-  return bytes_flashed == file_size ? flash_offset : 0xFFFFFFFF;
+  return flash_offset;
 }
 
 // runs a .blit file, flashing it if required
@@ -458,7 +439,7 @@ static bool launch_game_from_sd(const char *path, bool auto_delete = false) {
   }
 
   if(launch_offset == 0xFFFFFFFF && meta.size) {
-    launch_offset = flash_from_sd_to_qspi_flash(file, meta.size, flash_offset);
+    launch_offset = flash_from_sd_to_qspi_flash(file, flash_offset);
     scan_flash();
   }
 
@@ -635,27 +616,27 @@ static const uint8_t *flash_to_tmp(const std::string &filename, uint32_t &size)
 
   auto flash_offset = qspi_flash_size - qspi_tmp_reserved;
 
-  erase_qspi_flash(flash_offset, size);
+  BlitInstaller installer;
+  installer.init(qspi_installer_flash, install_buffer, sizeof(install_buffer), size, false, 0, [flash_offset](uint32_t) {
+    return flash_offset;
+  });
 
   progress.show("Copying file to cache...", size);
 
   const int buffer_size = SD_BUFFER_SIZE;
   uint8_t buffer[buffer_size];
 
-  FSIZE_t bytes_flashed = 0;
-  while(bytes_flashed < size) {
+  while(!installer.is_complete()) {
     UINT bytes_read;
     auto res = f_read(&f, (void *)buffer, buffer_size, &bytes_read);
 
-    if(res != FR_OK)
+    if(res != FR_OK || !bytes_read)
       break;
 
-    if(!flash_buffer(bytes_flashed + flash_offset, buffer, bytes_read))
+    if(!installer.write(buffer, bytes_read))
       break;
 
-    bytes_flashed += bytes_read;
-
-    progress.update(bytes_flashed);
+    progress.update(installer.get_stream_offset());
   }
 
   progress.hide();
@@ -665,7 +646,7 @@ static const uint8_t *flash_to_tmp(const std::string &filename, uint32_t &size)
 
   f_close(&f);
 
-  if(bytes_flashed < size)
+  if(!installer.is_complete())
     return nullptr;
 
   cached_file_in_tmp = true;
@@ -959,7 +940,7 @@ CDCCommandHandler::StreamResult FlashLoader::StreamData(CDCDataStream &dataStrea
             m_sFilelen[m_uParseIndex++] = byte;
             if (byte == 0)
             {
-              m_parseState = stRelocs;
+              m_parseState = stData;
               m_uParseIndex = 0;
               char *pEndPtr;
               m_uFilelen = strtoul(m_sFilelen, &pEndPtr, 10);
@@ -967,7 +948,8 @@ CDCCommandHandler::StreamResult FlashLoader::StreamData(CDCDataStream &dataStrea
               if(!m_uFilelen) {
                 debugf("Failed to parse filelen\n\r");
                 result =srError;
-              }
+              } else if(!prepare_for_data())
+                result = srError;
             }
           }
         }
@@ -978,48 +960,39 @@ CDCCommandHandler::StreamResult FlashLoader::StreamData(CDCDataStream &dataStrea
         }
       break;
 
-      case stRelocs: {
-        uint32_t word;
-        if(dest == Destination::SD) {
-          // writing to SD, pass the relocs through
-          m_parseState = stData;
-          if(!prepare_for_data())
-            result = srError;
-        } else if(m_uParseIndex > 1 && m_uParseIndex == num_relocs + 2) {
-          m_parseState = stData;
-          m_uParseIndex = 0;
-
-          // got relocs, prepare to flash
-          if(!prepare_for_data())
-            result = srError;
-        } else {
-          // break out of loop as we need more data
-          if(dataStream.GetStreamLength() < 4)
-            return srContinue;
-
-          while(result == srContinue && dataStream.Get(word)) {
-            if(m_uParseIndex == 0 && word != 0x4F4C4552 /*RELO*/) {
-              debugf("Missing relocation header\n");
+      case stData:
+        if(dest == Destination::Flash) {
+          // the installer handles relocations, erasing and verifying
+          while(result == srContinue && dataStream.GetStreamLength()) {
+            uint8_t data[64];
+            auto len = std::min({dataStream.GetStreamLength(), uint32_t(sizeof(data)), installer.get_stream_length() - installer.get_stream_offset()});
+            dataStream.GetDataOfLength(data, len);
+
+            if(!installer.write(data, len)) {
+              debugf("Failed to write to flash\n\r");
               result = srError;
-            } else if(m_uParseIndex == 1) {
-              num_relocs = word;
-              m_uFilelen -= num_relocs * 4 + 8;
-              relocation_offsets.clear();
-              relocation_offsets.reserve(num_relocs);
-            } else if(m_uParseIndex)
-              relocation_offsets.push_back(word - qspi_flash_address);
+              break;
+            }
 
-            m_uParseIndex++;
+            m_uBytesHandled = installer.get_stream_offset();
 
-            // done
-            if(m_uParseIndex == num_relocs + 2)
-              break;
+            if(installer.is_complete()) {
+              flash_start_offset = installer.get_flash_offset();
+
+              while(CDC_Transmit_HS((uint8_t *)"32BL__OK", 8) == USBD_BUSY){}
+              // return the block we used
+              uint16_t block = flash_start_offset / qspi_flash_sector_size;
+              while(CDC_Transmit_HS((uint8_t *)&block, 2) == USBD_BUSY){}
+
+              result = srFinish;
+              progress.hide();
+              handle_data_end(true);
+            } else if(installer.get_stream_offset() - uint32_t(progress.value) >= SD_BUFFER_SIZE)
+              progress.update(installer.get_stream_offset());
           }
+          break;
         }
-        break;
-      }
 
-      case stData:
         while((result == srContinue) && (m_parseState == stData) && (m_uParseIndex <= m_uFilelen) && dataStream.Get(byte)) {
           uint32_t uByteOffset = m_uParseIndex % PAGE_SIZE;
           buffer[uByteOffset] = byte;
@@ -1039,27 +1012,13 @@ CDCCommandHandler::StreamResult FlashLoader::StreamData(CDCDataStream &dataStrea
             continue;
           }
 
-          if(dest == Destination::SD) {
-            // save data
-            UINT uWritten;
-            FRESULT res = f_write(&file, buffer, uWriteLen, &uWritten);
-
-            if(res != FR_OK || uWritten != uWriteLen) {
-              debugf("Failed to save to SDCard\n\r");
-              result = srError;
-            }
-          } else {
-            // flash
-            uint32_t offset = (m_uParseIndex / PAGE_SIZE) * PAGE_SIZE;
-
-            // relocation patching
-            apply_relocs(offset, flash_start_offset, buffer, uWriteLen, relocation_offsets, cur_reloc);
+          // save data
+          UINT uWritten;
+          FRESULT res = f_write(&file, buffer, uWriteLen, &uWritten);
 
-            // save data
-            if(!flash_buffer(flash_start_offset + offset, buffer, uWriteLen)) {
-              debugf("Failed to write to flash\n\r");
-              result = srError;
-            }
+          if(res != FR_OK || uWritten != uWriteLen) {
+            debugf("Failed to save to SDCard\n\r");
+            result = srError;
           }
 
           progress.update(m_uParseIndex + 1);
@@ -1067,12 +1026,6 @@ CDCCommandHandler::StreamResult FlashLoader::StreamData(CDCDataStream &dataStrea
           if(bEOS) {
             if(result != srError) {
               while(CDC_Transmit_HS((uint8_t *)"32BL__OK", 8) == USBD_BUSY){}
-              if(dest == Destination::Flash) {
-                // return the block we used
-                uint16_t block = flash_start_offset / qspi_flash_sector_size;
-                while(CDC_Transmit_HS((uint8_t *)&block, 2) == USBD_BUSY){}
-              }
-
               result = srFinish;
             }
             progress.hide();
@@ -1113,17 +1066,15 @@ bool FlashLoader::prepare_for_data() {
       progress.show(buf, m_uFilelen);
     }
   } else {
-    // flash
-    cur_reloc = 0;
-    flash_start_offset = get_flash_offset_for_file(m_uFilelen);
+    // flash, offset is found once the relocations have been received
+    installer.init(qspi_installer_flash, install_buffer, sizeof(install_buffer), m_uFilelen, true, qspi_flash_address, [](uint32_t data_len) {
+      auto offset = get_flash_offset_for_file(data_len);
 
-    if(flash_start_offset == 0xFFFFFFFF) {
-      debugf("Failed to find free space\n\r");
-      return false;
-    }
+      if(offset == 0xFFFFFFFF)
+        debugf("Failed to find free space\n\r");
 
-    // erase
-    erase_qspi_flash(flash_start_offset, m_uFilelen);
+      return offset;
+    });
 
     char buf[300];
     snprintf(buf, 300, "Saving %s to flash...", m_sFilename);
@@ -2,6 +2,7 @@
 #include "32blit.hpp"
 #include "CDCCommandHandler.h"
 #include "ff.h"
+#include "installer.hpp"
 #include "persistence.h"
 
 #define BUFFER_SIZE (256)
@@ -75,7 +76,7 @@ public:
   virtual bool StreamInit(CDCFourCC uCommand);
 
 private:
-  enum ParseState {stFilename, stLength, stRelocs, stData};
+  enum ParseState {stFilename, stLength, stData};
 
   enum class Destination {SD, Flash};
 
@@ -96,8 +97,6 @@ private:
   uint32_t m_uFilelen = 0;
   uint32_t flash_start_offset = 0;
 
-  uint32_t num_relocs = 0;
-  size_t cur_reloc = 0;
-  std::vector<uint32_t> relocation_offsets;
+  BlitInstaller installer;
   bool flash_mapped = false;
 };
@@ -18,14 +18,24 @@
 #include "engine/tweening.hpp"
 #include "engine/version.hpp"
 #include "graphics/blend.hpp"
+#include "graphics/collision_mask.hpp"
 #include "graphics/color.hpp"
+#include "graphics/filter.hpp"
 #include "graphics/font.hpp"
 #include "graphics/jpeg.hpp"
+#include "graphics/mesh.hpp"
 #include "graphics/mode7.hpp"
 #include "graphics/surface.hpp"
 #include "graphics/tilemap.hpp"
+#include "math/collision.hpp"
 #include "math/constants.hpp"
+#include "math/fastmath.hpp"
 #include "math/interpolation.hpp"
+#include "types/fixed.hpp"
+#include "types/fmat3.hpp"
+#include "types/fmat4.hpp"
+#include "types/fvec2.hpp"
+#include "types/fvec3.hpp"
 #include "types/map.hpp"
 #include "types/mat3.hpp"
 #include "types/mat4.hpp"
@@ -150,6 +150,9 @@ namespace blit {
     // low level framebuffer
     uint8_t *(*get_screen_data)(); // used to get current screen.data before render if firmware does page-flipping
     void (*set_framebuffer)(uint8_t *data, uint32_t max_size, Size max_bounds); // pass framebuffer over if allocated on the "user" side of the API
+
+    // layers composited behind the screen after render
+    void (*set_screen_layers)(const ScreenLayer *layers, uint8_t count, Pen screen_key);
   };
 
   struct APIData {
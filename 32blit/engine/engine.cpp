@@ -28,11 +28,18 @@ namespace blit {
     if(!api.set_screen_mode_format(new_mode, new_screen))
       return false;
 
+    // layers are the old screen format
+    set_screen_layers(nullptr, 0, Pen());
+
     screen = Surface(new_screen.data, new_screen.format, new_screen.bounds);
     screen.palette = new_screen.palette;
 
-    if(new_screen.pen_blend)
+    if(new_screen.pen_blend) {
       screen.pbf = new_screen.pen_blend;
+      // the specialised scaling/affine kernels write the data directly
+      screen.sbf = stretch_generic;
+      screen.abf = affine_generic;
+    }
 
     if(new_screen.blit_blend)
       screen.bbf = new_screen.blit_blend;
@@ -45,6 +52,31 @@ namespace blit {
 
   void set_screen_palette(const Pen *colours, int num_cols) {
     api.set_screen_palette(colours, num_cols);
+    invalidate_palette_blend(screen.palette);
+  }
+
+  /**
+   * Set surfaces to display behind the screen.
+   *
+   * Layers are composited by the firmware after `render`, back to front with
+   * the screen on top, so static backgrounds don't need to be redrawn every
+   * frame. Pixels of the screen matching `screen_key` show the layers, the
+   * screen should be cleared to it at the start of `render`.
+   *
+   * The array is read each frame so offsets can be changed in place, and
+   * must stay valid until the layers are removed by setting a count of 0.
+   * Changing the screen mode also removes them. Some ports keep a copy of
+   * the layer pixels, call this again after drawing to a layer.
+   *
+   * \param layers Array of layers, from back to front.
+   * \param count Number of layers.
+   * \param screen_key Colour of the screen to show the layers through, for
+   *                   paletted screens the index goes in the alpha channel
+   *                   (`Pen(0, 0, 0, 0)` is black, or index 0).
+   */
+  void set_screen_layers(const ScreenLayer *layers, uint8_t count, Pen screen_key) {
+    if(api.set_screen_layers)
+      api.set_screen_layers(layers, count, screen_key);
   }
 
   uint32_t now() {
@@ -91,8 +123,11 @@ namespace blit {
 
   Surface screen(nullptr, PixelFormat::M, Size(0, 0));
 
-  static const uint32_t update_rate_ms = 10;
-  static uint32_t pending_update_time = 0;
+  // all update timing is tracked in microseconds so that rates that don't divide evenly into ms (60Hz) don't drift
+  static uint32_t update_interval_us = 10000;
+  static uint32_t max_catch_up_updates = 0;
+  static uint64_t pending_update_time = 0;
+  static uint32_t dropped_updates = 0;
 
   static uint32_t last_tick_time = 0;
   static uint32_t last_state = 0;
@@ -100,6 +135,31 @@ namespace blit {
   extern std::vector<Timer *> timers;
   extern std::vector<Tween *> tweens;
 
+  void set_update_rate(uint32_t rate_hz) {
+    if(rate_hz == 0)
+      return;
+
+    // at least 1us, higher rates would divide by zero
+    update_interval_us = rate_hz >= 1000000 ? 1 : 1000000 / rate_hz;
+    pending_update_time = 0;
+  }
+
+  uint32_t get_update_rate() {
+    return 1000000 / update_interval_us;
+  }
+
+  void set_max_catch_up_updates(uint32_t max_updates) {
+    max_catch_up_updates = max_updates;
+  }
+
+  uint32_t get_dropped_updates() {
+    return dropped_updates;
+  }
+
+  float get_update_interpolation() {
+    return float(pending_update_time) / float(update_interval_us);
+  }
+
   int tick(uint32_t time) {
     if (last_tick_time == 0) {
       last_tick_time = time;
@@ -128,8 +188,17 @@ namespace blit {
     update_tweens(time);
 
     // catch up on updates if any pending
-    pending_update_time += (time - last_tick_time);
-    while (pending_update_time >= update_rate_ms) {
+    // 64-bit as a gap of over ~71 minutes would overflow in us
+    pending_update_time += uint64_t(time - last_tick_time) * 1000;
+
+    // too far behind, drop the excess instead of trying to run them all
+    if (max_catch_up_updates && pending_update_time >= uint64_t(max_catch_up_updates) * update_interval_us) {
+      uint64_t excess = pending_update_time / update_interval_us - max_catch_up_updates;
+      dropped_updates += uint32_t(excess);
+      pending_update_time -= excess * update_interval_us;
+    }
+
+    while (pending_update_time >= update_interval_us) {
       // button state changes
       uint32_t changed = api_data.buttons.state ^ last_state;
 
@@ -137,13 +206,13 @@ namespace blit {
       api_data.buttons.released = changed & last_state;
       last_state = api_data.buttons.state;
 
-      update(time - pending_update_time); // create fake timestamp that would have been accurate for the update event
-      pending_update_time -= update_rate_ms;
+      update(time - uint32_t(pending_update_time / 1000)); // create fake timestamp that would have been accurate for the update event
+      pending_update_time -= update_interval_us;
     }
 
     last_tick_time = time;
 
-    return update_rate_ms - pending_update_time;
+    return int((update_interval_us - pending_update_time + 999) / 1000);
   }
 
   const char *get_launch_path() {
@@ -19,6 +19,25 @@ namespace blit {
   bool set_screen_mode(ScreenMode new_mode, PixelFormat format, Size bounds = {0, 0});
   void set_screen_palette(const Pen *colours, int num_cols);
 
+  /// Layer composited behind the screen, see `set_screen_layers`
+  ///
+  /// This is passed to the firmware, so it only holds the pixels rather than a `Surface`.
+  /// Rows are packed, as they are in a `Surface`.
+  struct ScreenLayer {
+    ScreenLayer() = default;
+    ScreenLayer(const Surface &surface) : data(surface.data), bounds(surface.bounds), format(surface.format) {}
+
+    const uint8_t *data = nullptr;
+    Size bounds;
+    PixelFormat format = PixelFormat::RGB; // must be the same as the screen, paletted layers use the screen palette
+    Point offset;               // scroll position of the layer, it repeats in both directions
+    uint8_t alpha = 255;        // ignored for paletted layers
+    bool use_key = false;
+    Pen key;                    // colour (or index in the alpha channel for paletted layers) not to draw
+  };
+
+  void set_screen_layers(const ScreenLayer *layers, uint8_t count, Pen screen_key);
+
   uint32_t now();
   uint32_t now_us();
   uint32_t us_diff(uint32_t from, uint32_t to);
@@ -30,5 +49,35 @@ namespace blit {
 
   int tick(uint32_t time);
 
+  /**
+   * Set the rate `update` is called at. Defaults to 100Hz.
+   * Rates above 1MHz are treated as 1MHz.
+   *
+   * \param rate_hz Updates per second
+   */
+  void set_update_rate(uint32_t rate_hz);
+  uint32_t get_update_rate();
+
+  /**
+   * Limit the number of updates that can run in a single tick when falling behind.
+   * Any time beyond this is dropped, instead of running more updates and falling further behind.
+   *
+   * \param max_updates Maximum updates per tick, 0 for no limit (default)
+   */
+  void set_max_catch_up_updates(uint32_t max_updates);
+
+  /**
+   * \return Total number of updates dropped due to the catch-up limit
+   */
+  uint32_t get_dropped_updates();
+
+  /**
+   * Get how far between the last update and the next one the current time is.
+   * Intended to be used in `render` to interpolate between the previous and current update states.
+   *
+   * \return Interpolation factor in the range 0-1
+   */
+  float get_update_interpolation();
+
   const char *get_launch_path();
 }
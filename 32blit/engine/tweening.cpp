@@ -6,6 +6,7 @@
 #include "tweening.hpp"
 
 #include "../math/constants.hpp"
+#include "../math/fastmath.hpp"
 
 namespace blit {
   std::vector<Tween *> tweens;
@@ -81,7 +82,7 @@ namespace blit {
   }
 
   float tween_sine(uint32_t t, float b, float c, uint32_t d) {
-    return b + (sinf((float(t) / float(d) * pi * 2.0f) + (pi / 2.0f)) + 1.0f) / 2.0f * (c - b);
+    return b + (fastmath::cos(float(t) / float(d) * pi * 2.0f) + 1.0f) / 2.0f * (c - b);
   }
 
   float tween_linear(uint32_t t, float b, float c, uint32_t d) {
@@ -1,5 +1,8 @@
+#include <algorithm>
+#include <climits>
 #include <cstdint>
 #include <cstring>
+#include <new>
 
 #include "surface.hpp"
 
@@ -296,18 +299,265 @@ namespace blit {
     }
   }
 
-  void P_P(const Pen* pen, const Surface* dest, uint32_t off, uint32_t cnt) {
-    uint8_t* d = dest->data + off;
+  // lookup tables for blending translucent colours onto a paletted surface,
+  // rebuilt from the palette on first use after it changes
+  struct PaletteBlendCache {
+    const Pen *palette = nullptr;     // palette the cache was built from
+    bool valid = false;
+    uint32_t last_used = 0;
+
+    uint8_t level[256];               // blend level of each entry's alpha
+    uint16_t translucent_count = 0;   // entries with a level other than opaque
+    uint8_t translucent_index = 0;    // the only translucent entry if there's one
+
+    bool inverse_valid = false;
+    uint8_t *inverse = nullptr;       // nearest entry to each 4-bit per channel colour (4096 entries)
+
+    uint8_t *tables[palette_blend_levels - 1] = {}; // [src][dest] result for each level
+    bool table_valid[palette_blend_levels - 1] = {};
+  };
+
+  static PaletteBlendCache palette_caches[palette_blend_max_palettes];
+  static uint32_t palette_cache_counter = 0;
+  static int palette_tables_allocated = 0;
+
+  // alpha is quantised into palette_blend_levels steps, 0 is skipped and the last is opaque
+  __attribute__((always_inline)) inline uint8_t palette_blend_level(uint32_t a) {
+    return (a + (128 / palette_blend_levels)) / (256 / palette_blend_levels);
+  }
+
+  static PaletteBlendCache &get_palette_cache(const Pen *palette) {
+    PaletteBlendCache *cache = nullptr;
+
+    for (auto &entry : palette_caches) {
+      if (entry.palette == palette) {
+        cache = &entry;
+        break;
+      }
+
+      // least recently used, unused entries have a last_used of 0
+      if (!cache || entry.last_used < cache->last_used)
+        cache = &entry;
+    }
+
+    cache->last_used = ++palette_cache_counter;
+
+    if (cache->valid && cache->palette == palette)
+      return *cache;
+
+    // the inverse and table buffers are kept for the new palette
+    cache->palette = palette;
+    cache->valid = true;
+    cache->inverse_valid = false;
+    for (auto &v : cache->table_valid)
+      v = false;
+
+    cache->translucent_count = 0;
+    for (int i = 0; i < 256; i++) {
+      cache->level[i] = palette_blend_level(palette[i].a);
+      if (cache->level[i] != palette_blend_levels) {
+        cache->translucent_count++;
+        cache->translucent_index = i;
+      }
+    }
+
+    return *cache;
+  }
+
+  static const uint8_t *get_palette_inverse(PaletteBlendCache &cache) {
+    auto palette = cache.palette;
+
+    if (!cache.inverse) {
+#if defined(PICO_BUILD)
+      // the SDK's malloc panics instead of returning null, so don't allocate in the middle of a draw
+      static uint8_t inverse_storage[palette_blend_max_palettes][4096];
+      cache.inverse = inverse_storage[&cache - palette_caches];
+#else
+      cache.inverse = new (std::nothrow) uint8_t[4096];
+      if (!cache.inverse)
+        return nullptr;
+#endif
+    }
+
+    if (!cache.inverse_valid) {
+      // entries with no alpha are assumed to be unused
+      for (int c = 0; c < 4096; c++) {
+        int r = (c >> 8) * 17, g = ((c >> 4) & 0xF) * 17, b = (c & 0xF) * 17;
+        int best = 0, best_dist = INT32_MAX;
+
+        for (int i = 0; i < 256; i++) {
+          if (!palette[i].a)
+            continue;
+
+          int dr = palette[i].r - r, dg = palette[i].g - g, db = palette[i].b - b;
+          int dist = dr * dr + dg * dg + db * db;
+          if (dist < best_dist) {
+            best = i;
+            best_dist = dist;
+          }
+        }
+
+        cache.inverse[c] = best;
+      }
+
+      cache.inverse_valid = true;
+    }
+
+    return cache.inverse;
+  }
+
+  // a new table if there's room for one, or one that's no longer in use
+  static uint8_t *acquire_palette_table() {
+    if (palette_tables_allocated < palette_blend_max_tables) {
+      auto table = new (std::nothrow) uint8_t[256 * 256];
+      if (table) {
+        palette_tables_allocated++;
+        return table;
+      }
+    }
+
+    for (auto &cache : palette_caches) {
+      for (int i = 0; i < palette_blend_levels - 1; i++) {
+        if (cache.tables[i] && (!cache.valid || !cache.table_valid[i])) {
+          auto table = cache.tables[i];
+          cache.tables[i] = nullptr;
+          cache.table_valid[i] = false;
+          return table;
+        }
+      }
+    }
+
+    return nullptr;
+  }
+
+  // returns nullptr if the table couldn't be allocated
+  static const uint8_t *get_palette_table(PaletteBlendCache &cache, uint8_t level) {
+    auto &table = cache.tables[level - 1];
+
+    if (table && cache.table_valid[level - 1])
+      return table;
+
+    auto palette = cache.palette;
+    auto inverse = get_palette_inverse(cache);
+
+    if (!inverse)
+      return nullptr;
+
+    if (!table)
+      table = acquire_palette_table();
+
+    if (!table)
+      return nullptr;
+
+    uint8_t a = level * 255 / palette_blend_levels;
+    auto out = table;
+
+    for (int s = 0; s < 256; s++) {
+      auto &sp = palette[s];
+      for (int d = 0; d < 256; d++) {
+        auto &dp = palette[d];
+        int r = blend(sp.r, dp.r, a), g = blend(sp.g, dp.g, a), b = blend(sp.b, dp.b, a);
+        *out++ = inverse[((r + 8) / 17) << 8 | ((g + 8) / 17) << 4 | ((b + 8) / 17)];
+      }
+    }
+
+    cache.table_valid[level - 1] = true;
+
+    return table;
+  }
+
+  // blends one pixel the same way as the tables, for when there isn't one
+  // without the inverse map either this is a plain copy
+  static uint8_t palette_blend_pixel(PaletteBlendCache &cache, uint8_t s, uint8_t d, uint8_t level) {
+    auto inverse = get_palette_inverse(cache);
+
+    if (!inverse)
+      return s;
+
+    auto &sp = cache.palette[s], &dp = cache.palette[d];
+    uint8_t a = level * 255 / palette_blend_levels;
+    int r = blend(sp.r, dp.r, a), g = blend(sp.g, dp.g, a), b = blend(sp.b, dp.b, a);
+
+    return inverse[((r + 8) / 17) << 8 | ((g + 8) / 17) << 4 | ((b + 8) / 17)];
+  }
+
+  const uint8_t *get_palette_inverse(const Pen *palette) {
+    return get_palette_inverse(get_palette_cache(palette));
+  }
+
+  void invalidate_palette_blend(const Pen *palette) {
+    for (auto &cache : palette_caches) {
+      if (cache.palette == palette)
+        cache.valid = false;
+    }
+  }
+
+  // true if blits onto the surface need to go through the tables, without a
+  // palette there's nothing to blend with
+  __attribute__((always_inline)) inline bool palette_translucent(const Surface *dest, const PaletteBlendCache *cache) {
+    if (!cache)
+      return false;
+
+    return dest->alpha != 255 || (cache->translucent_count && !(cache->translucent_count == 1 && cache->translucent_index == dest->transparent_index));
+  }
+
+  // blends a span of source indices onto the surface, src_step 0 repeats one
+  static void palette_blend_span(const uint8_t *s, int32_t src_step, const Surface* dest, uint8_t *d, uint32_t cnt, PaletteBlendCache &cache) {
     uint8_t transparent = dest->transparent_index;
 
     do {
-      if (pen->a != transparent) {
-        *d = pen->a;
+      uint8_t col = *s;
+
+      if (col != transparent) {
+        uint8_t level = palette_blend_level(alpha(dest->palette[col].a, dest->alpha));
+
+        if (level == palette_blend_levels)
+          *d = col;
+        else if (level) {
+          auto table = get_palette_table(cache, level);
+          *d = table ? table[col * 256 + *d] : palette_blend_pixel(cache, col, *d, level);
+        }
       }
+
       d++;
+      s += src_step;
     } while (--cnt);
   }
 
+  void P_P(const Pen* pen, const Surface* dest, uint32_t off, uint32_t cnt) {
+    uint8_t* d = dest->data + off;
+    uint8_t transparent = dest->transparent_index;
+
+    if (pen->a == transparent)
+      return;
+
+    if (dest->palette) {
+      auto &cache = get_palette_cache(dest->palette);
+      uint8_t level = palette_blend_level(alpha(dest->palette[pen->a].a, dest->alpha));
+
+      if (level == 0)
+        return;
+
+      if (level != palette_blend_levels) {
+        auto table = get_palette_table(cache, level);
+
+        if (table) {
+          table += pen->a * 256;
+          do {
+            *d = table[*d]; d++;
+          } while (--cnt);
+        } else {
+          do {
+            *d = palette_blend_pixel(cache, pen->a, *d, level); d++;
+          } while (--cnt);
+        }
+        return;
+      }
+    }
+
+    memset(d, pen->a, cnt);
+  }
+
   void M_M(const Pen* pen, const Surface* dest, uint32_t off, uint32_t cnt) {
     uint8_t* d = dest->data + off;
 
@@ -400,6 +650,12 @@ namespace blit {
     uint8_t *d = dest->data + doff;
     uint8_t transparent = dest->transparent_index;
 
+    auto cache = dest->palette ? &get_palette_cache(dest->palette) : nullptr;
+    if (palette_translucent(dest, cache)) {
+      palette_blend_span(s, src_step, dest, d, cnt, *cache);
+      return;
+    }
+
     do {
       if (*s != transparent) {
         *d = *s;
@@ -418,6 +674,339 @@ namespace blit {
     } while (--cnt);
   }
 
+  // scaled span kernels
+  //
+  // the source x position is stepped in 16.16 fixed point and each source
+  // pixel is only read and converted once for the run of destination pixels
+  // that sample it, rather than once per destination pixel through pgf/pbf
+
+  // returns the number of destination pixels (at most cnt) that sample the
+  // source pixel at x, advancing x past them
+  __attribute__((always_inline)) inline uint32_t stretch_run(int32_t &x, int32_t x_step, uint32_t cnt) {
+    int32_t sx = x >> 16;
+    uint32_t run = 1;
+    x += x_step;
+
+    while (run < cnt && (x >> 16) == sx) {
+      run++;
+      x += x_step;
+    }
+
+    return run;
+  }
+
+  // returns the upscale factor for the integer fast paths or 0
+  // (the caller rounds the 3x step up so that runs don't drift)
+  static int stretch_factor(int32_t x_step) {
+    switch (x_step < 0 ? -x_step : x_step) {
+      case 0x8000: return 2;
+      case 0x5556: return 3;
+      case 0x4000: return 4;
+    }
+    return 0;
+  }
+
+  template<PixelFormat src_format>
+  __attribute__((always_inline)) inline Pen stretch_fetch(const Surface *src, const uint8_t *s) {
+    if (src_format == PixelFormat::P)
+      return src->palette[*s];
+    else if (src_format == PixelFormat::RGB)
+      return Pen(s[0], s[1], s[2]);
+
+    return *(const Pen *)s;
+  }
+
+  template<PixelFormat dest_format>
+  __attribute__((always_inline)) inline void stretch_write(const Pen *pen, const Surface *dest, uint8_t *d, uint8_t *m, uint32_t c) {
+    if (!m) {
+      uint32_t a = alpha(pen->a, dest->alpha);
+
+      if (a >= 255) {
+        if (dest_format == PixelFormat::RGB565)
+          copy_rgba_rgb565(pen, d, c);
+        else
+          copy_rgba_rgb(pen, d, c);
+      } else if (a > 1) {
+        if (dest_format == PixelFormat::RGB565)
+          blend_rgba_rgb565(pen, d, a, c);
+        else
+          blend_rgba_rgb(pen, d, a, c);
+      }
+      return;
+    }
+
+    // mask enabled, slow blend
+    do {
+      uint32_t a = alpha(pen->a, *m++, dest->alpha);
+
+      if (a >= 255) {
+        if (dest_format == PixelFormat::RGB565)
+          copy_rgba_rgb565(pen, d, 1);
+        else
+          copy_rgba_rgb(pen, d, 1);
+      } else if (a > 1) {
+        if (dest_format == PixelFormat::RGB565)
+          blend_rgba_rgb565(pen, d, a, 1);
+        else
+          blend_rgba_rgb(pen, d, a, 1);
+      }
+
+      d += pixel_format_stride[int(dest_format)];
+    } while (--c);
+  }
+
+  template<PixelFormat src_format, PixelFormat dest_format>
+  static void stretch_span(const Surface* src, uint32_t soff, const Surface* dest, uint32_t doff, uint32_t cnt, int32_t x, int32_t x_step, int32_t src_step, int factor) {
+    const int src_stride = pixel_format_stride[int(src_format)];
+    const int dest_stride = pixel_format_stride[int(dest_format)];
+
+    const uint8_t* s = src->data + soff * src_stride;
+    uint8_t* d = dest->data + doff * dest_stride;
+    uint8_t* m = dest->mask ? dest->mask->data + doff : nullptr;
+
+    if (factor) {
+      // integer upscale, every run after the first is exactly factor pixels
+      int32_t frac = x & 0xFFFF;
+      uint32_t run = x_step > 0 ? (0xFFFF - frac) / x_step + 1 : frac / -x_step + 1;
+
+      s += (x >> 16) * src_step * src_stride;
+      int32_t s_step = (x_step > 0 ? src_step : -src_step) * src_stride;
+
+      do {
+        if (run > cnt)
+          run = cnt;
+
+        auto pen = stretch_fetch<src_format>(src, s);
+        stretch_write<dest_format>(&pen, dest, d, m, run);
+
+        d += run * dest_stride;
+        if (m) m += run;
+        s += s_step;
+        cnt -= run;
+        run = factor;
+      } while (cnt);
+      return;
+    }
+
+    do {
+      auto pen = stretch_fetch<src_format>(src, s + (x >> 16) * src_step * src_stride);
+      uint32_t run = stretch_run(x, x_step, cnt);
+
+      stretch_write<dest_format>(&pen, dest, d, m, run);
+
+      d += run * dest_stride;
+      if (m) m += run;
+      cnt -= run;
+    } while (cnt);
+  }
+
+  template<PixelFormat dest_format>
+  static void stretch_dispatch(const Surface* src, uint32_t soff, const Surface* dest, uint32_t doff, uint32_t cnt, int32_t x, int32_t x_step, int32_t src_step) {
+    int factor = stretch_factor(x_step);
+
+    switch (src->format) {
+      case PixelFormat::RGBA:
+        stretch_span<PixelFormat::RGBA, dest_format>(src, soff, dest, doff, cnt, x, x_step, src_step, factor);
+        break;
+      case PixelFormat::RGB:
+        stretch_span<PixelFormat::RGB, dest_format>(src, soff, dest, doff, cnt, x, x_step, src_step, factor);
+        break;
+      case PixelFormat::P:
+        stretch_span<PixelFormat::P, dest_format>(src, soff, dest, doff, cnt, x, x_step, src_step, factor);
+        break;
+      default:
+        stretch_generic(src, soff, dest, doff, cnt, x, x_step, src_step);
+        break;
+    }
+  }
+
+  void RGBA_RGB(const Surface* src, uint32_t soff, const Surface* dest, uint32_t doff, uint32_t cnt, int32_t x, int32_t x_step, int32_t src_step) {
+    stretch_dispatch<PixelFormat::RGB>(src, soff, dest, doff, cnt, x, x_step, src_step);
+  }
+
+  void RGBA_RGB565(const Surface* src, uint32_t soff, const Surface* dest, uint32_t doff, uint32_t cnt, int32_t x, int32_t x_step, int32_t src_step) {
+    stretch_dispatch<PixelFormat::RGB565>(src, soff, dest, doff, cnt, x, x_step, src_step);
+  }
+
+  void P_P(const Surface* src, uint32_t soff, const Surface* dest, uint32_t doff, uint32_t cnt, int32_t x, int32_t x_step, int32_t src_step) {
+    if (src->format != PixelFormat::P) {
+      stretch_generic(src, soff, dest, doff, cnt, x, x_step, src_step);
+      return;
+    }
+
+    uint8_t *s = src->data + soff;
+    uint8_t *d = dest->data + doff;
+    uint8_t transparent = dest->transparent_index;
+
+    auto cache = dest->palette ? &get_palette_cache(dest->palette) : nullptr;
+    bool translucent = palette_translucent(dest, cache);
+
+    do {
+      uint8_t *col = s + (x >> 16) * src_step;
+      uint32_t run = stretch_run(x, x_step, cnt);
+
+      if (translucent)
+        palette_blend_span(col, 0, dest, d, run, *cache);
+      else if (*col != transparent)
+        memset(d, *col, run);
+
+      d += run;
+      cnt -= run;
+    } while (cnt);
+  }
+
+  void stretch_generic(const Surface* src, uint32_t soff, const Surface* dest, uint32_t doff, uint32_t cnt, int32_t x, int32_t x_step, int32_t src_step) {
+    do {
+      auto pen = src->pgf(src, soff + (x >> 16) * src_step);
+      uint32_t run = stretch_run(x, x_step, cnt);
+
+      dest->pbf(&pen, dest, doff, run);
+
+      doff += run;
+      cnt -= run;
+    } while (cnt);
+  }
+
+  // affine span kernels
+  //
+  // u, v are the source position (in pixels of the source surface) and du, dv
+  // the step per destination pixel in 16.16 fixed point, the caller clips the
+  // span so that every sample lies inside src_r
+
+  // bilinear sample between the four pixels around u, v, neighbours outside
+  // src_r are clamped to the edge
+  template<class F>
+  __attribute__((always_inline)) inline Pen affine_bilinear(F fetch, const Rect &src_r, int32_t u, int32_t v) {
+    // sample relative to pixel centres
+    u -= 0x8000;
+    v -= 0x8000;
+
+    int32_t x0 = u >> 16, y0 = v >> 16;
+    uint32_t fx = (u >> 8) & 0xFF, fy = (v >> 8) & 0xFF;
+
+    int32_t x1 = std::min(x0 + 1, src_r.x + src_r.w - 1);
+    int32_t y1 = std::min(y0 + 1, src_r.y + src_r.h - 1);
+    x0 = std::max(x0, src_r.x);
+    y0 = std::max(y0, src_r.y);
+
+    Pen p00 = fetch(x0, y0), p10 = fetch(x1, y0);
+    Pen p01 = fetch(x0, y1), p11 = fetch(x1, y1);
+
+    uint32_t w00 = (256 - fx) * (256 - fy), w10 = fx * (256 - fy);
+    uint32_t w01 = (256 - fx) * fy, w11 = fx * fy;
+
+    return Pen(
+      int((p00.r * w00 + p10.r * w10 + p01.r * w01 + p11.r * w11) >> 16),
+      int((p00.g * w00 + p10.g * w10 + p01.g * w01 + p11.g * w11) >> 16),
+      int((p00.b * w00 + p10.b * w10 + p01.b * w01 + p11.b * w11) >> 16),
+      int((p00.a * w00 + p10.a * w10 + p01.a * w01 + p11.a * w11) >> 16)
+    );
+  }
+
+  template<PixelFormat src_format, PixelFormat dest_format>
+  static void affine_span(const Surface* src, const Rect &src_r, const Surface* dest, uint32_t doff, uint32_t cnt, int32_t u, int32_t v, int32_t du, int32_t dv, bool bilinear) {
+    const int src_stride = pixel_format_stride[int(src_format)];
+    const int dest_stride = pixel_format_stride[int(dest_format)];
+
+    uint8_t* d = dest->data + doff * dest_stride;
+    uint8_t* m = dest->mask ? dest->mask->data + doff : nullptr;
+
+    auto fetch = [src, src_stride](int32_t x, int32_t y) {
+      return stretch_fetch<src_format>(src, src->data + (x + y * src->bounds.w) * src_stride);
+    };
+
+    if (bilinear) {
+      do {
+        auto pen = affine_bilinear(fetch, src_r, u, v);
+        stretch_write<dest_format>(&pen, dest, d, m, 1);
+
+        d += dest_stride;
+        if (m) m++;
+        u += du;
+        v += dv;
+      } while (--cnt);
+      return;
+    }
+
+    do {
+      auto pen = fetch(u >> 16, v >> 16);
+      stretch_write<dest_format>(&pen, dest, d, m, 1);
+
+      d += dest_stride;
+      if (m) m++;
+      u += du;
+      v += dv;
+    } while (--cnt);
+  }
+
+  template<PixelFormat dest_format>
+  static void affine_dispatch(const Surface* src, const Rect &src_r, const Surface* dest, uint32_t doff, uint32_t cnt, int32_t u, int32_t v, int32_t du, int32_t dv, bool bilinear) {
+    switch (src->format) {
+      case PixelFormat::RGBA:
+        affine_span<PixelFormat::RGBA, dest_format>(src, src_r, dest, doff, cnt, u, v, du, dv, bilinear);
+        break;
+      case PixelFormat::RGB:
+        affine_span<PixelFormat::RGB, dest_format>(src, src_r, dest, doff, cnt, u, v, du, dv, bilinear);
+        break;
+      case PixelFormat::P:
+        affine_span<PixelFormat::P, dest_format>(src, src_r, dest, doff, cnt, u, v, du, dv, bilinear);
+        break;
+      default:
+        affine_generic(src, src_r, dest, doff, cnt, u, v, du, dv, bilinear);
+        break;
+    }
+  }
+
+  void RGBA_RGB(const Surface* src, const Rect &src_r, const Surface* dest, uint32_t doff, uint32_t cnt, int32_t u, int32_t v, int32_t du, int32_t dv, bool bilinear) {
+    affine_dispatch<PixelFormat::RGB>(src, src_r, dest, doff, cnt, u, v, du, dv, bilinear);
+  }
+
+  void RGBA_RGB565(const Surface* src, const Rect &src_r, const Surface* dest, uint32_t doff, uint32_t cnt, int32_t u, int32_t v, int32_t du, int32_t dv, bool bilinear) {
+    affine_dispatch<PixelFormat::RGB565>(src, src_r, dest, doff, cnt, u, v, du, dv, bilinear);
+  }
+
+  // indices can't be filtered, so this is always nearest
+  void P_P(const Surface* src, const Rect &src_r, const Surface* dest, uint32_t doff, uint32_t cnt, int32_t u, int32_t v, int32_t du, int32_t dv, bool bilinear) {
+    if (src->format != PixelFormat::P) {
+      affine_generic(src, src_r, dest, doff, cnt, u, v, du, dv, bilinear);
+      return;
+    }
+
+    uint8_t *d = dest->data + doff;
+    uint8_t transparent = dest->transparent_index;
+
+    auto cache = dest->palette ? &get_palette_cache(dest->palette) : nullptr;
+    bool translucent = palette_translucent(dest, cache);
+
+    do {
+      uint8_t *col = src->data + (u >> 16) + (v >> 16) * src->bounds.w;
+
+      if (translucent)
+        palette_blend_span(col, 0, dest, d, 1, *cache);
+      else if (*col != transparent)
+        *d = *col;
+
+      d++;
+      u += du;
+      v += dv;
+    } while (--cnt);
+  }
+
+  void affine_generic(const Surface* src, const Rect &src_r, const Surface* dest, uint32_t doff, uint32_t cnt, int32_t u, int32_t v, int32_t du, int32_t dv, bool bilinear) {
+    auto fetch = [src](int32_t x, int32_t y) {
+      return src->pgf(src, x + y * src->bounds.w);
+    };
+
+    do {
+      auto pen = bilinear ? affine_bilinear(fetch, src_r, u, v) : fetch(u >> 16, v >> 16);
+      dest->pbf(&pen, dest, doff, 1);
+
+      doff++;
+      u += du;
+      v += dv;
+    } while (--cnt);
+  }
+
   Pen get_pen_rgb(const Surface *surf, uint32_t offset) {
     auto ptr = surf->data + offset * 3;
     return {ptr[0], ptr[1], ptr[2]};
@@ -5,6 +5,7 @@
 namespace blit {
   struct Surface;
   struct Pen;
+  struct Rect;
 
   // blends the supplied pen onto a span of pixels in the destination surface
   // supports pen alpha, global alpha, and mask alpha where needed
@@ -15,6 +16,18 @@ namespace blit {
   // supports source alpha, global alpha, and mask alpha where needed
   using BlitBlendFunc = void(*)(const Surface* src, uint32_t soff, const Surface* dest, uint32_t doff, uint32_t cnt, int32_t src_step);
 
+  // blends a horizontally scaled span of the source surface onto a span of
+  // pixels in the destination surface, x and x_step are the source position
+  // and step in 16.16 fixed point
+  // supports source alpha, global alpha, and mask alpha where needed
+  using StretchBlendFunc = void(*)(const Surface* src, uint32_t soff, const Surface* dest, uint32_t doff, uint32_t cnt, int32_t x, int32_t x_step, int32_t src_step);
+
+  // blends an affine mapped span of the source surface onto a span of pixels
+  // in the destination surface, u/v and du/dv are the source position and
+  // step per pixel in 16.16 fixed point and all samples must be inside src_r
+  // supports source alpha, global alpha, and mask alpha where needed
+  using AffineBlendFunc = void(*)(const Surface* src, const Rect &src_r, const Surface* dest, uint32_t doff, uint32_t cnt, int32_t u, int32_t v, int32_t du, int32_t dv, bool bilinear);
+
   // reads a pixel from the surface and converts it to a Pen
   using PenGetFunc = Pen(*)(const Surface* surf, uint32_t off);
 
@@ -30,6 +43,49 @@ namespace blit {
   extern void P_P(const Surface* src, uint32_t soff, const Surface* dest, uint32_t doff, uint32_t cnt, int32_t src_step);
   extern void M_M(const Surface* src, uint32_t soff, const Surface* dest, uint32_t doff, uint32_t cnt, int32_t src_step);
 
+  extern void RGBA_RGB(const Surface* src, uint32_t soff, const Surface* dest, uint32_t doff, uint32_t cnt, int32_t x, int32_t x_step, int32_t src_step);
+  extern void RGBA_RGB565(const Surface* src, uint32_t soff, const Surface* dest, uint32_t doff, uint32_t cnt, int32_t x, int32_t x_step, int32_t src_step);
+  extern void P_P(const Surface* src, uint32_t soff, const Surface* dest, uint32_t doff, uint32_t cnt, int32_t x, int32_t x_step, int32_t src_step);
+  // reads through pgf/pbf, used for any other format pair
+  extern void stretch_generic(const Surface* src, uint32_t soff, const Surface* dest, uint32_t doff, uint32_t cnt, int32_t x, int32_t x_step, int32_t src_step);
+
+  extern void RGBA_RGB(const Surface* src, const Rect &src_r, const Surface* dest, uint32_t doff, uint32_t cnt, int32_t u, int32_t v, int32_t du, int32_t dv, bool bilinear);
+  extern void RGBA_RGB565(const Surface* src, const Rect &src_r, const Surface* dest, uint32_t doff, uint32_t cnt, int32_t u, int32_t v, int32_t du, int32_t dv, bool bilinear);
+  extern void P_P(const Surface* src, const Rect &src_r, const Surface* dest, uint32_t doff, uint32_t cnt, int32_t u, int32_t v, int32_t du, int32_t dv, bool bilinear);
+  // reads through pgf/pbf, used for any other format pair
+  extern void affine_generic(const Surface* src, const Rect &src_r, const Surface* dest, uint32_t doff, uint32_t cnt, int32_t u, int32_t v, int32_t du, int32_t dv, bool bilinear);
+
+  // paletted surfaces blend entries with alpha (or with global alpha set)
+  // through lookup tables of the nearest entries, one 64KB table is built
+  // for each of the alpha levels used. call this after modifying a palette
+  // in place so they're rebuilt (set_screen_palette does this for the screen)
+  //
+  // the tables are allocated on first use and shared between palettes, at most
+  // palette_blend_max_tables of them (so up to 64KB each, plus 4KB for the
+  // inverse map of each palette). once they're all in use other levels are
+  // blended per pixel, which is slower. if even the inverse map can't be
+  // allocated the colours are copied without blending
+  //
+  // on pico malloc panics instead of failing, so there are no tables and the
+  // inverse map is static. everything is blended per pixel
+  constexpr int palette_blend_levels = 8;
+#if defined(PICO_BUILD)
+  constexpr int palette_blend_max_tables = 0;
+  constexpr int palette_blend_max_palettes = 1;
+#elif defined(TARGET_32BLIT_HW)
+  constexpr int palette_blend_max_tables = 3;
+  constexpr int palette_blend_max_palettes = 2;
+#else
+  constexpr int palette_blend_max_tables = palette_blend_levels - 1;
+  constexpr int palette_blend_max_palettes = 4;
+#endif
+  void invalidate_palette_blend(const Pen *palette);
+
+  // nearest palette entry to each colour with 4 bits per channel, indexed by
+  // r << 8 | g << 4 | b. shares the cache (and invalidation) of the blend tables
+  // returns nullptr if it couldn't be allocated
+  const uint8_t *get_palette_inverse(const Pen *palette);
+
   Pen get_pen_rgb(const Surface *surf, uint32_t offset);
   Pen get_pen_rgba(const Surface *surf, uint32_t offset);
   Pen get_pen_p(const Surface *surf, uint32_t offset);
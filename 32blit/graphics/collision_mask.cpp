@@ -0,0 +1,147 @@
+/*! \file collision_mask.cpp
+    \brief Pixel-perfect collision between sprites.
+*/
+#include <algorithm>
+
+#include "collision_mask.hpp"
+
+namespace blit {
+
+  /**
+   * Build a mask from an area of a surface.
+   *
+   * Pixels are solid if their alpha (or the alpha of their palette entry)
+   * is at least `threshold`. Build masks once when the sprites are loaded,
+   * not every frame.
+   *
+   * \param[in] src Surface to read, usually a sprite sheet.
+   * \param[in] r Area of the surface, such as `src->sprite_bounds(index)`.
+   * \param[in] threshold Minimum alpha of solid pixels.
+   */
+  CollisionMask::CollisionMask(Surface *src, const Rect &r, uint8_t threshold) : bounds(r.w, r.h) {
+    if (bounds.empty())
+      return;
+
+    // one extra word so rows can be read 32 bits at a time from any pixel
+    stride = (bounds.w + 31) / 32 + 1;
+
+    for (auto &d : data)
+      d.resize(stride * bounds.h);
+
+    auto set = [this](std::vector<uint32_t> &d, int32_t x, int32_t y) {
+      d[y * stride + (x >> 5)] |= 0x80000000u >> (x & 31);
+    };
+
+    auto solid = [src, threshold](int32_t x, int32_t y) {
+      return src->pgf(src, src->offset(x, y)).a >= threshold;
+    };
+
+    Rect sheet(Point(0, 0), src->bounds);
+    Rect area = r.intersection(sheet);
+
+    for (int32_t y = area.y; y < area.y + area.h; y++) {
+      for (int32_t x = area.x; x < area.x + area.w; x++) {
+        if (!solid(x, y))
+          continue;
+
+        int32_t mx = x - r.x, my = y - r.y;
+
+        set(data[0], mx, my);
+        set(data[1], bounds.w - 1 - mx, my);
+      }
+    }
+
+    // blit reads the swapped sprite from the transposed area, which is a different part of the sheet if it isn't square
+    area = Rect(r.x, r.y, r.h, r.w).intersection(sheet);
+
+    for (int32_t y = area.y; y < area.y + area.h; y++) {
+      for (int32_t x = area.x; x < area.x + area.w; x++) {
+        if (!solid(x, y))
+          continue;
+
+        int32_t mx = y - r.y, my = x - r.x;
+
+        set(data[2], mx, my);
+        set(data[3], bounds.w - 1 - mx, my);
+      }
+    }
+  }
+
+  /**
+   * Size of the mask once transformed. This is always `bounds`, as `blit`
+   * doesn't swap the width and height for `XYSWAP`.
+   *
+   * \param[in] transform `SpriteTransform` flags.
+   */
+  Size CollisionMask::transformed_bounds(uint8_t /*transform*/) const {
+    return bounds;
+  }
+
+  const uint32_t *CollisionMask::row(int32_t y, uint8_t transform) const {
+    int o = ((transform & SpriteTransform::XYSWAP) ? 2 : 0) | ((transform & SpriteTransform::HORIZONTAL) ? 1 : 0);
+
+    if (transform & SpriteTransform::VERTICAL)
+      y = bounds.h - 1 - y;
+
+    return data[o].data() + y * stride;
+  }
+
+  /**
+   * Check if a pixel of the mask is solid.
+   *
+   * \param[in] p Position in the transformed mask.
+   * \param[in] transform `SpriteTransform` flags.
+   */
+  bool CollisionMask::get(const Point &p, uint8_t transform) const {
+    Size size = transformed_bounds(transform);
+
+    if (p.x < 0 || p.y < 0 || p.x >= size.w || p.y >= size.h)
+      return false;
+
+    return row(p.y, transform)[p.x >> 5] & (0x80000000u >> (p.x & 31));
+  }
+
+  // 32 bits of a row starting at x
+  static inline uint32_t row_bits(const uint32_t *row, int32_t x) {
+    int32_t word = x >> 5, shift = x & 31;
+    return shift ? (row[word] << shift) | (row[word + 1] >> (32 - shift)) : row[word];
+  }
+
+  /**
+   * Check if two masks overlap.
+   *
+   * Only the rows where the bounds of the masks intersect are tested, 32
+   * pixels at a time, stopping at the first solid pixel they share.
+   *
+   * \param[in] a
+   * \param[in] pa Position of the top left of `a`, as passed to `sprite`.
+   * \param[in] ta `SpriteTransform` flags `a` is drawn with.
+   * \param[in] b
+   * \param[in] pb Position of the top left of `b`.
+   * \param[in] tb `SpriteTransform` flags `b` is drawn with.
+   * \return `true` if any solid pixels overlap.
+   */
+  bool masks_overlap(const CollisionMask &a, const Point &pa, uint8_t ta, const CollisionMask &b, const Point &pb, uint8_t tb) {
+    Size sa = a.transformed_bounds(ta), sb = b.transformed_bounds(tb);
+
+    int32_t x0 = std::max(pa.x, pb.x), x1 = std::min(pa.x + sa.w, pb.x + sb.w);
+    int32_t y0 = std::max(pa.y, pb.y), y1 = std::min(pa.y + sa.h, pb.y + sb.h);
+
+    if (x0 >= x1 || y0 >= y1)
+      return false;
+
+    for (int32_t y = y0; y < y1; y++) {
+      auto row_a = a.row(y - pa.y, ta);
+      auto row_b = b.row(y - pb.y, tb);
+
+      // bits past the end of either row are zero, so the last word needs no masking
+      for (int32_t x = x0; x < x1; x += 32) {
+        if (row_bits(row_a, x - pa.x) & row_bits(row_b, x - pb.x))
+          return true;
+      }
+    }
+
+    return false;
+  }
+
+}
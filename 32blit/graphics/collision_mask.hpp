@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "surface.hpp"
+
+namespace blit {
+
+  /**
+   * 1-bit mask of the solid pixels of a sprite, for pixel-perfect overlap
+   * tests.
+   *
+   * Rows are stored as 32-bit words with the leftmost pixel in the top bit.
+   * The horizontally flipped and x/y swapped versions are built along with
+   * it, so a mask can be tested with any `SpriteTransform`.
+   *
+   * Masks match what `blit` draws. An x/y swapped sprite keeps its size and
+   * shows the transposed area of the sheet, `r.h` by `r.w` pixels from the
+   * same top left, so only square sprites are simply rotated.
+   */
+  struct CollisionMask {
+    Size bounds;
+
+    CollisionMask() = default;
+    CollisionMask(Surface *src, const Rect &r, uint8_t threshold = 128);
+
+    Size transformed_bounds(uint8_t transform) const;
+    bool get(const Point &p, uint8_t transform = 0) const;
+
+    // row y of the transformed mask, padded with a zero word
+    const uint32_t *row(int32_t y, uint8_t transform) const;
+
+  private:
+    uint16_t stride = 0;              // words per row
+    std::vector<uint32_t> data[4];    // normal, mirrored, swapped and swapped mirrored
+  };
+
+  bool masks_overlap(const CollisionMask &a, const Point &pa, uint8_t ta, const CollisionMask &b, const Point &pb, uint8_t tb);
+
+}
@@ -0,0 +1,225 @@
+/*! \file compositor.cpp
+    \brief Composites scrolling layers behind the screen.
+*/
+#include <algorithm>
+#include <cstring>
+
+#include "compositor.hpp"
+
+namespace blit {
+
+  static const ScreenLayer *layers = nullptr;
+  static uint8_t layer_count = 0;
+  static Pen screen_key;
+  static uint32_t generation = 0;
+
+  void compositor_set_layers(const ScreenLayer *new_layers, uint8_t count, Pen key) {
+    layers = count ? new_layers : nullptr;
+    layer_count = layers ? count : 0;
+    screen_key = key;
+    generation++;
+  }
+
+  const ScreenLayer *get_screen_layers(uint8_t &count, Pen &key) {
+    count = layer_count;
+    key = screen_key;
+    return layers;
+  }
+
+  uint32_t get_screen_layers_generation() {
+    return generation;
+  }
+
+  __attribute__((always_inline)) static inline uint8_t blend(uint8_t s, uint8_t d, uint8_t a) {
+    return d + ((a * (s - d) + 127) >> 8);
+  }
+
+  static int32_t wrap(int32_t v, int32_t size) {
+    v %= size;
+    return v < 0 ? v + size : v;
+  }
+
+  // key as it's stored in a surface of this format
+  static uint32_t pack_key(const Pen &key, PixelFormat format) {
+    switch(format) {
+      case PixelFormat::RGB:
+        return key.r | key.g << 8 | key.b << 16;
+      case PixelFormat::RGB565:
+        return (key.r >> 3) | (key.g >> 2) << 5 | (key.b >> 3) << 11;
+      default:
+        return key.a;
+    }
+  }
+
+  static uint32_t get_pixel(const uint8_t *p, PixelFormat format) {
+    switch(format) {
+      case PixelFormat::RGB:
+        return p[0] | p[1] << 8 | p[2] << 16;
+      case PixelFormat::RGB565:
+        return *(const uint16_t *)p;
+      default:
+        return *p;
+    }
+  }
+
+  // draws cnt pixels of a layer, all from the same row and without wrapping
+  static void layer_span(const ScreenLayer &layer, const uint8_t *s, uint8_t *d, uint32_t cnt, PixelFormat format, uint8_t stride) {
+    if(!layer.use_key && (layer.alpha == 255 || format == PixelFormat::P)) {
+      memcpy(d, s, cnt * stride);
+      return;
+    }
+
+    uint32_t key = pack_key(layer.key, format);
+    uint8_t a = layer.alpha;
+
+    for(uint32_t i = 0; i < cnt; i++, s += stride, d += stride) {
+      uint32_t c = get_pixel(s, format);
+      if(layer.use_key && c == key)
+        continue;
+
+      if(a == 255 || format == PixelFormat::P) {
+        memcpy(d, s, stride);
+      } else if(format == PixelFormat::RGB) {
+        d[0] = blend(s[0], d[0], a);
+        d[1] = blend(s[1], d[1], a);
+        d[2] = blend(s[2], d[2], a);
+      } else {
+        uint16_t dc = *(uint16_t *)d;
+        uint8_t r = blend((c & 0x1F) << 3, (dc & 0x1F) << 3, a);
+        uint8_t g = blend(((c >> 5) & 0x3F) << 2, ((dc >> 5) & 0x3F) << 2, a);
+        uint8_t b = blend((c >> 11) << 3, (dc >> 11) << 3, a);
+        *(uint16_t *)d = (r >> 3) | (g >> 2) << 5 | (b >> 3) << 11;
+      }
+    }
+  }
+
+  Pen get_screen_key_colour(PixelFormat screen_format, const Pen *palette) {
+    uint32_t key = pack_key(screen_key, screen_format);
+
+    switch(screen_format) {
+      case PixelFormat::RGB:
+        return screen_key;
+      case PixelFormat::RGB565: {
+        uint8_t r = key & 0x1F, g = (key >> 5) & 0x3F, b = key >> 11;
+        return Pen(r << 3 | r >> 2, g << 2 | g >> 4, b << 3 | b >> 2);
+      }
+      default:
+        return palette[key];
+    }
+  }
+
+  bool is_screen_layer_visible(const ScreenLayer &layer, PixelFormat screen_format) {
+    return layer.data && layer.format == screen_format && !layer.bounds.empty() && (layer.alpha || screen_format == PixelFormat::P);
+  }
+
+  // draws every layer over a run of keyed screen pixels, back to front
+  static void composite_run(Surface &screen, int32_t x, int32_t y, int32_t cnt) {
+    auto stride = screen.pixel_stride;
+
+    for(int i = 0; i < layer_count; i++) {
+      auto &layer = layers[i];
+
+      if(!is_screen_layer_visible(layer, screen.format))
+        continue;
+
+      int32_t ly = wrap(y + layer.offset.y, layer.bounds.h);
+      int32_t lx = wrap(x + layer.offset.x, layer.bounds.w);
+      uint8_t *d = screen.data + x * stride + y * screen.row_stride;
+      const uint8_t *row = layer.data + ly * layer.bounds.w * stride;
+
+      // split the run where the layer repeats
+      for(int32_t left = cnt; left;) {
+        int32_t c = std::min(left, layer.bounds.w - lx);
+        layer_span(layer, row + lx * stride, d, c, screen.format, stride);
+        d += c * stride;
+        left -= c;
+        lx = 0;
+      }
+    }
+  }
+
+  /**
+   * Replaces the screen pixels matching the screen key with the layers.
+   *
+   * Only RGB, RGB565 and paletted screens are supported and layers of any
+   * other format than the screen's are skipped. Each row is searched for
+   * runs of keyed pixels so the layers are only read where they're visible.
+   *
+   * \param screen Surface to composite into, the screen after render.
+   */
+  void composite_screen_layers(Surface &screen) {
+    if(!layer_count)
+      return;
+
+    auto format = screen.format;
+    if(format != PixelFormat::RGB && format != PixelFormat::RGB565 && format != PixelFormat::P)
+      return;
+
+    auto stride = screen.pixel_stride;
+    uint32_t key = pack_key(screen_key, format);
+
+    for(int32_t y = 0; y < screen.bounds.h; y++) {
+      const uint8_t *p = screen.data + y * screen.row_stride;
+      int32_t run_start = -1;
+
+      for(int32_t x = 0; x < screen.bounds.w; x++, p += stride) {
+        bool keyed = get_pixel(p, format) == key;
+
+        if(keyed && run_start < 0)
+          run_start = x;
+        else if(!keyed && run_start >= 0) {
+          composite_run(screen, run_start, y, x - run_start);
+          run_start = -1;
+        }
+      }
+
+      if(run_start >= 0)
+        composite_run(screen, run_start, y, screen.bounds.w - run_start);
+    }
+  }
+
+  /**
+   * Converts a layer or the screen to RGBA for drawing on a GPU.
+   *
+   * Pixels matching the key are given an alpha of 0, the rest 255. The
+   * layer's own alpha isn't applied.
+   *
+   * \param surface RGB, RGB565 or paletted surface.
+   * \param palette Palette for paletted surfaces.
+   * \param use_key Make the pixels matching `key` transparent.
+   * \param key Colour (or index in the alpha channel for paletted surfaces) to make transparent.
+   * \param out Output, `surface.bounds` in size.
+   * \param out_stride Bytes per row of `out`.
+   */
+  void screen_layer_to_rgba(const Surface &surface, const Pen *palette, bool use_key, Pen key, uint8_t *out, int32_t out_stride) {
+    auto format = surface.format;
+    uint32_t packed_key = pack_key(key, format);
+
+    for(int32_t y = 0; y < surface.bounds.h; y++) {
+      const uint8_t *s = surface.data + y * surface.row_stride;
+      uint8_t *d = out + y * out_stride;
+
+      for(int32_t x = 0; x < surface.bounds.w; x++, s += surface.pixel_stride, d += 4) {
+        uint32_t c = get_pixel(s, format);
+
+        if(format == PixelFormat::RGB) {
+          d[0] = s[0];
+          d[1] = s[1];
+          d[2] = s[2];
+        } else if(format == PixelFormat::RGB565) {
+          uint8_t r = c & 0x1F, g = (c >> 5) & 0x3F, b = c >> 11;
+          d[0] = r << 3 | r >> 2;
+          d[1] = g << 2 | g >> 4;
+          d[2] = b << 3 | b >> 2;
+        } else {
+          d[0] = palette[c].r;
+          d[1] = palette[c].g;
+          d[2] = palette[c].b;
+        }
+
+        d[3] = use_key && c == packed_key ? 0 : 255;
+      }
+    }
+  }
+
+}
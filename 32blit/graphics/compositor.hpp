@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+
+#include "surface.hpp"
+#include "../engine/engine.hpp"
+
+namespace blit {
+
+  // firmware side of set_screen_layers, the layers aren't copied
+  void compositor_set_layers(const ScreenLayer *layers, uint8_t count, Pen screen_key);
+
+  // fills the keyed pixels of the screen from the current layers, called
+  // by the firmware after render
+  void composite_screen_layers(Surface &screen);
+
+  // for ports drawing the layers in hardware instead of calling
+  // composite_screen_layers, count is 0 if there are no layers
+  const ScreenLayer *get_screen_layers(uint8_t &count, Pen &screen_key);
+
+  // changes each time the layers are set, copies of layer pixels made
+  // before then are out of date
+  uint32_t get_screen_layers_generation();
+
+  // colour shown where the screen and all of the layers are keyed
+  Pen get_screen_key_colour(PixelFormat screen_format, const Pen *palette);
+
+  // if a layer would be drawn over a screen of this format
+  bool is_screen_layer_visible(const ScreenLayer &layer, PixelFormat screen_format);
+
+  // converts a layer or the screen to 8-bit RGBA with keyed pixels transparent,
+  // paletted surfaces use `palette`
+  void screen_layer_to_rgba(const Surface &surface, const Pen *palette, bool use_key, Pen key, uint8_t *out, int32_t out_stride);
+
+}
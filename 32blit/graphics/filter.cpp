@@ -1,54 +1,558 @@
+/*! \file filter.cpp
+    \brief Post-processing filters for surfaces.
+*/
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <new>
+
+#include "filter.hpp"
 
 namespace blit {
-/*
-  void blur(uint8_t passes) {
-    // horizontal
-    uint8_t last;
-
-    for (uint8_t pass = 0; pass < passes; pass++) {
-      uint8_t *p = (uint8_t *)target;
-      for (uint8_t y = 0; y < 120; y++) {
-        last = *p;
-        p++;
-
-        for (uint8_t x = 1; x < 159; x++) {
-          *p = (*(p + 1) + last + *p + *p) >> 2;
-          last = *p;
-          p++;
+
+  ColorMatrix ColorMatrix::identity() {
+    return {{
+      {1.0f, 0.0f, 0.0f, 0.0f},
+      {0.0f, 1.0f, 0.0f, 0.0f},
+      {0.0f, 0.0f, 1.0f, 0.0f}
+    }};
+  }
+
+  ColorMatrix ColorMatrix::grayscale() {
+    return saturation(0.0f);
+  }
+
+  ColorMatrix ColorMatrix::sepia() {
+    return {{
+      {0.393f, 0.769f, 0.189f, 0.0f},
+      {0.349f, 0.686f, 0.168f, 0.0f},
+      {0.272f, 0.534f, 0.131f, 0.0f}
+    }};
+  }
+
+  /**
+   * Blend between grayscale (0) and the original colour (1), values above 1
+   * increase saturation.
+   */
+  ColorMatrix ColorMatrix::saturation(float s) {
+    // luma weights
+    const float lr = 0.299f, lg = 0.587f, lb = 0.114f;
+    float is = 1.0f - s;
+
+    return {{
+      {lr * is + s, lg * is,     lb * is,     0.0f},
+      {lr * is,     lg * is + s, lb * is,     0.0f},
+      {lr * is,     lg * is,     lb * is + s, 0.0f}
+    }};
+  }
+
+  /**
+   * Brightness is added (-1 to 1), contrast scales around mid-grey (1 is unchanged).
+   */
+  ColorMatrix ColorMatrix::brightness_contrast(float brightness, float contrast) {
+    float o = brightness + 0.5f * (1.0f - contrast);
+
+    return {{
+      {contrast, 0.0f,     0.0f,     o},
+      {0.0f,     contrast, 0.0f,     o},
+      {0.0f,     0.0f,     contrast, o}
+    }};
+  }
+
+  /**
+   * Combine two matrices, the result applies `rhs` then this.
+   */
+  ColorMatrix ColorMatrix::operator*(const ColorMatrix &rhs) const {
+    ColorMatrix ret;
+
+    for (int row = 0; row < 3; row++) {
+      for (int col = 0; col < 4; col++) {
+        ret.m[row][col] = m[row][0] * rhs.m[0][col] + m[row][1] * rhs.m[1][col] + m[row][2] * rhs.m[2][col];
+      }
+      ret.m[row][3] += m[row][3];
+    }
+
+    return ret;
+  }
+
+  // RGB565 as stored by the blend functions
+  static inline uint16_t pack_rgb565(uint8_t r, uint8_t g, uint8_t b) {
+    return (r >> 3) | ((g >> 2) << 5) | ((b >> 3) << 11);
+  }
+
+  static inline void unpack_rgb565(uint16_t rgb565, uint8_t *rgb) {
+    rgb[0] = (rgb565 & 0x1F) << 3;
+    rgb[1] = ((rgb565 >> 5) & 0x3F) << 2;
+    rgb[2] = ((rgb565 >> 11) & 0x1F) << 3;
+  }
+
+  static bool is_filterable(const Surface *surface) {
+    return surface->format == PixelFormat::RGB || surface->format == PixelFormat::RGBA || surface->format == PixelFormat::RGB565;
+  }
+
+  // get a row of pixels as 8-bit RGB with `stride` bytes per pixel, RGB565
+  // rows are unpacked into `buf` and need writing back with `end_row`
+  static uint8_t *begin_row(Surface *surface, int32_t x, int32_t y, int32_t w, uint8_t *buf, int &stride) {
+    if (surface->format != PixelFormat::RGB565) {
+      stride = surface->pixel_stride;
+      return surface->ptr(x, y);
+    }
+
+    auto s = (uint16_t *)surface->ptr(x, y);
+    for (int32_t i = 0; i < w; i++)
+      unpack_rgb565(s[i], buf + i * 3);
+
+    stride = 3;
+    return buf;
+  }
+
+  static void end_row(Surface *surface, int32_t x, int32_t y, int32_t w, const uint8_t *buf) {
+    if (surface->format != PixelFormat::RGB565)
+      return;
+
+    auto d = (uint16_t *)surface->ptr(x, y);
+    for (int32_t i = 0; i < w; i++, buf += 3)
+      d[i] = pack_rgb565(buf[0], buf[1], buf[2]);
+  }
+
+  // copy a row of pixels as packed 8-bit RGB
+  static void read_row(Surface *surface, int32_t x, int32_t y, int32_t w, uint8_t *out) {
+    switch (surface->format) {
+      case PixelFormat::RGB:
+        memcpy(out, surface->ptr(x, y), w * 3);
+        break;
+
+      case PixelFormat::RGB565: {
+        auto s = (uint16_t *)surface->ptr(x, y);
+        for (int32_t i = 0; i < w; i++, out += 3)
+          unpack_rgb565(s[i], out);
+        break;
+      }
+
+      case PixelFormat::RGBA: {
+        auto s = surface->ptr(x, y);
+        for (int32_t i = 0; i < w; i++, s += 4) {
+          *out++ = s[0];
+          *out++ = s[1];
+          *out++ = s[2];
         }
+        break;
       }
+
+      default:
+        for (int32_t i = 0; i < w; i++) {
+          auto pen = surface->get_pixel(Point(x + i, y));
+          *out++ = pen.r;
+          *out++ = pen.g;
+          *out++ = pen.b;
+        }
     }
+  }
+
+  // reciprocal for box_average, rounded up
+  static uint64_t box_reciprocal(int32_t n) {
+    return ((uint64_t(1) << 32) + n - 1) / n;
+  }
+
+  // sum / n rounded to the nearest integer, exact for sums of n 8-bit values while n < 4096
+  static inline uint8_t box_average(uint32_t sum, int32_t n, uint64_t recip) {
+    return ((sum + n / 2) * recip) >> 32;
+  }
+
+  // one box blur pass of each row, the running sum makes it the same cost for any radius
+  static void box_blur_rows(Surface *dest, const Rect &r, int radius, uint8_t *in, uint8_t *buf) {
+    int32_t n = radius * 2 + 1;
+    auto recip = box_reciprocal(n);
+    int32_t last = r.w - 1;
+
+    for (int32_t y = r.y; y < r.y + r.h; y++) {
+      read_row(dest, r.x, y, r.w, in);
 
-    // vertical      
-    for (uint8_t pass = 0; pass < passes; pass++) {
-      for (uint8_t x = 0; x < 160; x++) {
-        uint8_t *p = (uint8_t *)target + x;
+      int stride;
+      uint8_t *out = begin_row(dest, r.x, y, r.w, buf, stride);
 
-        last = *p;
-        p += 160;
-         
-        for (uint8_t y = 1; y < 119; y++) {
-          *p = (*(p + 160) + last + *p + *p) >> 2;
-          last = *p;
-          p += 160;
+      for (int c = 0; c < 3; c++) {
+        uint32_t sum = 0;
+        for (int32_t k = -radius; k <= radius; k++)
+          sum += in[std::min(std::max(k, 0), last) * 3 + c];
+
+        uint8_t *o = out + c;
+
+        for (int32_t x = 0; x < r.w; x++) {
+          *o = box_average(sum, n, recip);
+          o += stride;
+
+          sum += in[std::min(x + radius + 1, last) * 3 + c];
+          sum -= in[std::max(x - radius, 0) * 3 + c];
         }
       }
+
+      end_row(dest, r.x, y, r.w, out);
     }
   }
 
-  uint32_t g_seed = 0;
-  inline uint8_t rand_uint8() {
-    g_seed = (214013 * g_seed + 2531011);
-    return (g_seed >> 16) & 0xFF;
+  // rows the column pass keeps, only the original rows from radius above down to the current one are needed
+  static int32_t box_window_rows(const Rect &r, int radius) {
+    return std::min(radius + 1, r.h);
   }
 
-  void noise(uint8_t alpha) {
-    uint8_t *p = (uint8_t *)target;
-    for (uint8_t y = 0; y < 120; y++) {
-      for (uint8_t x = 0; x < 160; x++) {
-        *p++ = ((*p * (255 - alpha)) + (rand_uint8() * alpha)) >> 8;
+  // one box blur pass of each column, done a row at a time by keeping the
+  // sum of each column and the original rows that haven't left the window
+  static void box_blur_columns(Surface *dest, const Rect &r, int radius, uint8_t *window, uint32_t *sums, uint8_t *buf) {
+    int32_t n = radius * 2 + 1;
+    auto recip = box_reciprocal(n);
+    int32_t row_size = r.w * 3;
+    int32_t window_rows = box_window_rows(r, radius);
+
+    // original row y, rows below the current one haven't been written so are read directly
+    auto slot = [&](int32_t y) {
+      return window + (y % window_rows) * row_size;
+    };
+    uint8_t *tmp = window + window_rows * row_size;
+
+    memset(sums, 0, row_size * sizeof(uint32_t));
+
+    // rows past the edges repeat them, so count the edge rows that many more times
+    int32_t last = r.h - 1;
+
+    for (int32_t e = 0; e <= std::min(radius, last); e++) {
+      uint32_t weight = 1 + (e == 0 ? radius : 0) + (e == last ? std::max(radius - last, 0) : 0);
+      read_row(dest, r.x, r.y + e, r.w, tmp);
+
+      for (int32_t i = 0; i < row_size; i++)
+        sums[i] += tmp[i] * weight;
+    }
+
+    for (int32_t y = 0; y < r.h; y++) {
+      // keep the original before it's overwritten
+      read_row(dest, r.x, r.y + y, r.w, slot(y));
+
+      int stride;
+      uint8_t *out = begin_row(dest, r.x, r.y + y, r.w, buf, stride);
+
+      for (int32_t x = 0; x < r.w; x++) {
+        out[0] = box_average(sums[x * 3 + 0], n, recip);
+        out[1] = box_average(sums[x * 3 + 1], n, recip);
+        out[2] = box_average(sums[x * 3 + 2], n, recip);
+        out += stride;
       }
+
+      end_row(dest, r.x, r.y + y, r.w, buf);
+
+      if (y == r.h - 1)
+        break;
+
+      // move the window down
+      auto row = slot(std::max(y - radius, 0));
+
+      for (int32_t i = 0; i < row_size; i++)
+        sums[i] -= row[i];
+
+      read_row(dest, r.x, r.y + std::min(y + radius + 1, r.h - 1), r.w, tmp);
+
+      for (int32_t i = 0; i < row_size; i++)
+        sums[i] += tmp[i];
+    }
+  }
+
+  static const int max_box_radius = 2047;
+
+  static void box_blur_passes(Surface *dest, const Rect &r, const int *radii, int passes) {
+    int max_radius = 0;
+    for (int i = 0; i < passes; i++)
+      max_radius = std::max(max_radius, radii[i]);
+
+    // box_average is only exact up to this
+    max_radius = std::min(max_radius, max_box_radius);
+
+    // the original rows kept by the column pass, plus one to load into
+    int32_t row_size = r.w * 3;
+    auto window = new (std::nothrow) uint8_t[row_size * (box_window_rows(r, max_radius) + 1)];
+    auto buf = new (std::nothrow) uint8_t[row_size * 2];
+    auto sums = new (std::nothrow) uint32_t[row_size];
+
+    for (int i = 0; i < passes && window && buf && sums; i++) {
+      if (radii[i] < 1)
+        continue;
+
+      int radius = std::min(radii[i], max_box_radius);
+      box_blur_rows(dest, r, radius, window, buf);
+      box_blur_columns(dest, r, radius, window, sums, buf);
     }
-  }*/
 
-}
\ No newline at end of file
+    delete[] window;
+    delete[] buf;
+    delete[] sums;
+  }
+
+  /**
+   * Blur part of a surface with a box filter.
+   *
+   * Rows and columns are blurred separately using running sums so the cost
+   * doesn't depend on the radius. Multiple passes approach a Gaussian blur.
+   * Paletted surfaces aren't supported. The radius is limited to 2047. Needs
+   * about (radius + 3) rows of 3 bytes per pixel (at most the height of the
+   * area + 3), nothing is blurred if that can't be allocated.
+   *
+   * \param dest Surface to blur.
+   * \param r Area to blur, pixels outside it aren't sampled.
+   * \param radius Radius of the box in pixels.
+   * \param passes Number of times to blur.
+   */
+  void box_blur(Surface *dest, const Rect &r, int radius, int passes) {
+    Rect cr = dest->clip.intersection(r);
+
+    if (cr.empty() || radius < 1 || !is_filterable(dest))
+      return;
+
+    int radii[8];
+    passes = std::min(passes, 8);
+    for (int i = 0; i < passes; i++)
+      radii[i] = radius;
+
+    box_blur_passes(dest, cr, radii, passes);
+  }
+
+  /**
+   * Blur part of a surface with an approximate Gaussian filter.
+   *
+   * Uses three box blurs with radii chosen to match the standard deviation.
+   * Paletted surfaces aren't supported.
+   *
+   * \param dest Surface to blur.
+   * \param r Area to blur, pixels outside it aren't sampled.
+   * \param sigma Standard deviation of the blur in pixels.
+   */
+  void gaussian_blur(Surface *dest, const Rect &r, float sigma) {
+    Rect cr = dest->clip.intersection(r);
+
+    if (cr.empty() || sigma <= 0.0f || !is_filterable(dest))
+      return;
+
+    // box widths for three passes, some are the next odd width up so the variance adds up
+    const int passes = 3;
+    float ideal = std::sqrt(12.0f * sigma * sigma / passes + 1.0f);
+    int lower = int(ideal);
+    if (lower % 2 == 0)
+      lower--;
+    int upper = lower + 2;
+
+    float ideal_count = (12.0f * sigma * sigma - passes * lower * lower - 4.0f * passes * lower - 3.0f * passes) / (-4.0f * lower - 4.0f);
+    int count = int(std::round(ideal_count));
+
+    int radii[passes];
+    for (int i = 0; i < passes; i++)
+      radii[i] = ((i < count ? lower : upper) - 1) / 2;
+
+    box_blur_passes(dest, cr, radii, passes);
+  }
+
+  // apply a colour function to part of a surface, paletted surfaces remap
+  // each index to the entry nearest the result for that index's colour
+  template<class F>
+  static void apply_color(Surface *dest, const Rect &r, F func) {
+    Rect cr = dest->clip.intersection(r);
+
+    if (cr.empty())
+      return;
+
+    if (dest->format == PixelFormat::P) {
+      if (!dest->palette)
+        return;
+
+      auto inverse = get_palette_inverse(dest->palette);
+      if (!inverse)
+        return;
+
+      uint8_t remap[256];
+
+      for (int i = 0; i < 256; i++) {
+        uint8_t rgb[3] = {dest->palette[i].r, dest->palette[i].g, dest->palette[i].b};
+        func(rgb);
+        remap[i] = inverse[((rgb[0] + 8) / 17) << 8 | ((rgb[1] + 8) / 17) << 4 | ((rgb[2] + 8) / 17)];
+      }
+
+      for (int32_t y = cr.y; y < cr.y + cr.h; y++) {
+        uint8_t *p = dest->ptr(cr.x, y);
+        for (int32_t x = 0; x < cr.w; x++, p++) {
+          if (*p != dest->transparent_index)
+            *p = remap[*p];
+        }
+      }
+      return;
+    }
+
+    if (!is_filterable(dest))
+      return;
+
+    auto buf = dest->format == PixelFormat::RGB565 ? new uint8_t[cr.w * 3] : nullptr;
+
+    for (int32_t y = cr.y; y < cr.y + cr.h; y++) {
+      int stride;
+      uint8_t *row = begin_row(dest, cr.x, y, cr.w, buf, stride);
+
+      uint8_t *p = row;
+      for (int32_t x = 0; x < cr.w; x++, p += stride)
+        func(p);
+
+      end_row(dest, cr.x, y, cr.w, row);
+    }
+
+    delete[] buf;
+  }
+
+  // apply a lookup table to each channel
+  static void apply_lut(Surface *dest, const Rect &r, const uint8_t (&lut)[3][256]) {
+    apply_color(dest, r, [&lut](uint8_t *rgb) {
+      rgb[0] = lut[0][rgb[0]];
+      rgb[1] = lut[1][rgb[1]];
+      rgb[2] = lut[2][rgb[2]];
+    });
+  }
+
+  /**
+   * Transform the colours of part of a surface by a matrix.
+   *
+   * \param dest Surface to modify.
+   * \param r Area to modify.
+   * \param matrix `ColorMatrix` to apply.
+   */
+  void color_matrix(Surface *dest, const Rect &r, const ColorMatrix &matrix) {
+    // 8.8 fixed point, with the offset scaled to 0 - 255
+    int32_t m[3][4];
+    for (int row = 0; row < 3; row++) {
+      for (int col = 0; col < 3; col++)
+        m[row][col] = int32_t(std::round(matrix.m[row][col] * 256.0f));
+      m[row][3] = int32_t(std::round(matrix.m[row][3] * 255.0f * 256.0f)) + 128;
+    }
+
+    apply_color(dest, r, [&m](uint8_t *rgb) {
+      int32_t r = rgb[0], g = rgb[1], b = rgb[2];
+
+      for (int i = 0; i < 3; i++) {
+        int32_t v = (m[i][0] * r + m[i][1] * g + m[i][2] * b + m[i][3]) >> 8;
+        rgb[i] = std::min(std::max(v, 0), 255);
+      }
+    });
+  }
+
+  /**
+   * Blend part of a surface towards a colour.
+   *
+   * \param dest Surface to modify.
+   * \param r Area to modify.
+   * \param colour Colour to blend towards, the alpha is the amount.
+   */
+  void tint(Surface *dest, const Rect &r, const Pen &colour) {
+    uint8_t lut[3][256];
+    uint8_t target[3] = {colour.r, colour.g, colour.b};
+
+    for (int c = 0; c < 3; c++) {
+      for (int v = 0; v < 256; v++)
+        lut[c][v] = v + ((colour.a * (target[c] - v) + 127) / 255);
+    }
+
+    apply_lut(dest, r, lut);
+  }
+
+  /**
+   * Darken part of a surface.
+   *
+   * \param dest Surface to modify.
+   * \param r Area to modify.
+   * \param brightness Brightness to fade to, 255 is unchanged and 0 black.
+   */
+  void fade(Surface *dest, const Rect &r, uint8_t brightness) {
+    uint8_t lut[3][256];
+
+    for (int v = 0; v < 256; v++)
+      lut[0][v] = lut[1][v] = lut[2][v] = (v * brightness + 127) / 255;
+
+    apply_lut(dest, r, lut);
+  }
+
+  // 4x4 ordered dither thresholds (0 - 15)
+  static const uint8_t bayer4[4][4] = {
+    { 0,  8,  2, 10},
+    {12,  4, 14,  6},
+    { 3, 11,  1,  9},
+    {15,  7, 13,  5}
+  };
+
+  /**
+   * Copy part of a surface to an RGB565 or paletted surface with ordered
+   * dithering.
+   *
+   * The dither pattern is aligned to the destination so it stays in place as
+   * the image moves. Paletted surfaces use the nearest entry to each colour
+   * at 4 bits per channel, so work best with an evenly spread palette.
+   * Other destination formats are blitted normally.
+   *
+   * \param src Surface to copy from.
+   * \param src_r Area of the source to copy.
+   * \param dest Surface to copy to.
+   * \param p Position in the destination.
+   */
+  void dither(Surface *src, const Rect &src_r, Surface *dest, const Point &p) {
+    if (dest->format != PixelFormat::RGB565 && (dest->format != PixelFormat::P || !dest->palette)) {
+      dest->blit(src, src_r, p);
+      return;
+    }
+
+    // only the part of the source rect inside the source can be read
+    Rect sr = src_r.intersection(Rect(Point(0, 0), src->bounds));
+    Point dp = p + (sr.tl() - src_r.tl());
+
+    Rect dr = dest->clip.intersection(Rect(dp, Size(sr.w, sr.h)));
+
+    if (sr.empty() || dr.empty())
+      return;
+
+    // move the source rect by as much as the destination was clipped
+    Point so(sr.x + dr.x - dp.x, sr.y + dr.y - dp.y);
+
+    auto inverse = dest->format == PixelFormat::P ? get_palette_inverse(dest->palette) : nullptr;
+
+    if (dest->format == PixelFormat::P && !inverse) {
+      dest->blit(src, src_r, p);
+      return;
+    }
+
+    auto row = new uint8_t[dr.w * 3];
+
+    for (int32_t y = 0; y < dr.h; y++) {
+      read_row(src, so.x, so.y + y, dr.w, row);
+
+      int32_t dy = dr.y + y;
+      auto threshold = bayer4[dy & 3];
+      const uint8_t *s = row;
+
+      if (inverse) {
+        uint8_t *d = dest->ptr(dr.x, dy);
+
+        for (int32_t x = 0; x < dr.w; x++, s += 3) {
+          // spread the threshold over the 17 steps between 4-bit levels
+          int t = threshold[(dr.x + x) & 3] * 17 / 16;
+          int r = std::min((s[0] + t) / 17, 15);
+          int g = std::min((s[1] + t) / 17, 15);
+          int b = std::min((s[2] + t) / 17, 15);
+          *d++ = inverse[r << 8 | g << 4 | b];
+        }
+      } else {
+        auto d = (uint16_t *)dest->ptr(dr.x, dy);
+
+        for (int32_t x = 0; x < dr.w; x++, s += 3) {
+          int t = threshold[(dr.x + x) & 3];
+          // 5-bit channels step by 8 and 6-bit by 4
+          int r = std::min((s[0] + t / 2) >> 3, 31);
+          int g = std::min((s[1] + t / 4) >> 2, 63);
+          int b = std::min((s[2] + t / 2) >> 3, 31);
+          *d++ = r | (g << 5) | (b << 11);
+        }
+      }
+    }
+
+    delete[] row;
+  }
+
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+
+#include "surface.hpp"
+
+namespace blit {
+
+  /**
+   * 3x4 colour matrix, each row gives the new red, green or blue from the
+   * old (r, g, b, 1). Channels are 0 - 1 so the last column is an offset.
+   */
+  struct ColorMatrix {
+    float m[3][4];
+
+    static ColorMatrix identity();
+    static ColorMatrix grayscale();
+    static ColorMatrix sepia();
+    static ColorMatrix saturation(float s);
+    static ColorMatrix brightness_contrast(float brightness, float contrast);
+
+    ColorMatrix operator*(const ColorMatrix &rhs) const;
+  };
+
+  // these all operate on the part of `r` inside the surface's clip rect and
+  // support RGB, RGBA (alpha is kept) and RGB565 surfaces. colour changes
+  // to paletted surfaces remap each index to the nearest entry instead
+
+  void box_blur(Surface *dest, const Rect &r, int radius, int passes = 1);
+  void gaussian_blur(Surface *dest, const Rect &r, float sigma);
+
+  void color_matrix(Surface *dest, const Rect &r, const ColorMatrix &matrix);
+  void tint(Surface *dest, const Rect &r, const Pen &colour);
+  void fade(Surface *dest, const Rect &r, uint8_t brightness);
+
+  void dither(Surface *src, const Rect &src_r, Surface *dest, const Point &p);
+
+}
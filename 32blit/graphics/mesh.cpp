@@ -0,0 +1,175 @@
+/*! \file mesh.cpp
+    \brief Minimal 3D pipeline for drawing triangle meshes.
+*/
+#include <algorithm>
+#include <cstring>
+
+#include "mesh.hpp"
+
+namespace blit {
+
+  /**
+   * Allocate a depth buffer for a surface
+   *
+   * \param[in] surface_bounds Size of the surface the buffer will be attached to.
+   * \param[in] half_res `true` to store one depth value per 2x2 pixels.
+   */
+  DepthBuffer::DepthBuffer(const Size &surface_bounds, bool half_res) : shift(half_res ? 1 : 0) {
+    bounds = Size((surface_bounds.w + shift) >> shift, (surface_bounds.h + shift) >> shift);
+    data = new uint16_t[bounds.w * bounds.h];
+    clear();
+  }
+
+  DepthBuffer::~DepthBuffer() {
+    delete[] data;
+  }
+
+  /**
+   * Reset every depth value, usually to the far plane before drawing a frame
+   *
+   * \param[in] depth Value to reset to.
+   */
+  void DepthBuffer::clear(uint16_t depth) {
+    std::fill(data, data + bounds.w * bounds.h, depth);
+  }
+
+  // vertex in clip space
+  struct ClipVertex {
+    float x, y, z, w;
+    Vec2 uv;
+  };
+
+  // distance inside each frustum plane (inside if >= 0), the far plane is
+  // left to the depth test
+  static float clip_distance(const ClipVertex &v, int plane) {
+    switch (plane) {
+      case 0: return v.z + v.w; // near
+      case 1: return v.x + v.w; // left
+      case 2: return v.w - v.x; // right
+      case 3: return v.y + v.w; // bottom
+      default: return v.w - v.y; // top
+    }
+  }
+
+  static const int num_clip_planes = 5;
+  static const int max_clip_vertices = 3 + num_clip_planes;
+
+  // clips a convex polygon against a plane, returning the new vertex count
+  static int clip_polygon(const ClipVertex *in, int count, ClipVertex *out, int plane) {
+    int out_count = 0;
+
+    for (int i = 0; i < count; i++) {
+      auto &a = in[i], &b = in[(i + 1) % count];
+      float da = clip_distance(a, plane), db = clip_distance(b, plane);
+
+      if (da >= 0.0f)
+        out[out_count++] = a;
+
+      if ((da >= 0.0f) != (db >= 0.0f)) {
+        float t = da / (da - db);
+        auto &o = out[out_count++];
+        o.x = a.x + (b.x - a.x) * t;
+        o.y = a.y + (b.y - a.y) * t;
+        o.z = a.z + (b.z - a.z) * t;
+        o.w = a.w + (b.w - a.w) * t;
+        o.uv = a.uv + (b.uv - a.uv) * t;
+      }
+    }
+
+    return out_count;
+  }
+
+  /**
+   * Draw a mesh
+   *
+   * Vertices are transformed to clip space by `transform` (usually
+   * projection * view * model, see `Mat4::perspective`) and clipped to the
+   * view. Triangles are textured from `mesh.texture` or filled with the
+   * current pen of `dest` and depth tested if `dest` has a depth buffer.
+   *
+   * \param[in] dest Surface to draw to, the viewport covers the whole surface.
+   * \param[in] mesh
+   * \param[in] transform Model to clip space transform.
+   * \param[in] cull Faces to skip.
+   * \param[in] perspective `true` for perspective-correct texturing.
+   */
+  void draw_mesh(Surface *dest, const Mesh &mesh, const Mat4 &transform, CullMode cull, bool perspective) {
+    const Mat4 &m = transform;
+
+    float half_w = dest->bounds.w * 0.5f;
+    float half_h = dest->bounds.h * 0.5f;
+
+    for (uint32_t i = 0; i + 2 < mesh.index_count; i += 3) {
+      ClipVertex poly[max_clip_vertices], tmp[max_clip_vertices];
+
+      // transform to clip space
+      uint8_t outside_all = 0xFF, outside_any = 0;
+
+      for (int j = 0; j < 3; j++) {
+        auto &in = mesh.vertices[mesh.indices[i + j]];
+        auto &v = poly[j];
+
+        v.x = m.v00 * in.pos.x + m.v01 * in.pos.y + m.v02 * in.pos.z + m.v03;
+        v.y = m.v10 * in.pos.x + m.v11 * in.pos.y + m.v12 * in.pos.z + m.v13;
+        v.z = m.v20 * in.pos.x + m.v21 * in.pos.y + m.v22 * in.pos.z + m.v23;
+        v.w = m.v30 * in.pos.x + m.v31 * in.pos.y + m.v32 * in.pos.z + m.v33;
+        v.uv = in.uv;
+
+        uint8_t outside = 0;
+        for (int plane = 0; plane < num_clip_planes; plane++) {
+          if (clip_distance(v, plane) < 0.0f)
+            outside |= 1 << plane;
+        }
+
+        outside_all &= outside;
+        outside_any |= outside;
+      }
+
+      // entirely outside one of the planes
+      if (outside_all)
+        continue;
+
+      int count = 3;
+
+      if (outside_any) {
+        for (int plane = 0; plane < num_clip_planes && count; plane++) {
+          if (!(outside_any & (1 << plane)))
+            continue;
+
+          count = clip_polygon(poly, count, tmp, plane);
+          memcpy(poly, tmp, count * sizeof(ClipVertex));
+        }
+
+        if (count < 3)
+          continue;
+      }
+
+      // project to the screen
+      TexturedVertex screen_verts[max_clip_vertices];
+
+      for (int j = 0; j < count; j++) {
+        auto &v = poly[j];
+        float inv_w = 1.0f / v.w;
+
+        screen_verts[j].pos = Vec2((v.x * inv_w + 1.0f) * half_w, (1.0f - v.y * inv_w) * half_h);
+        screen_verts[j].uv = v.uv;
+        screen_verts[j].w = v.w;
+        screen_verts[j].z = (v.z * inv_w + 1.0f) * 0.5f;
+      }
+
+      // cull using the winding on screen, y points down so front faces have a negative area
+      if (cull != CullMode::none) {
+        auto &a = screen_verts[0].pos, &b = screen_verts[1].pos, &c = screen_verts[2].pos;
+        float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+
+        if (cull == CullMode::back ? area >= 0.0f : area <= 0.0f)
+          continue;
+      }
+
+      // clipping keeps the polygon convex so it can be drawn as a fan
+      for (int j = 1; j + 1 < count; j++)
+        dest->texture_triangle(mesh.texture, screen_verts[0], screen_verts[j], screen_verts[j + 1], perspective);
+    }
+  }
+
+}
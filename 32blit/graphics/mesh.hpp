@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+
+#include "surface.hpp"
+#include "../types/mat4.hpp"
+#include "../types/vec2.hpp"
+#include "../types/vec3.hpp"
+
+namespace blit {
+
+  /**
+   * 16-bit depth buffer for a surface, 0 is nearest and 0xFFFF furthest.
+   *
+   * Attach to a surface with `surface.depth = &buffer` to depth test
+   * `texture_triangle` and `draw_mesh`. At half resolution each depth value
+   * covers a 2x2 block of pixels, which uses a quarter of the memory
+   * (38KB instead of 150KB for a 320x240 screen) at the cost of some
+   * accuracy where triangles meet.
+   */
+  struct DepthBuffer {
+    uint16_t *data;
+    Size bounds;    // size of the depth data
+    uint8_t shift;  // 0 for full resolution, 1 for half
+
+    DepthBuffer(const Size &surface_bounds, bool half_res = false);
+    DepthBuffer(const DepthBuffer &) = delete;
+    ~DepthBuffer();
+
+    DepthBuffer &operator=(const DepthBuffer &) = delete;
+
+    void clear(uint16_t depth = 0xFFFF);
+
+    uint16_t *ptr(int32_t x, int32_t y) { return data + (x >> shift) + (y >> shift) * bounds.w; }
+  };
+
+  struct MeshVertex {
+    Vec3 pos;
+    Vec2 uv;  // texture position in pixels
+  };
+
+  /**
+   * Indexed triangle mesh, the vertex and index data isn't copied so must
+   * outlive the mesh.
+   */
+  struct Mesh {
+    const MeshVertex *vertices = nullptr;
+    const uint16_t *indices = nullptr;  // three per triangle
+    uint32_t index_count = 0;
+
+    Surface *texture = nullptr;         // drawn with the destination pen if not set
+  };
+
+  /// Which triangles `draw_mesh` skips, front faces are wound anti-clockwise as seen by the camera
+  enum class CullMode {
+    none,
+    back,
+    front
+  };
+
+  void draw_mesh(Surface *dest, const Mesh &mesh, const Mat4 &transform, CullMode cull = CullMode::back, bool perspective = true);
+
+}
@@ -6,6 +6,7 @@
 #include <cmath>
 #include <cfloat>
 
+#include "../math/fastmath.hpp"
 #include "../math/interpolation.hpp"
 #include "mode7.hpp"
 
@@ -14,6 +15,13 @@
 
 namespace blit {
  
+  // only needs to be accurate to a fraction of a pixel, so use fast trig
+  static Vec2 rotate(Vec2 v, float a) {
+    float c = fastmath::cos(a);
+    float s = fastmath::sin(a);
+    return Vec2(v.x * c - v.y * s, v.x * s + v.y * c);
+  }
+
 
   // TODO: Provide method to return scale for world coordinate
 
@@ -33,22 +41,21 @@ namespace blit {
 
     Vec2 v(w - pos);
     v.normalize();
-    Vec2 f(0, -1);
-    f *= Mat3::rotation(angle);
+    Vec2 f = rotate(Vec2(0, -1), angle);
 
     float wd = (w - pos).length();
     float dot = f.dot(v);
     float det = f.x * v.y - f.y * v.x;
-    float theta = atan2f(det, dot);
-    float costheta = cosf(theta);
+    float theta = fastmath::atan2(det, dot);
+    float costheta = fastmath::cos(theta);
     float ctd = wd * costheta;
 
-    float pd = ctd / cosf(hfov);
+    float pd = ctd / fastmath::cos(hfov);
 
-    float theta_sign = std::copysign(1.0f, theta);
-    
     float hsl = sqrtf((pd * pd) - (ctd * ctd));
-    float so = hsl + (sqrtf((wd * wd) - (ctd * ctd)) * theta_sign);
+
+    // sqrt(wd^2 - ctd^2) with the sign of theta, without the cancellation near the centre
+    float so = hsl + wd * fastmath::sin(theta);
     float r = so / (hsl * 2.0f);
 
     Vec2 s(
@@ -71,14 +78,10 @@ namespace blit {
    * \param[in] viewport
    */
   Vec2 screen_to_world(Vec2 s, float fov, float angle, Vec2 pos, float near, float far, Rect viewport) {
-    Vec2 forward(0, -1);
-    forward *= Mat3::rotation(angle);
-
-    Vec2 left = forward;
-    left *= Mat3::rotation(-(fov / 2.0f));
+    Vec2 forward = rotate(Vec2(0, -1), angle);
 
-    Vec2 right = forward;
-    right *= Mat3::rotation((fov / 2.0f));
+    Vec2 left = rotate(forward, -(fov / 2.0f));
+    Vec2 right = rotate(forward, (fov / 2.0f));
 
     float distance = ((far - near) / float(s.y - viewport.y)) + near;
     
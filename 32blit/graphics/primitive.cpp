@@ -2,9 +2,13 @@
     \brief Drawing routines for primitive shapes.
 */
 
+#include <algorithm>
 #include <cstdlib>
 #include <cmath>
+#include <cstring>
+#include <memory>
 
+#include "mesh.hpp"
 #include "surface.hpp"
 
 namespace blit {
@@ -138,38 +142,660 @@ namespace blit {
     }
   }
 
+  // floor division, for stepping edges left and right the same way
+  static int64_t floor_div(int64_t a, int64_t b) {
+    int64_t q = a / b;
+    return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+  }
+
+  static int64_t ceil_div(int64_t a, int64_t b) {
+    return -floor_div(-a, b);
+  }
+
+  // Cohen-Sutherland region code of a point relative to a rectangle
+  enum ClipCode {
+    CLIP_LEFT = 1,
+    CLIP_RIGHT = 2,
+    CLIP_TOP = 4,
+    CLIP_BOTTOM = 8
+  };
+
+  template<typename T>
+  static int clip_code(T x, T y, T x0, T y0, T x1, T y1) {
+    return (x < x0 ? CLIP_LEFT : x > x1 ? CLIP_RIGHT : 0) | (y < y0 ? CLIP_TOP : y > y1 ? CLIP_BOTTOM : 0);
+  }
+
+  // clip a line to the rectangle (x0, y0) - (x1, y1) inclusive, returns false if nothing is left
+  static bool clip_line(Vec2 &p1, Vec2 &p2, float x0, float y0, float x1, float y1) {
+    int code1 = clip_code(p1.x, p1.y, x0, y0, x1, y1);
+    int code2 = clip_code(p2.x, p2.y, x0, y0, x1, y1);
+
+    while (code1 | code2) {
+      if (code1 & code2)
+        return false;
+
+      // move the outside point to the edge it's beyond
+      int code = code1 ? code1 : code2;
+      Vec2 &p = code1 ? p1 : p2;
+      Vec2 d = p2 - p1;
+
+      if (code & CLIP_LEFT)
+        p = Vec2(x0, p1.y + d.y * (x0 - p1.x) / d.x);
+      else if (code & CLIP_RIGHT)
+        p = Vec2(x1, p1.y + d.y * (x1 - p1.x) / d.x);
+      else if (code & CLIP_TOP)
+        p = Vec2(p1.x + d.x * (y0 - p1.y) / d.y, y0);
+      else
+        p = Vec2(p1.x + d.x * (y1 - p1.y) / d.y, y1);
+
+      if (code1)
+        code1 = clip_code(p1.x, p1.y, x0, y0, x1, y1);
+      else
+        code2 = clip_code(p2.x, p2.y, x0, y0, x1, y1);
+    }
+
+    return true;
+  }
+
+  // batches pixels along a row into runs of equal coverage (0 - 256) so
+  // they can be blended with a single call
+  struct CoverageSpan {
+    Surface *dest;
+    Pen pen;
+    int32_t x = 0, y = 0, count = 0;
+    int coverage = 0;
+
+    CoverageSpan(Surface *dest) : dest(dest), pen(dest->pen) {}
+
+    ~CoverageSpan() {
+      flush();
+    }
+
+    void add(int32_t px, int32_t py, int c, int32_t n = 1) {
+      if (count && (c != coverage || py != y || px != x + count))
+        flush();
+
+      if (!count) {
+        x = px;
+        y = py;
+        coverage = c;
+      }
+
+      count += n;
+    }
+
+    void flush() {
+      if (!count)
+        return;
+
+      if (dest->format == PixelFormat::P) {
+        // pen alpha is the palette index, so draw or don't
+        if (coverage >= 128)
+          dest->pbf(&dest->pen, dest, dest->offset(x, y), count);
+      } else if (coverage > 0) {
+        pen.a = (dest->pen.a * std::min(coverage, 256)) >> 8;
+        dest->pbf(&pen, dest, dest->offset(x, y), count);
+      }
+
+      count = 0;
+    }
+  };
+
   /**
    * Draw a line in the current pen colour.
    *
+   * The line is clipped before drawing and pixels along the same row are
+   * blended as a single span.
+   *
    * \param[in] p1 `Point` describing the start of the line.
    * \param[in] p2 `Point` describing the end of the line.
    */
   void Surface::line(const Point &p1, const Point &p2) {
-    int32_t dx = int32_t(abs(p2.x - p1.x));
-    int32_t dy = -int32_t(abs(p2.y - p1.y));
+    int32_t cx0 = clip.x, cy0 = clip.y, cx1 = clip.x + clip.w - 1, cy1 = clip.y + clip.h - 1;
+
+    int code1 = clip_code(p1.x, p1.y, cx0, cy0, cx1, cy1);
+    int code2 = clip_code(p2.x, p2.y, cx0, cy0, cx1, cy1);
+
+    if (code1 & code2)
+      return;
+
+    int32_t dx = p2.x - p1.x, dy = p2.y - p1.y;
+    int32_t sx = dx < 0 ? -1 : 1, sy = dy < 0 ? -1 : 1;
+
+    bool x_major = abs(dx) >= abs(dy);
+
+    // step k along the major axis moves the minor axis by
+    // floor((2 * k * minor + major) / (2 * major)), the same pixels Bresenham picks
+    int32_t major = x_major ? abs(dx) : abs(dy);
+    int32_t minor = x_major ? abs(dy) : abs(dx);
+
+    if (major == 0) {
+      if (!code1)
+        pbf(&pen, this, offset(p1), 1);
+      return;
+    }
+
+    int32_t k0 = 0, k1 = major;
+
+    if (code1 | code2) {
+      // restrict the steps to those inside the clip rect, the major axis directly
+      // and the minor axis by inverting the offset above
+      int32_t major_start = x_major ? p1.x : p1.y, major_dir = x_major ? sx : sy;
+      int32_t minor_start = x_major ? p1.y : p1.x, minor_dir = x_major ? sy : sx;
+      int32_t major_min = x_major ? cx0 : cy0, major_max = x_major ? cx1 : cy1;
+      int32_t minor_min = x_major ? cy0 : cx0, minor_max = x_major ? cy1 : cx1;
+
+      if (major_dir > 0) {
+        k0 = std::max(k0, major_min - major_start);
+        k1 = std::min(k1, major_max - major_start);
+      } else {
+        k0 = std::max(k0, major_start - major_max);
+        k1 = std::min(k1, major_start - major_min);
+      }
+
+      int32_t o0 = minor_dir > 0 ? minor_min - minor_start : minor_start - minor_max;
+      int32_t o1 = minor_dir > 0 ? minor_max - minor_start : minor_start - minor_min;
+
+      if (minor == 0) {
+        if (o0 > 0 || o1 < 0)
+          return;
+      } else {
+        k0 = std::max(int64_t(k0), ceil_div(int64_t(2 * o0 - 1) * major, 2 * minor));
+        k1 = std::min(int64_t(k1), ceil_div(int64_t(2 * o1 + 1) * major, 2 * minor) - 1);
+      }
+
+      if (k0 > k1)
+        return;
+    }
+
+    int64_t num = int64_t(2 * k0) * minor + major;
+    int32_t o = num / (2 * major);
+    int32_t err = num % (2 * major);
+
+    int32_t run_start = k0;
+
+    for (int32_t k = k0; k <= k1; k++) {
+      // draw the run when the minor axis is about to move
+      bool last = k == k1;
+      err += 2 * minor;
+      bool step = err >= 2 * major;
+
+      if (step || last) {
+        if (x_major) {
+          int32_t x = sx > 0 ? p1.x + run_start : p1.x - k;
+          pbf(&pen, this, offset(x, p1.y + sy * o), k - run_start + 1);
+        } else {
+          for (int32_t j = run_start; j <= k; j++)
+            pbf(&pen, this, offset(p1.x + sx * o, p1.y + sy * j), 1);
+        }
+
+        run_start = k + 1;
+      }
+
+      if (step) {
+        err -= 2 * major;
+        o++;
+      }
+    }
+  }
+
+  /**
+   * Draw an anti-aliased line in the current pen colour.
+   *
+   * Uses Xiaolin Wu's algorithm, each step along the line blends the two
+   * nearest pixels by how close they are to it. Pixel centres are at whole
+   * coordinates, as for `line`.
+   *
+   * \param[in] p1 `Vec2` describing the start of the line.
+   * \param[in] p2 `Vec2` describing the end of the line.
+   */
+  void Surface::aa_line(Vec2 p1, Vec2 p2) {
+    // clip with a margin so the ends of the clipped line don't fade inside the clip rect
+    if (!clip_line(p1, p2, clip.x - 2.0f, clip.y - 2.0f, clip.x + clip.w + 1.0f, clip.y + clip.h + 1.0f))
+      return;
+
+    bool steep = std::abs(p2.y - p1.y) > std::abs(p2.x - p1.x);
+
+    if (steep) {
+      std::swap(p1.x, p1.y);
+      std::swap(p2.x, p2.y);
+    }
+
+    if (p1.x > p2.x)
+      std::swap(p1, p2);
+
+    // clip rect in (major, minor) coordinates
+    int32_t major_min = steep ? clip.y : clip.x, major_max = major_min + (steep ? clip.h : clip.w) - 1;
+    int32_t minor_min = steep ? clip.x : clip.y, minor_max = minor_min + (steep ? clip.w : clip.h) - 1;
+
+    CoverageSpan span(this);
+
+    auto plot = [&](int32_t major, float minor, float weight) {
+      int32_t m = int32_t(std::floor(minor));
+      float f = minor - m;
+
+      if (major < major_min || major > major_max)
+        return;
+
+      if (m >= minor_min && m <= minor_max) {
+        if (steep)
+          span.add(m, major, int((1.0f - f) * weight * 256.0f));
+        else
+          span.add(major, m, int((1.0f - f) * weight * 256.0f));
+      }
+
+      if (m + 1 >= minor_min && m + 1 <= minor_max) {
+        if (steep)
+          span.add(m + 1, major, int(f * weight * 256.0f));
+        else
+          span.add(major, m + 1, int(f * weight * 256.0f));
+      }
+    };
+
+    float dx = p2.x - p1.x;
+    float gradient = dx == 0.0f ? 1.0f : (p2.y - p1.y) / dx;
+
+    int32_t x1 = int32_t(std::floor(p1.x + 0.5f));
+    int32_t x2 = int32_t(std::floor(p2.x + 0.5f));
+
+    if (x1 == x2) {
+      // both ends in the same column
+      plot(x1, (p1.y + p2.y) * 0.5f, dx);
+      return;
+    }
+
+    // ends are weighted by how much of their column the line covers
+    plot(x1, p1.y + gradient * (x1 - p1.x), x1 + 0.5f - p1.x);
+
+    int32_t xs = std::max(x1 + 1, major_min);
+    int32_t xe = std::min(x2 - 1, major_max);
+
+    float y = p1.y + gradient * (xs - p1.x);
+
+    for (int32_t x = xs; x <= xe; x++) {
+      plot(x, y, 1.0f);
+      y += gradient;
+    }
+
+    plot(x2, p2.y + gradient * (x2 - p2.x), p2.x + 0.5f - x2);
+  }
+
+  // row interval of [lo, hi] for a coordinate linear in x (a * x + b)
+  static bool linear_interval(float a, float b, float lo, float hi, float &l, float &r) {
+    if (std::abs(a) < 1e-6f) {
+      if (b < lo || b > hi)
+        return false;
+      return true;
+    }
+
+    float t0 = (lo - b) / a, t1 = (hi - b) / a;
+    if (t0 > t1)
+      std::swap(t0, t1);
+
+    l = std::max(l, t0);
+    r = std::min(r, t1);
+    return l <= r;
+  }
+
+  /**
+   * Draw a line with a width in the current pen colour.
+   *
+   * Rows are drawn as a span of fully covered pixels with, when antialiased,
+   * the partially covered pixels at either end blended by coverage.
+   *
+   * \param[in] p1 `Vec2` describing the start of the line.
+   * \param[in] p2 `Vec2` describing the end of the line.
+   * \param[in] width Width of the line in pixels.
+   * \param[in] cap `LineCap` for the shape of the ends of the line.
+   * \param[in] antialias `true` to blend edge pixels by coverage.
+   */
+  void Surface::thick_line(const Vec2 &p1, const Vec2 &p2, float width, LineCap cap, bool antialias) {
+    float half = width * 0.5f;
+
+    if (half <= 0.0f)
+      return;
+
+    Vec2 d = p2 - p1;
+    float len = d.length();
+
+    if (len < 1e-6f) {
+      if (cap == LineCap::butt)
+        return;
+      d = Vec2(1.0f, 0.0f);
+      len = 0.0f;
+    } else
+      d /= len;
 
-    int32_t sx = (p1.x < p2.x) ? 1 : -1;
-    int32_t sy = (p1.y < p2.y) ? 1 : -1;
+    Vec2 n(-d.y, d.x);
 
-    int32_t err = dx + dy;
+    // extent along the line, square caps extend past the ends
+    float u0 = cap == LineCap::square ? -half : 0.0f;
+    float u1 = cap == LineCap::square ? len + half : len;
+    bool round = cap == LineCap::round;
 
-    Point p(p1);
+    // signed distance from the edge of the line
+    auto distance = [&](float x, float y) {
+      Vec2 p(x - p1.x, y - p1.y);
+      float u = p.dot(d), v = p.dot(n);
 
-    int count = std::max(dx, -dy);
+      if (round) {
+        u = u - std::max(0.0f, std::min(u, len));
+        return std::sqrt(u * u + v * v) - half;
+      }
+
+      float du = std::abs(u - (u0 + u1) * 0.5f) - (u1 - u0) * 0.5f;
+      float dv = std::abs(v) - half;
+      float outside = std::sqrt(std::max(du, 0.0f) * std::max(du, 0.0f) + std::max(dv, 0.0f) * std::max(dv, 0.0f));
+      return outside + std::min(std::max(du, dv), 0.0f);
+    };
+
+    // pixels with centres within [l, r] on row y of the line grown by `grow`
+    auto row_interval = [&](float y, float grow, float &l, float &r) {
+      float cu = (y - p1.y) * d.y - p1.x * d.x;
+      float cv = (y - p1.y) * n.y - p1.x * n.x;
+
+      l = -1e9f;
+      r = 1e9f;
+
+      if (!round)
+        return linear_interval(d.x, cu, u0 - grow, u1 + grow, l, r) && linear_interval(n.x, cv, -half - grow, half + grow, l, r);
+
+      // the body of the line and a circle at each end
+      float radius = half + grow;
+      bool found = linear_interval(d.x, cu, 0.0f, len, l, r) && linear_interval(n.x, cv, -radius, radius, l, r);
+
+      if (!found) {
+        l = 1e9f;
+        r = -1e9f;
+      }
+
+      for (auto &c : {p1, p2}) {
+        float dy = y - c.y, s = radius * radius - dy * dy;
+        if (s >= 0.0f) {
+          s = std::sqrt(s);
+          l = std::min(l, c.x - s);
+          r = std::max(r, c.x + s);
+          found = true;
+        }
+      }
+
+      return found;
+    };
+
+    if (format == PixelFormat::P)
+      antialias = false; // pen alpha is the palette index
+
+    float grow = antialias ? 0.5f : 0.0f;
+    float reach = half + grow + (round ? 0.0f : half);
+
+    int32_t ys = std::max(clip.y, int32_t(std::floor(std::min(p1.y, p2.y) - reach)));
+    int32_t ye = std::min(clip.y + clip.h - 1, int32_t(std::ceil(std::max(p1.y, p2.y) + reach)));
+
+    CoverageSpan span(this);
+
+    for (int32_t y = ys; y <= ye; y++) {
+      float l, r;
+      if (!row_interval(y, grow, l, r))
+        continue;
+
+      int32_t xs = std::max(clip.x, int32_t(std::ceil(l)));
+      int32_t xe = std::min(clip.x + clip.w - 1, int32_t(std::floor(r)));
+
+      if (xs > xe)
+        continue;
+
+      if (!antialias) {
+        pbf(&pen, this, offset(xs, y), xe - xs + 1);
+        continue;
+      }
+
+      // pixels at least half a pixel inside are fully covered
+      int32_t fs = xe + 1, fe = xe;
+      if (row_interval(y, -0.5f, l, r)) {
+        fs = std::max(xs, int32_t(std::ceil(l)));
+        fe = std::min(xe, int32_t(std::floor(r)));
+      }
 
-    while (true) {
-      if (clip.contains(p)) {
-        pbf(&pen, this, offset(p), 1);
+      for (int32_t x = xs; x <= xe; x++) {
+        if (x >= fs && x <= fe) {
+          span.add(x, y, 256, fe - x + 1);
+          x = fe;
+          continue;
+        }
+
+        float c = 0.5f - distance(x, y);
+        span.add(x, y, int(std::min(std::max(c, 0.0f), 1.0f) * 256.0f));
       }
+    }
+  }
+
+  // half width of row y of an ellipse with integer radii, -1 if the row is empty
+  // matches the mid-point algorithm used by `circle` when rx == ry
+  static int32_t ellipse_half_width(int32_t rx, int32_t ry, int32_t y) {
+    // x^2 * ry^2 + y^2 * rx^2 < rx^2 * ry^2 + rx * ry * (rx + ry) / 2
+    int64_t rx2 = int64_t(rx) * rx, ry2 = int64_t(ry) * ry;
+    int64_t limit = 2 * rx2 * ry2 + int64_t(rx) * ry * (rx + ry) - 2 * int64_t(y) * y * rx2;
+
+    if (limit <= 0)
+      return -1;
+
+    int32_t x = int32_t(std::sqrt(double(limit) / double(2 * ry2)));
+
+    while (2 * int64_t(x) * x * ry2 >= limit)
+      x--;
+    while (2 * int64_t(x + 1) * (x + 1) * ry2 < limit)
+      x++;
+
+    return x;
+  }
+
+  // draw a horizontal span clipped to the clip rect, the row is assumed to be inside it
+  static void clipped_span(Surface *dest, int32_t x0, int32_t x1, int32_t y) {
+    x0 = std::max(x0, dest->clip.x);
+    x1 = std::min(x1, dest->clip.x + dest->clip.w - 1);
+
+    if (x1 >= x0)
+      dest->pbf(&dest->pen, dest, dest->offset(x0, y), x1 - x0 + 1);
+  }
+
+  /**
+   * Draw an ellipse in the current pen colour.
+   *
+   * \param[in] c `Point` describing the center of the ellipse.
+   * \param[in] rx Horizontal radius of the ellipse.
+   * \param[in] ry Vertical radius of the ellipse.
+   */
+  void Surface::ellipse(const Point &c, int32_t rx, int32_t ry) {
+    if (rx <= 0 || ry <= 0) {
+      rectangle(Rect(c.x - std::max(rx, 0), c.y - std::max(ry, 0), std::max(rx, 0) * 2 + 1, std::max(ry, 0) * 2 + 1));
+      return;
+    }
+
+    int32_t h = ellipse_half_width(ry, rx, 0);
+    int32_t ys = std::max(clip.y, c.y - h), ye = std::min(clip.y + clip.h - 1, c.y + h);
+
+    for (int32_t y = ys; y <= ye; y++) {
+      int32_t w = ellipse_half_width(rx, ry, y - c.y);
+      if (w >= 0)
+        clipped_span(this, c.x - w, c.x + w, y);
+    }
+  }
 
-      if (count-- == 0) break;
+  /**
+   * Draw the outline of an ellipse in the current pen colour.
+   *
+   * The outline is the edge pixels of `ellipse`, drawn as spans.
+   *
+   * \param[in] c `Point` describing the center of the ellipse.
+   * \param[in] rx Horizontal radius of the ellipse.
+   * \param[in] ry Vertical radius of the ellipse.
+   */
+  void Surface::outline_ellipse(const Point &c, int32_t rx, int32_t ry) {
+    if (rx <= 0 || ry <= 0) {
+      ellipse(c, rx, ry);
+      return;
+    }
+
+    int32_t h = ellipse_half_width(ry, rx, 0);
+    int32_t ys = std::max(clip.y, c.y - h), ye = std::min(clip.y + clip.h - 1, c.y + h);
+
+    if (ys > ye)
+      return;
+
+    int32_t above = ellipse_half_width(rx, ry, ys - 1 - c.y);
+    int32_t w = ellipse_half_width(rx, ry, ys - c.y);
+
+    for (int32_t y = ys; y <= ye; y++) {
+      int32_t below = ellipse_half_width(rx, ry, y + 1 - c.y);
+
+      // pixels not covered by the rows above and below are on the edge
+      int32_t s = std::min(std::min(above, below) + 1, w);
 
-      int32_t e2 = err * 2;
-      if (e2 >= dy) { err += dy; p.x += sx; }
-      if (e2 <= dx) { err += dx; p.y += sy; }
+      if (w >= 0) {
+        if (s <= 0)
+          clipped_span(this, c.x - w, c.x + w, y);
+        else {
+          clipped_span(this, c.x - w, c.x - s, y);
+          clipped_span(this, c.x + s, c.x + w, y);
+        }
+      }
+
+      above = w;
+      w = below;
     }
   }
 
+  /**
+   * Draw the outline of a circle in the current pen colour.
+   *
+   * \param[in] c `Point` describing the center of the circle.
+   * \param[in] r Radius of the circle.
+   */
+  void Surface::outline_circle(const Point &c, int32_t r) {
+    outline_ellipse(c, r, r);
+  }
+
+  /**
+   * Draw an anti-aliased ellipse in the current pen colour.
+   *
+   * Edge pixels are blended by an approximation of their distance from the
+   * edge, which is exact for circles.
+   *
+   * \param[in] c `Vec2` describing the center of the ellipse.
+   * \param[in] radius `Vec2` describing the horizontal and vertical radius.
+   * \param[in] stroke Width of the outline, or 0 to fill the ellipse.
+   */
+  void Surface::aa_ellipse(const Vec2 &c, const Vec2 &radius, float stroke) {
+    // outside and inside (hole) edges of the shape
+    Vec2 outer = radius, inner(0.0f, 0.0f);
+
+    if (stroke > 0.0f) {
+      outer += Vec2(stroke, stroke) * 0.5f;
+      inner = radius - Vec2(stroke, stroke) * 0.5f;
+    }
+
+    if (outer.x <= 0.0f || outer.y <= 0.0f)
+      return;
+
+    bool hole = inner.x > 0.0f && inner.y > 0.0f;
+
+    // approximate signed distance from the edge of an ellipse
+    auto distance = [](float x, float y, const Vec2 &r) {
+      float k0 = std::sqrt((x * x) / (r.x * r.x) + (y * y) / (r.y * r.y));
+      float k1 = std::sqrt((x * x) / (r.x * r.x * r.x * r.x) + (y * y) / (r.y * r.y * r.y * r.y));
+      return k1 > 0.0f ? k0 * (k0 - 1.0f) / k1 : -std::min(r.x, r.y);
+    };
+
+    auto coverage = [](float d) {
+      return std::min(std::max(0.5f - d, 0.0f), 1.0f);
+    };
+
+    // half width of row y of an ellipse grown by `grow`, < 0 if empty
+    auto half_width = [](float y, const Vec2 &r, float grow) {
+      float rx = r.x + grow, ry = r.y + grow;
+      if (rx <= 0.0f || ry <= 0.0f || std::abs(y) > ry)
+        return -1.0f;
+      return rx * std::sqrt(1.0f - (y * y) / (ry * ry));
+    };
+
+    // pixels between the bounds (exact for circles, near enough for ellipses) are evaluated
+    const float edge_out = 1.0f, edge_in = -1.5f;
+
+    int32_t ys = std::max(clip.y, int32_t(std::floor(c.y - outer.y - edge_out)));
+    int32_t ye = std::min(clip.y + clip.h - 1, int32_t(std::ceil(c.y + outer.y + edge_out)));
+
+    int32_t clip_x1 = clip.x + clip.w - 1;
+
+    CoverageSpan span(this);
+
+    for (int32_t y = ys; y <= ye; y++) {
+      float dy = y - c.y;
+
+      float ow = half_width(dy, outer, edge_out);
+      if (ow < 0.0f)
+        continue;
+
+      int32_t xs = std::max(clip.x, int32_t(std::ceil(c.x - ow)));
+      int32_t xe = std::min(clip_x1, int32_t(std::floor(c.x + ow)));
+
+      // fully covered pixels
+      float fw = half_width(dy, outer, edge_in);
+      int32_t fs = fw < 0.0f ? xe + 1 : int32_t(std::ceil(c.x - fw));
+      int32_t fe = fw < 0.0f ? xe : std::min(xe, int32_t(std::floor(c.x + fw)));
+
+      // pixels that may be partly in the hole, and those entirely in it
+      int32_t hs = xe + 1, he = xe, es = xe + 1, ee = xe;
+
+      if (hole) {
+        float hw = half_width(dy, inner, edge_out);
+        if (hw >= 0.0f) {
+          hs = int32_t(std::ceil(c.x - hw));
+          he = int32_t(std::floor(c.x + hw));
+        }
+
+        float ew = half_width(dy, inner, edge_in);
+        if (ew >= 0.0f) {
+          es = int32_t(std::ceil(c.x - ew));
+          ee = int32_t(std::floor(c.x + ew));
+        }
+      }
+
+      for (int32_t x = xs; x <= xe; x++) {
+        if (x >= es && x <= ee) {
+          x = ee;
+          continue;
+        }
+
+        if (x >= fs && x <= fe && (x < hs || x > he)) {
+          // rest of the fully covered run
+          int32_t end = std::min(fe, x < hs ? hs - 1 : xe);
+          span.add(x, y, 256, end - x + 1);
+          x = end;
+          continue;
+        }
+
+        float dx = x - c.x;
+        float cover = coverage(distance(dx, dy, outer));
+
+        if (hole)
+          cover = std::min(cover, 1.0f - coverage(distance(dx, dy, inner)));
+
+        span.add(x, y, int(cover * 256.0f));
+      }
+    }
+  }
+
+  /**
+   * Draw an anti-aliased circle in the current pen colour.
+   *
+   * \param[in] c `Vec2` describing the center of the circle.
+   * \param[in] r Radius of the circle.
+   * \param[in] stroke Width of the outline, or 0 to fill the circle.
+   */
+  void Surface::aa_circle(const Vec2 &c, float r, float stroke) {
+    aa_ellipse(c, Vec2(r, r), stroke);
+  }
+
   /**
    * TODO: Document this function
    *
@@ -208,7 +834,8 @@ namespace blit {
     bounds = mclip.intersection(bounds);
 
     // if triangle completely out of bounds then don't bother!
-    if (bounds.empty()) {
+    // (bounds are inclusive, so a zero width/height is still a row/column of pixels)
+    if (bounds.w < 0 || bounds.h < 0) {
       return;
     }
 
@@ -259,151 +886,543 @@ namespace blit {
     }
   }
 
-  /**
-   * Draw a polygon from a std::vector<point> list of points.
-   *
-   * \param[in] points `std::vector<point>` of points describing the polygon.
-   */
-  void Surface::polygon(std::vector<Point> points) {
-    int32_t nodes[64]; // maximum allowed number of nodes per scanline for polygon rendering
+  // edge of a polygon being rasterised, y range and x are 16.16 fixed point
+  // x is stepped exactly (as floor(x) plus a remainder in units of 1 / dy)
+  struct PolygonEdge {
+    int32_t y0, y1;         // (y0, y1] covered by the edge
+    int32_t x0, dx, dy;     // integer start and deltas
+    int32_t x, err;         // x at the current sample row
+    int32_t step, step_err; // x step per sample row
+    int8_t dir;             // +1 downwards, -1 upwards (for non-zero winding)
+  };
+
+  // polygons up to this size keep the edge table on the stack
+  static const uint32_t polygon_stack_points = 32;
 
+  // antialiased coverage is accumulated for a strip this wide at a time
+  static const int32_t polygon_coverage_width = 128;
+
+  static void fill_polygon(Surface *dest, const Point *points, uint32_t count, FillRule rule, bool antialias, PolygonEdge *edges, PolygonEdge **active) {
+    auto &clip = dest->clip;
+
+    int32_t minx = points[0].x, maxx = points[0].x;
     int32_t miny = points[0].y, maxy = points[0].y;
 
-    for (uint16_t i = 1; i < points.size(); i++) {
+    for (uint32_t i = 1; i < count; i++) {
+      minx = std::min(minx, points[i].x);
+      maxx = std::max(maxx, points[i].x);
       miny = std::min(miny, points[i].y);
       maxy = std::max(maxy, points[i].y);
     }
 
-    // for each scanline within the polygon bounds (clipped to clip rect)
-    Point p;
+    // rows are (miny, maxy], antialiased rows cover [y - 0.5, y + 0.5) so
+    // can touch one more at each end
+    int32_t start_y = std::max(clip.y, miny + (antialias ? 0 : 1));
+    int32_t end_y = std::min(clip.y + clip.h, maxy + 1);
 
-    for (p.y = std::max(clip.y, miny); p.y <= std::min(clip.y + clip.h, maxy); p.y++) {
-      uint8_t n = 0;
-      for (uint16_t i = 0; i < points.size(); i++) {
-        uint16_t j = (i + 1) % points.size();
-        int32_t sy = points[i].y;
-        int32_t ey = points[j].y;
-        int32_t fy = p.y;
-        if ((sy < fy && ey >= fy) || (ey < fy && sy >= fy)) {
-          int32_t sx = points[i].x;
-          int32_t ex = points[j].x;
-          int32_t px = int32_t(sx + float(fy - sy) / float(ey - sy) * float(ex - sx));
-
-          nodes[n++] = px < clip.x ? clip.x : (px >= clip.x + clip.w ? clip.x + clip.w - 1 : px);// clamp(int32_t(sx + float(fy - sy) / float(ey - sy) * float(ex - sx)), clip.x, clip.x + clip.w);
-        }
-      }
+    if (start_y >= end_y)
+      return;
+
+    // sample rows per pixel row
+    const int samples = antialias ? 4 : 1;
+    const int coverage_per_sample = 256 / samples;
+
+    uint32_t num_edges = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+      Point a = points[i], b = points[i + 1 == count ? 0 : i + 1];
+
+      if (a.y == b.y)
+        continue; // horizontal edges don't cross any rows
+
+      auto &e = edges[num_edges++];
+      e.dir = a.y < b.y ? 1 : -1;
+
+      if (a.y > b.y)
+        std::swap(a, b);
+
+      // multiply rather than shift, points may be off the top of the surface
+      e.y0 = a.y * 0x10000;
+      e.y1 = b.y * 0x10000;
+      e.x0 = a.x;
+      e.dx = b.x - a.x;
+      e.dy = b.y - a.y;
+
+      int64_t step = int64_t(e.dx) * (0x10000 / samples);
+      e.step = floor_div(step, e.dy);
+      e.step_err = step - int64_t(e.step) * e.dy;
+    }
+
+    std::sort(edges, edges + num_edges, [](const PolygonEdge &a, const PolygonEdge &b) {
+      return a.y0 < b.y0;
+    });
+
+    // without antialiasing spans are drawn directly, so one pass covers the whole width
+    // otherwise coverage is accumulated a strip of columns at a time
+    int32_t pass_x = clip.x, pass_end = clip.x + clip.w;
+    int32_t pass_w = clip.w;
+
+    uint16_t coverage[polygon_coverage_width];
+
+    if (antialias) {
+      // only the columns the polygon can touch
+      pass_x = std::max(pass_x, minx - 1);
+      pass_end = std::min(pass_end, maxx + 1);
+      pass_w = polygon_coverage_width;
+
+      memset(coverage, 0, sizeof(coverage));
+    }
+
+    for (; pass_x < pass_end; pass_x += pass_w) {
+      int32_t strip_w = std::min(pass_w, pass_end - pass_x);
+      int32_t cover_min = strip_w, cover_max = -1;
+
+      uint32_t next_edge = 0, num_active = 0;
+
+      for (int32_t y = start_y; y < end_y; y++) {
+        for (int s = 0; s < samples; s++) {
+          // sample at the pixel row, or spread over it when antialiasing
+          int32_t sy = y * 0x10000;
+          if (antialias)
+            sy += ((2 * s + 1) << 16) / (2 * samples) - 0x8000;
+
+          // drop finished edges
+          uint32_t j = 0;
+          for (uint32_t i = 0; i < num_active; i++) {
+            if (active[i]->y1 >= sy)
+              active[j++] = active[i];
+          }
+          num_active = j;
+
+          // add edges starting above this row
+          while (next_edge < num_edges && edges[next_edge].y0 < sy) {
+            auto e = &edges[next_edge++];
+
+            if (e->y1 >= sy) {
+              int64_t x = int64_t(sy - e->y0) * e->dx;
+              e->x = floor_div(x, e->dy);
+              e->err = x - int64_t(e->x) * e->dy;
+              e->x += e->x0 * 0x10000;
+              active[num_active++] = e;
+            }
+          }
+
+          // keep the active edges sorted by x, the order rarely changes between rows
+          for (uint32_t i = 1; i < num_active; i++) {
+            auto e = active[i];
+            j = i;
+            while (j > 0 && active[j - 1]->x > e->x) {
+              active[j] = active[j - 1];
+              j--;
+            }
+            active[j] = e;
+          }
+
+          // fill between the edges where the winding says we're inside
+          int winding = 0;
+          int32_t span_start = 0;
+
+          for (uint32_t i = 0; i < num_active; i++) {
+            auto e = active[i];
+
+            bool was_inside = rule == FillRule::even_odd ? (winding & 1) : winding != 0;
+            winding += rule == FillRule::even_odd ? 1 : e->dir;
+            bool is_inside = rule == FillRule::even_odd ? (winding & 1) : winding != 0;
 
-      uint16_t i = 0;
-      while (i < n - 1) {
-        if (nodes[i] > nodes[i + 1]) {
-          int32_t s = nodes[i]; nodes[i] = nodes[i + 1]; nodes[i + 1] = s;
-          if (i) i--;
+            if (!was_inside && is_inside) {
+              span_start = e->x;
+              continue;
+            }
+
+            if (!was_inside || is_inside)
+              continue;
+
+            if (!antialias) {
+              int32_t xs = std::max((span_start >> 16) + 1, clip.x);
+              int32_t xe = std::min((e->x >> 16) + 1, clip.x + clip.w);
+
+              if (xe > xs)
+                dest->pbf(&dest->pen, dest, dest->offset(xs, y), xe - xs);
+              continue;
+            }
+
+            // pixel x covers [x - 0.5, x + 0.5), shift so it's [x, x + 1) relative to the strip
+            int32_t l = std::max(span_start + 0x8000 - pass_x * 0x10000, 0);
+            int32_t r = std::min(e->x + 0x8000 - pass_x * 0x10000, strip_w << 16);
+
+            if (r <= l)
+              continue;
+
+            int32_t pl = l >> 16, pr = (r - 1) >> 16;
+
+            if (pl == pr)
+              coverage[pl] += ((r - l) * coverage_per_sample) >> 16;
+            else {
+              coverage[pl] += ((((pl + 1) << 16) - l) * coverage_per_sample) >> 16;
+              for (int32_t px = pl + 1; px < pr; px++)
+                coverage[px] += coverage_per_sample;
+              coverage[pr] += ((r - (pr << 16)) * coverage_per_sample) >> 16;
+            }
+
+            cover_min = std::min(cover_min, pl);
+            cover_max = std::max(cover_max, pr);
+          }
+
+          for (uint32_t i = 0; i < num_active; i++) {
+            auto e = active[i];
+            e->x += e->step;
+            e->err += e->step_err;
+            if (e->err >= e->dy) {
+              e->x++;
+              e->err -= e->dy;
+            }
+          }
         }
-        else {
-          i++;
+
+        if (!antialias || cover_max < cover_min)
+          continue;
+
+        // draw the row, a span at a time for runs of equal coverage
+        Pen cover_pen = dest->pen;
+        int32_t px = cover_min;
+
+        while (px <= cover_max) {
+          uint16_t c = coverage[px];
+          int32_t run = 1;
+
+          while (px + run <= cover_max && coverage[px + run] == c)
+            run++;
+
+          if (c) {
+            cover_pen.a = (dest->pen.a * std::min(c, uint16_t(256))) >> 8;
+            dest->pbf(&cover_pen, dest, dest->offset(pass_x + px, y), run);
+          }
+
+          memset(coverage + px, 0, run * sizeof(uint16_t));
+          px += run;
         }
-      }
 
-      for (i = 0; i < n; i += 2) {
-        h_span(Point(nodes[i], p.y), nodes[i + 1] - nodes[i] + 1);
+        cover_min = strip_w;
+        cover_max = -1;
       }
     }
   }
-}
 
-  /*
-  void texture_triangle(int32_t x1, int32_t y1, int32_t u1, int32_t v1, int32_t x2, int32_t y2, int32_t u2, int32_t v2, int32_t x3, int32_t y3, int32_t u3, int32_t v3) {
-    int32_t minx = min<int32_t>(x1, min<int32_t>(x2, x3));
-    int32_t maxx = max<int32_t>(x1, max<int32_t>(x2, x3));
-    int32_t miny = min<int32_t>(y1, min<int32_t>(y2, y3));
-    int32_t maxy = max<int32_t>(y1, max<int32_t>(y2, y3));
+  /**
+   * Draw a polygon from a std::vector<point> list of points.
+   *
+   * \param[in] points `std::vector<point>` of points describing the polygon.
+   */
+  void Surface::polygon(const std::vector<Point> &points) {
+    polygon(points.data(), points.size());
+  }
 
-    // if triangle completely out of bounds then don't bother!
-    if (maxx < clip.l || minx >= clip.r || maxy < clip.t || miny >= clip.b) {
+  /**
+   * Draw a polygon from a list of points.
+   *
+   * Edges are stepped in fixed point using an active edge table so shapes may
+   * be concave or self-intersecting. Pixels on an edge are filled using the
+   * same rule as `triangle` so polygons sharing an edge don't overdraw it.
+   *
+   * Polygons of up to 32 points keep the edge table on the stack, larger ones
+   * allocate it. Pass a scratch buffer (see `polygon_scratch_size`) to avoid
+   * the allocation.
+   *
+   * \param[in] points Pointer to the points describing the polygon.
+   * \param[in] count Number of points.
+   * \param[in] rule `FillRule` deciding which areas of a self-intersecting polygon are filled.
+   * \param[in] antialias `true` to blend edge pixels by coverage (ignored for paletted surfaces).
+   */
+  void Surface::polygon(const Point *points, uint32_t count, FillRule rule, bool antialias) {
+    if (count < 3)
+      return;
+
+    if (count > polygon_stack_points) {
+      auto scratch_size = polygon_scratch_size(count);
+      std::unique_ptr<uint8_t[]> scratch(new uint8_t[scratch_size]);
+      polygon(points, count, rule, antialias, scratch.get(), scratch_size);
       return;
     }
 
-    // clip extremes to frame buffer size
-    minx = max<int32_t>(minx, clip.l);
-    maxx = min<int32_t>(maxx, clip.r - 1);
-    miny = max<int32_t>(miny, clip.t);
-    maxy = min<int32_t>(maxy, clip.b - 1);
+    PolygonEdge edges[polygon_stack_points];
+    PolygonEdge *active[polygon_stack_points];
 
-    // bias ensures no overdraw between neighbouring triangles
-    int8_t bias0 = is_top_left(x2, y2, x3, y3) ? 0 : -1;
-    int8_t bias1 = is_top_left(x3, y3, x1, y1) ? 0 : -1;
-    int8_t bias2 = is_top_left(x1, y1, x2, y2) ? 0 : -1;
-
-    int32_t a01 = y1 - y2;
-    int32_t b01 = x2 - x1;
-    int32_t a12 = y2 - y3;
-    int32_t b12 = x3 - x2;
-    int32_t a20 = y3 - y1;
-    int32_t b20 = x1 - x3;
-
-    int32_t w0row = orient2d(x2, y2, x3, y3, minx, miny) + bias0;
-    int32_t w1row = orient2d(x3, y3, x1, y1, minx, miny) + bias1;
-    int32_t w2row = orient2d(x1, y1, x2, y2, minx, miny) + bias2;
-
-    for (int32_t y = miny; y <= maxy; y++) {
-      int32_t w0 = w0row;
-      int32_t w1 = w1row;
-      int32_t w2 = w2row;
+    fill_polygon(this, points, count, rule, antialias && format != PixelFormat::P, edges, active);
+  }
 
-      for (int32_t x = minx; x <= maxx; x++) {
-        if ((w0 | w1 | w2) >= 0) {
-          float d = float((y2 - y3) * (x1 - x3) + (x3 - x2) * (y1 - y3));
-          float v1w = float((y2 - y3) * (x - x3) + (x3 - x2) * (y - y3)) / d;
-          float v2w = float((y3 - y1) * (x - x3) + (x1 - x3) * (y - y3)) / d;
-          float v3w = 1.0f - v1w - v2w;
+  /**
+   * Draw a polygon from a list of points, using caller provided memory for the edge table.
+   *
+   * \param[in] points Pointer to the points describing the polygon.
+   * \param[in] count Number of points.
+   * \param[in] rule `FillRule` deciding which areas of a self-intersecting polygon are filled.
+   * \param[in] antialias `true` to blend edge pixels by coverage (ignored for paletted surfaces).
+   * \param[in] scratch Buffer of at least `polygon_scratch_size(count)` bytes.
+   * \param[in] scratch_size Size of `scratch` in bytes.
+   */
+  void Surface::polygon(const Point *points, uint32_t count, FillRule rule, bool antialias, void *scratch, uint32_t scratch_size) {
+    if (count <= polygon_stack_points) {
+      polygon(points, count, rule, antialias);
+      return;
+    }
 
-          int32_t tu = (v1w * float(u1) + v2w * float(u2) + v3w * float(u3));
-          int32_t tv = (v1w * float(v1) + v2w * float(v2) + v3w * float(v3));
-          tu %= 128;
-          tv %= 128;
+    size_t space = scratch_size;
 
-          rgba *t = &sprites[tu + (tv * 128)];
+    auto edges = (PolygonEdge *)std::align(alignof(PolygonEdge), count * sizeof(PolygonEdge), scratch, space);
+    if (!edges)
+      return;
 
-          blend_func((uint8_t *)t, (uint8_t *)target, x + (y * 160));
-        }
+    void *active_ptr = edges + count;
+    space -= count * sizeof(PolygonEdge);
 
-        w0 += a12;
-        w1 += a20;
-        w2 += a01;
-      }
+    auto active = (PolygonEdge **)std::align(alignof(PolygonEdge *), count * sizeof(PolygonEdge *), active_ptr, space);
+    if (!active)
+      return;
 
-      w0row += b12;
-      w1row += b20;
-      w2row += b01;
-    }
+    fill_polygon(this, points, count, rule, antialias && format != PixelFormat::P, edges, active);
   }
 
-  //
- // Draw a circle.
-  //
-  // Implemented with the mid-point circle algorithm.
- //
-  // \param[in] {point} c Center `point` of the circle.
- // \param[in] {int32_t} r Radius of the circle in pixels.
- //
-  void outline_circle(const point &c, int32_t r) {
-    // if circle completely out of bounds then don't bother!
-    if (!clip.intersects(rect(c.x - r, c.y - r, r * 2, r * 2))) {
+  /**
+   * Get the size of the scratch buffer needed to draw a polygon.
+   *
+   * \param[in] count Number of points in the polygon.
+   * \return Size in bytes, including padding for alignment.
+   */
+  uint32_t Surface::polygon_scratch_size(uint32_t count) {
+    return count * (sizeof(PolygonEdge) + sizeof(PolygonEdge *)) + alignof(PolygonEdge) + alignof(PolygonEdge *);
+  }
+
+  // pixels between perspective corrections in texture_triangle
+  static const int32_t perspective_span = 16;
+
+  /**
+   * Draw a triangle textured from another surface.
+   *
+   * Positions are snapped to 1/16th of a pixel and pixels are sampled at
+   * their centres, so a triangle with a corner at (0, 0) and uv (0, 0) maps
+   * pixel (0, 0) to the centre of texel (0, 0). Samples exactly on an edge
+   * are filled using the same rule as `triangle`.
+   *
+   * With `perspective` set u/w, v/w and 1/w are interpolated and the texture
+   * coordinates corrected every 16 pixels, the vertices must then have w > 0
+   * (i.e. be clipped to the near plane).
+   *
+   * If a `DepthBuffer` is attached each pixel is tested against and updates
+   * it using the vertices' z. A half resolution buffer tests 2x2 pixels
+   * together using the depth at their centre, and lets through a pixel at
+   * the same depth as the one already stored.
+   *
+   * \param[in] src Surface to read from, or `nullptr` to fill with the current pen.
+   * \param[in] v1 First `TexturedVertex` of triangle.
+   * \param[in] v2 Second `TexturedVertex` of triangle.
+   * \param[in] v3 Third `TexturedVertex` of triangle.
+   * \param[in] perspective `true` for perspective-correct texturing.
+   */
+  void Surface::texture_triangle(Surface *src, TexturedVertex v1, TexturedVertex v2, TexturedVertex v3, bool perspective) {
+    if (perspective && (v1.w <= 0.0f || v2.w <= 0.0f || v3.w <= 0.0f))
       return;
+
+    // 28.4 fixed point positions
+    auto to_fixed = [](float f) { return int32_t(floorf(f * 16.0f + 0.5f)); };
+
+    Point p1(to_fixed(v1.pos.x), to_fixed(v1.pos.y));
+    Point p2(to_fixed(v2.pos.x), to_fixed(v2.pos.y));
+    Point p3(to_fixed(v3.pos.x), to_fixed(v3.pos.y));
+
+    int64_t area = int64_t(p2.x - p1.x) * (p3.y - p1.y) - int64_t(p2.y - p1.y) * (p3.x - p1.x);
+
+    if (area == 0)
+      return;
+
+    // fix "winding" of vertices if needed
+    if (area < 0) {
+      std::swap(p1, p3);
+      std::swap(v1, v3);
+      area = -area;
     }
 
-    int x = r - 1, y = 0, dx = 1, dy = 1, err = dx - (r << 1);
-    while (x >= y)
-    {
-      pixel(point(c.x + x, c.y + y)); pixel(point(c.x + y, c.y + x));
-      pixel(point(c.x - y, c.y + x)); pixel(point(c.x - x, c.y + y));
-      pixel(point(c.x - x, c.y - y)); pixel(point(c.x - y, c.y - x));
-      pixel(point(c.x + y, c.y - x)); pixel(point(c.x + x, c.y - y));
+    // pixel bounds, samples are at pixel centres
+    Rect mclip = clip; mclip.w--; mclip.h--;
+    Rect bounds(
+      Point(int32_t(floor_div(std::min(p1.x, std::min(p2.x, p3.x)) + 7, 16)), int32_t(floor_div(std::min(p1.y, std::min(p2.y, p3.y)) + 7, 16))),
+      Point(int32_t(floor_div(std::max(p1.x, std::max(p2.x, p3.x)) - 8, 16)), int32_t(floor_div(std::max(p1.y, std::max(p2.y, p3.y)) - 8, 16))));
+    bounds = mclip.intersection(bounds);
+
+    // if triangle completely out of bounds then don't bother!
+    if (bounds.w < 0 || bounds.h < 0)
+      return;
 
-      if (err <= 0) { y++; err += dy; dy += 2; }
-      if (err > 0) { x--; dx += 2; err += dx - (r << 1); }
+    // edge functions as w = a * x + b * y + c for pixel x/y, with the bias
+    // from is_top_left so neighbouring triangles don't overdraw
+    struct {
+      int64_t a, b, c;
+    } edges[3];
+
+    const Point *verts[]{&p1, &p2, &p3};
+
+    for (int i = 0; i < 3; i++) {
+      auto &e0 = *verts[(i + 1) % 3], &e1 = *verts[(i + 2) % 3];
+
+      edges[i].a = -int64_t(e1.y - e0.y) * 16;
+      edges[i].b = int64_t(e1.x - e0.x) * 16;
+      edges[i].c = -int64_t(e1.x - e0.x) * e0.y + int64_t(e1.y - e0.y) * e0.x + (is_top_left(e0, e1) ? 0 : -1);
+      edges[i].c += (edges[i].a + edges[i].b) / 2; // offset to the pixel centre
+    }
+
+    // attribute gradients from the snapped positions
+    float x1 = p1.x / 16.0f, y1 = p1.y / 16.0f;
+    float dx2 = p2.x / 16.0f - x1, dy2 = p2.y / 16.0f - y1;
+    float dx3 = p3.x / 16.0f - x1, dy3 = p3.y / 16.0f - y1;
+    float inv_area = 256.0f / area;
+
+    struct Gradient {
+      float v = 0.0f, dx = 0.0f, dy = 0.0f;
+      float at(float x, float y) const { return v + dx * x + dy * y; }
+    };
+
+    auto gradient = [&](float a1, float a2, float a3) {
+      return Gradient{
+        a1,
+        ((a2 - a1) * dy3 - (a3 - a1) * dy2) * inv_area,
+        ((a3 - a1) * dx2 - (a2 - a1) * dx3) * inv_area
+      };
+    };
+
+    Gradient u, v, q, z;
+
+    if (perspective) {
+      float q1 = 1.0f / v1.w, q2 = 1.0f / v2.w, q3 = 1.0f / v3.w;
+      u = gradient(v1.uv.x * q1, v2.uv.x * q2, v3.uv.x * q3);
+      v = gradient(v1.uv.y * q1, v2.uv.y * q2, v3.uv.y * q3);
+      q = gradient(q1, q2, q3);
+    } else {
+      u = gradient(v1.uv.x, v2.uv.x, v3.uv.x);
+      v = gradient(v1.uv.y, v2.uv.y, v3.uv.y);
+    }
+
+    // depth in 24.8 fixed point, z is affine in screen space so needs no correction
+    if (depth) {
+      auto to_depth = [](float f) { return std::min(std::max(f, 0.0f), 1.0f) * 65535.0f * 256.0f; };
+      z = gradient(to_depth(v1.z), to_depth(v2.z), to_depth(v3.z));
+    }
+
+    Rect src_r = src ? Rect(0, 0, src->bounds.w, src->bounds.h) : Rect();
+
+    // texture coordinates to 16.16, clamped inside the source
+    auto to_uv = [](float f, int32_t size) {
+      int32_t i = int32_t(std::min(std::max(f, 0.0f), float(size)) * 65536.0f);
+      return std::min(i, (size << 16) - 1);
+    };
+
+    // draws a span with u/v stepped linearly between the first and last pixel
+    auto segment = [&](int32_t x, int32_t y, int32_t cnt, float su, float sv, float eu, float ev) {
+      int32_t iu = to_uv(su, src_r.w), iv = to_uv(sv, src_r.h);
+      int32_t du = 0, dv = 0;
+
+      if (cnt > 1) {
+        du = (to_uv(eu, src_r.w) - iu) / (cnt - 1);
+        dv = (to_uv(ev, src_r.h) - iv) / (cnt - 1);
+      }
+
+      abf(src, src_r, this, offset(x, y), cnt, iu, iv, du, dv, false);
+    };
+
+    // draws cnt pixels of a row starting at x
+    auto run = [&](int32_t x, int32_t y, int32_t cnt) {
+      if (!src) {
+        pbf(&pen, this, offset(x, y), cnt);
+        return;
+      }
+
+      float fx = x + 0.5f - x1, fy = y + 0.5f - y1;
+
+      if (!perspective) {
+        float ex = fx + cnt - 1;
+        segment(x, y, cnt, u.at(fx, fy), v.at(fx, fy), u.at(ex, fy), v.at(ex, fy));
+        return;
+      }
+
+      // perspective correct at the ends of each short span, affine between
+      float sq = 1.0f / q.at(fx, fy);
+      float su = u.at(fx, fy) * sq, sv = v.at(fx, fy) * sq;
+
+      for (int32_t i = 0; i < cnt; i += perspective_span) {
+        int32_t seg_cnt = std::min(perspective_span, cnt - i);
+        float ex = fx + i + seg_cnt - 1;
+
+        float eq = 1.0f / q.at(ex, fy);
+        float eu = u.at(ex, fy) * eq, ev = v.at(ex, fy) * eq;
+
+        segment(x + i, y, seg_cnt, su, sv, eu, ev);
+
+        // start of the next span
+        float nx = ex + 1.0f;
+        sq = 1.0f / q.at(nx, fy);
+        su = u.at(nx, fy) * sq;
+        sv = v.at(nx, fy) * sq;
+      }
+    };
+
+    for (int32_t y = bounds.y; y <= bounds.y + bounds.h; y++) {
+      // find the span where all the edge functions are >= 0
+      int32_t xs = bounds.x, xe = bounds.x + bounds.w;
+
+      for (auto &e : edges) {
+        int64_t r = e.b * y + e.c;
+
+        if (e.a > 0)
+          xs = std::max(xs, int32_t(floor_div(-r + e.a - 1, e.a)));
+        else if (e.a < 0)
+          xe = std::min(xe, int32_t(floor_div(r, -e.a)));
+        else if (r < 0)
+          xe = xs - 1;
+      }
+
+      if (xs > xe)
+        continue;
+
+      if (!depth) {
+        run(xs, y, xe - xs + 1);
+        continue;
+      }
+
+      // depth test each pixel, drawing the runs that pass
+      int32_t iz = z.at(xs + 0.5f - x1, y + 0.5f - y1);
+      int32_t dz = z.dx;
+      int32_t run_start = -1;
+
+      // at half resolution 2x2 pixels share a depth value, they all use the depth at the centre
+      // of the cell and pass with <= so the first one to write it doesn't reject the others
+      bool half_res = depth->shift != 0;
+      float cell_y = float(y | 1) - y1;
+      uint16_t pz = 0;
+
+      for (int32_t x = xs; x <= xe; x++, iz += dz) {
+        uint16_t *d = depth->ptr(x, y);
+        bool pass;
+
+        if (half_res) {
+          if (x == xs || !(x & 1))
+            pz = std::min(std::max(int32_t(z.at(float(x | 1) - x1, cell_y)) >> 8, 0), 0xFFFF);
+          pass = pz <= *d;
+        } else {
+          pz = std::min(std::max(iz >> 8, 0), 0xFFFF);
+          pass = pz < *d;
+        }
+
+        if (pass) {
+          *d = pz;
+          if (run_start < 0)
+            run_start = x;
+        } else if (run_start >= 0) {
+          run(run_start, y, x - run_start);
+          run_start = -1;
+        }
+      }
+
+      if (run_start >= 0)
+        run(run_start, y, xe + 1 - run_start);
     }
   }
 }
 
-*/
@@ -1,6 +1,7 @@
 /*! \file surface.cpp
 */
 #include <algorithm>
+#include <cmath>
 #include <cstring>
 #include <string>
 
@@ -61,31 +62,43 @@ namespace blit {
       pbf = RGBA_RGBA;
       bbf = RGBA_RGBA;
       pgf = get_pen_rgba;
+      sbf = stretch_generic;
+      abf = affine_generic;
     }break;
     case PixelFormat::RGB: {
       pbf = RGBA_RGB;
       bbf = RGBA_RGB;
       pgf = get_pen_rgb;
+      sbf = RGBA_RGB;
+      abf = RGBA_RGB;
     }break;
     case PixelFormat::P: {
       pbf = P_P;
       bbf = P_P;
       pgf = get_pen_p;
+      sbf = P_P;
+      abf = P_P;
     }break;
     case PixelFormat::M: {
       pbf = M_M;
       bbf = M_M;
       pgf = get_pen_m;
+      sbf = stretch_generic;
+      abf = affine_generic;
     }break;
     case PixelFormat::RGB565: {
       pbf = RGBA_RGB565;
       bbf = RGBA_RGB565;
       pgf = get_pen_rgb565;
+      sbf = RGBA_RGB565;
+      abf = RGBA_RGB565;
     }break;
     default: {
       pbf = nullptr;
       bbf = nullptr;
       pgf = nullptr;
+      sbf = nullptr;
+      abf = nullptr;
     }break;
     }
   }
@@ -253,12 +266,75 @@ namespace blit {
     return true;
   }
 
+  // convert a row of the surface to RGBA
+  static const Pen *mipmap_source_row(Surface *src, int32_t y, Pen *row) {
+    if (src->format == PixelFormat::RGBA)
+      return (const Pen *)src->ptr(0, y);
+
+    const uint8_t *s = src->ptr(0, y);
+
+    switch (src->format) {
+      case PixelFormat::RGB:
+        for (int32_t x = 0; x < src->bounds.w; x++, s += 3)
+          row[x] = Pen(s[0], s[1], s[2]);
+        break;
+
+      case PixelFormat::P:
+        for (int32_t x = 0; x < src->bounds.w; x++)
+          row[x] = src->palette[*s++];
+        break;
+
+      default:
+        for (int32_t x = 0; x < src->bounds.w; x++)
+          row[x] = src->pgf(src, src->offset(x, y));
+    }
+
+    return row;
+  }
+
+  // average 2x2 blocks of two rows into one, colour is weighted by alpha so
+  // transparent pixels don't darken the edges
+  static void mipmap_downsample_row(const Pen *__restrict row0, const Pen *__restrict row1, Pen *__restrict out, int32_t w, bool gamma) {
+    for (int32_t x = 0; x < w; x++) {
+      const Pen &c1 = row0[x * 2], &c2 = row0[x * 2 + 1], &c3 = row1[x * 2], &c4 = row1[x * 2 + 1];
+
+      uint32_t a = c1.a + c2.a + c3.a + c4.a;
+      uint32_t w1 = c1.a, w2 = c2.a, w3 = c3.a, w4 = c4.a;
+
+      if (a == 0) {
+        // fully transparent, keep the plain average
+        w1 = w2 = w3 = w4 = 1;
+        a = 4;
+      }
+
+      uint32_t r, g, b;
+
+      if (gamma) {
+        // average in (approximately) linear light, assuming a gamma of 2
+        r = uint32_t(std::sqrt(float(c1.r * c1.r * w1 + c2.r * c2.r * w2 + c3.r * c3.r * w3 + c4.r * c4.r * w4) / float(a)));
+        g = uint32_t(std::sqrt(float(c1.g * c1.g * w1 + c2.g * c2.g * w2 + c3.g * c3.g * w3 + c4.g * c4.g * w4) / float(a)));
+        b = uint32_t(std::sqrt(float(c1.b * c1.b * w1 + c2.b * c2.b * w2 + c3.b * c3.b * w3 + c4.b * c4.b * w4) / float(a)));
+      } else {
+        r = (c1.r * w1 + c2.r * w2 + c3.r * w3 + c4.r * w4 + a / 2) / a;
+        g = (c1.g * w1 + c2.g * w2 + c3.g * w3 + c4.g * w4 + a / 2) / a;
+        b = (c1.b * w1 + c2.b * w2 + c3.b * w3 + c4.b * w4 + a / 2) / a;
+      }
+
+      out[x] = Pen(r, g, b, (c1.a + c2.a + c3.a + c4.a + 2) / 4);
+    }
+  }
+
   /**
    * Generate mipmaps for surface
    *
-   * \param depth `uint8_t`
+   * Each level halves the size of the previous one by averaging 2x2 blocks.
+   * Levels are RGBA whatever the format of the surface and are stored after
+   * the surface's pixel data, which must have room for them.
+   *
+   * \param depth Number of levels to generate.
+   * \param gamma `true` to average in linear light, which keeps bright details from dimming.
    */
-  void Surface::generate_mipmaps(uint8_t depth) {
+  void Surface::generate_mipmaps(uint8_t depth, bool gamma) {
     uint16_t w = bounds.w;
     uint16_t h = bounds.h;
 
@@ -270,43 +346,27 @@ namespace blit {
     // offset the data pointer to the end
     uint8_t *mipmap_data = data + (row_stride * bounds.h);
 
-    do {
+    // rows of the first level converted to RGBA
+    Pen *rows = format == PixelFormat::RGBA ? nullptr : new Pen[bounds.w * 2];
+
+    while (depth-- && w > 1 && h > 1) {
       w /= 2;
       h /= 2;
       Surface *dest = new Surface(mipmap_data, PixelFormat::RGBA, Size(w, h));
       mipmaps.push_back(dest);
 
       for (int y = 0; y < h; y++) {
-        for (int x = 0; x < w; x++) {
-          // sample the average ARGB values
-          Pen *c1, *c2, *c3, *c4;
-          if (src->format == PixelFormat::P) {
-            c1 = &src->palette[*src->ptr(Point(x * 2, y * 2))];
-            c2 = &src->palette[*src->ptr(Point(x * 2 + 1, y * 2))];
-            c3 = &src->palette[*src->ptr(Point(x * 2 + 1, y * 2 + 1))];
-            c4 = &src->palette[*src->ptr(Point(x * 2, y * 2 + 1))];
-          }
-          else {
-            c1 = (Pen *)(src->ptr(Point(x * 2, y * 2)));
-            c2 = (Pen *)(src->ptr(Point(x * 2 + 1, y * 2)));
-            c3 = (Pen *)(src->ptr(Point(x * 2 + 1, y * 2 + 1)));
-            c4 = (Pen *)(src->ptr(Point(x * 2, y * 2 + 1)));
-          }
-
-          uint8_t a = (c1->a + c2->a + c3->a + c4->a) / 4;
-          uint8_t r = (c1->r + c2->r + c3->r + c4->r) / 4;
-          uint8_t g = (c1->g + c2->g + c3->g + c4->g) / 4;
-          uint8_t b = (c1->b + c2->b + c3->b + c4->b) / 4;
-          a = 255;
+        auto row0 = mipmap_source_row(src, y * 2, rows);
+        auto row1 = mipmap_source_row(src, y * 2 + 1, rows ? rows + bounds.w : nullptr);
 
-          dest->pen = Pen(r, g, b, a);
-          dest->pixel(Point(x, y));
-        }
+        mipmap_downsample_row(row0, row1, (Pen *)dest->ptr(0, y), w, gamma);
       }
 
       src = dest;
       mipmap_data += (src->row_stride * src->bounds.h);
-    } while (--depth);
+    }
+
+    delete[] rows;
   }
 
   /**
@@ -382,6 +442,14 @@ namespace blit {
     int scale_x = (sprite.w << fix_shift) / r.w;
     int scale_y = (sprite.h << fix_shift) / r.h;
 
+    // round the step up for integer upscales, otherwise 3x truncates to a step
+    // that gives the first source pixel four destination pixels
+    if (r.w > sprite.w && r.w % sprite.w == 0)
+      scale_x = ((1 << fix_shift) + r.w / sprite.w - 1) / (r.w / sprite.w);
+
+    if (r.h > sprite.h && r.h % sprite.h == 0)
+      scale_y = ((1 << fix_shift) + r.h / sprite.h - 1) / (r.h / sprite.h);
+
     int left = (dr.x - r.x) * scale_x;
     int top = (dr.y - r.y) * scale_y;
 
@@ -401,45 +469,20 @@ namespace blit {
     uint32_t dest_offset = offset(dr);
     uint32_t src_offset;
 
+    int src_step = (t & SpriteTransform::XYSWAP) ? src->bounds.w : 1;
+
     int y_count = dr.h;
     int y = top;
 
-    int x_scale_px = r.w > sprite.w ? std::min(dr.w, int32_t((1 << fix_shift) / scale_x)) : 1;
-
     do {
-      int x_count = dr.w;
-      int x = left;
-
-      int src_step = 1;
-
-      if (t & SpriteTransform::XYSWAP) {
+      if (t & SpriteTransform::XYSWAP)
         src_offset = src->offset(sprite.x + (y >> fix_shift), sprite.y);
-        src_step = src->bounds.w;
-      } else
+      else
         src_offset = src->offset(sprite.x, sprite.y + (y >> fix_shift));
 
-      // fill an initial block if we're not part way through a pixel
-      int num = (x & ((1 << fix_shift) - 1)) == 0 ? x_scale_px : 1;
-      do {
-        int new_x = x + x_step * num;
-
-        // can fit another pixel
-        if (x >> fix_shift == new_x >> fix_shift && x_count > num) {
-          num++;
-          new_x += x_step;
-        }
-
-        auto pen = src->get_pixel(src_offset + (x >> fix_shift) * src_step);
-        pbf(&pen, this, dest_offset, num);
-        dest_offset += num;
-
-        x = new_x;
-        x_count -= num;
-
-        num = std::min(x_count, x_scale_px);
-      } while (x_count);
+      sbf(src, src_offset, this, dest_offset, dr.w, left, x_step, src_step);
 
-      dest_offset += bounds.w - dr.w;
+      dest_offset += bounds.w;
       y += y_step;
     } while (--y_count);
   }
@@ -484,57 +527,103 @@ namespace blit {
    * \param dr `rect` destination
    */
   void Surface::stretch_blit(Surface *src, const Rect &sr, const Rect &dr) {
-    Rect cdr = clip.intersection(dr);  // clipped destination rect
+    stretch_blit(src, sr, dr, 0);
+  }
 
-    if (cdr.empty())
-      return; // after clipping there is nothing to draw
+  // narrows [start, end) towards the indices i where lo <= c + dc * i < hi
+  // the result may include an extra pixel at either end due to rounding
+  static void affine_span_limit(int32_t c, int32_t dc, int32_t lo, int32_t hi, int32_t &start, int32_t &end) {
+    if (dc == 0) {
+      if (c < lo || c >= hi)
+        end = start;
+      return;
+    }
 
-    static const int fix_shift = 16;
+    float i0 = float(lo - c) / dc;
+    float i1 = float(hi - c) / dc;
 
-    int scale_x = (sr.w << fix_shift) / dr.w;
-    int scale_y = (sr.h << fix_shift) / dr.h;
+    if (i0 > i1)
+      std::swap(i0, i1);
 
-    int left = (cdr.x - dr.x) * scale_x;
-    int top = (cdr.y - dr.y) * scale_y;
+    start = std::max(float(start), floorf(i0));
+    end = std::min(float(end), ceilf(i1) + 1.0f);
+  }
 
-    uint32_t dest_offset = offset(cdr);
-    uint32_t src_offset;
+  /**
+   * Blit a rotated/scaled surface to the surface
+   *
+   * The transform maps positions in the source rect (relative to its top left)
+   * to the destination, for example to rotate a sprite around `origin` and
+   * draw it at `pos`:
+   * `Mat3::translation(pos) * Mat3::rotation(a) * Mat3::translation(-origin)`
+   *
+   * \param src
+   * \param src_r `rect` source
+   * \param transform source to destination transform
+   * \param bilinear `true` to filter between source pixels instead of picking the nearest
+   */
+  void Surface::blit(Surface *src, const Rect &src_r, const Mat3 &transform, bool bilinear) {
+    if (src_r.empty())
+      return;
+
+    float det = transform.v00 * transform.v11 - transform.v01 * transform.v10;
+    if (det == 0.0f)
+      return; // collapsed to a line/point
+
+    // destination bounds of the transformed source rect
+    Vec2 corners[]{
+      Vec2(0.0f, 0.0f) * transform, Vec2(float(src_r.w), 0.0f) * transform,
+      Vec2(0.0f, float(src_r.h)) * transform, Vec2(float(src_r.w), float(src_r.h)) * transform
+    };
 
-    int y_count = cdr.h;
-    int y = top;
+    Vec2 tl = corners[0], br = corners[0];
+    for (auto &c : corners) {
+      tl.x = std::min(tl.x, c.x); tl.y = std::min(tl.y, c.y);
+      br.x = std::max(br.x, c.x); br.y = std::max(br.y, c.y);
+    }
 
-    int x_scale_px = dr.w > sr.w ? std::min(cdr.w, int32_t((1 << fix_shift) / scale_x)) : 1;
+    Rect dr = clip.intersection(Rect(Point(floorf(tl.x), floorf(tl.y)), Point(ceilf(br.x), ceilf(br.y))));
 
-    do {
-      int x_count = cdr.w;
-      int x = left;
+    if (dr.empty())
+      return; // after clipping there is nothing to draw
 
-      src_offset = src->offset(sr.x, sr.y + (y >> fix_shift));
+    Mat3 inv = transform;
+    inv.inverse();
 
-      // fill an initial block if we're not part way through a pixel
-      int num = (x & ((1 << fix_shift) - 1)) == 0 ? x_scale_px : 1;
-      do {
-        int new_x = x + scale_x * num;
+    static const int fix_shift = 16;
+    static const float fix_scale = 1 << fix_shift;
 
-        // can fit another pixel
-        if (x >> fix_shift == new_x >> fix_shift && x_count > num) {
-          num++;
-          new_x += scale_x;
-        }
+    // source step per destination pixel
+    int32_t du = inv.v00 * fix_scale;
+    int32_t dv = inv.v10 * fix_scale;
 
-        auto pen = src->get_pixel(src_offset + (x >> fix_shift));
-        pbf(&pen, this, dest_offset, num);
-        dest_offset += num;
+    int32_t min_u = src_r.x << fix_shift, max_u = (src_r.x + src_r.w) << fix_shift;
+    int32_t min_v = src_r.y << fix_shift, max_v = (src_r.y + src_r.h) << fix_shift;
 
-        x = new_x;
-        x_count -= num;
+    auto inside = [&](int32_t u, int32_t v) {
+      return u >= min_u && u < max_u && v >= min_v && v < max_v;
+    };
 
-        num = std::min(x_count, x_scale_px);
-      } while (x_count);
+    for (int32_t y = dr.y; y < dr.y + dr.h; y++) {
+      // source position of the centre of the first pixel in the row
+      Vec2 s = Vec2(dr.x + 0.5f, y + 0.5f) * inv;
+      int32_t u = (s.x + src_r.x) * fix_scale;
+      int32_t v = (s.y + src_r.y) * fix_scale;
 
-      dest_offset += bounds.w - cdr.w;
-      y += scale_y;
-    } while (--y_count);
+      // find the part of the row inside the source rect
+      int32_t start = 0, end = dr.w;
+      affine_span_limit(u, du, min_u, max_u, start, end);
+      affine_span_limit(v, dv, min_v, max_v, start, end);
+
+      while (start < end && !inside(u + du * start, v + dv * start))
+        start++;
+
+      while (end > start && !inside(u + du * (end - 1), v + dv * (end - 1)))
+        end--;
+
+      if (start < end)
+        abf(src, src_r, this, offset(dr.x + start, y), end - start, u + du * start, v + dv * start, du, dv, bilinear);
+    }
   }
 
   /**
@@ -15,10 +15,13 @@
 #include "../engine/file.hpp"
 #include "../types/rect.hpp"
 #include "../types/size.hpp"
+#include "../types/mat3.hpp"
 #include "../graphics/blend.hpp"
 
 namespace blit {
 
+  struct DepthBuffer;
+
   /**
    * All sprite mirroring and rotations (90/180/270) can be composed
    * of simple horizontal/vertical flips and x/y coordinate swaps.
@@ -40,6 +43,27 @@ namespace blit {
     R270 = 0b110
   };
 
+  /// Fill rule for self-intersecting polygons
+  enum class FillRule {
+    even_odd, // filled where a line from the point crosses an odd number of edges
+    non_zero  // filled where the edges crossed don't cancel out by direction
+  };
+
+  /// Shape of the ends of `Surface::thick_line`
+  enum class LineCap {
+    butt,   // ends exactly at the end points
+    square, // extended past the end points by half the width
+    round   // semicircle around the end points
+  };
+
+  /// Vertex for `Surface::texture_triangle`
+  struct TexturedVertex {
+    Vec2 pos;         // destination position, may be sub-pixel
+    Vec2 uv;          // source position in pixels
+    float w = 1.0f;   // clip space w, only used for perspective correction
+    float z = 0.0f;   // depth from 0 (near) to 1 (far), only used with a depth buffer
+  };
+
 #pragma pack(push, 1)
   struct packed_image {
     uint8_t type[8];
@@ -123,6 +147,7 @@ namespace blit {
     uint16_t                        row_stride;               // bytes per row
 
     Surface                        *mask = nullptr;           // optional mask
+    DepthBuffer                    *depth = nullptr;          // optional depth buffer (for texture_triangle/draw_mesh)
     Pen                            *palette = nullptr;        // palette entries (for paletted images)
 
     Surface                        *sprites = nullptr;        // active spritesheet
@@ -133,6 +158,8 @@ namespace blit {
     blit::PenBlendFunc              pbf;
     blit::BlitBlendFunc             bbf;
     blit::PenGetFunc                pgf;
+    blit::StretchBlendFunc          sbf;
+    blit::AffineBlendFunc           abf;
 
     std::vector<Surface *>          mipmaps;                  // TODO: probably too niche/specific to attach directly to surface
 
@@ -167,7 +194,7 @@ namespace blit {
     __attribute__((always_inline)) inline uint32_t offset(const Point &p) { return p.x + p.y * bounds.w; }
     __attribute__((always_inline)) inline uint32_t offset(int32_t x, int32_t y) { return x + y * bounds.w; }
 
-    void generate_mipmaps(uint8_t depth);
+    void generate_mipmaps(uint8_t depth, bool gamma = false);
 
     Pen get_pixel(uint32_t offset) {return pgf(this, offset);}
     Pen get_pixel(Point p) {return pgf(this, offset(p));}
@@ -178,25 +205,34 @@ namespace blit {
     void h_span(Point p, int16_t c);
     void rectangle(const Rect &r);
     void circle(const Point &c, int32_t r);
+    void outline_circle(const Point &c, int32_t r);
+    void ellipse(const Point &c, int32_t rx, int32_t ry);
+    void outline_ellipse(const Point &c, int32_t rx, int32_t ry);
+    void aa_circle(const Vec2 &c, float r, float stroke = 0.0f);
+    void aa_ellipse(const Vec2 &c, const Vec2 &radius, float stroke = 0.0f);
 
     void line(const Point&p1, const Point&p2);
+    void aa_line(Vec2 p1, Vec2 p2);
+    void thick_line(const Vec2 &p1, const Vec2 &p2, float width, LineCap cap = LineCap::butt, bool antialias = false);
     void triangle(Point p1, Point p2, Point p3);
-    void polygon(std::vector<Point> p);
+    void polygon(const std::vector<Point> &p);
+    void polygon(const Point *points, uint32_t count, FillRule rule = FillRule::even_odd, bool antialias = false);
+    void polygon(const Point *points, uint32_t count, FillRule rule, bool antialias, void *scratch, uint32_t scratch_size);
+    static uint32_t polygon_scratch_size(uint32_t count);
 
     void text(std::string_view message, const Font &font, const Rect &r, bool variable = true, TextAlign align = TextAlign::top_left);
     void text(std::string_view message, const Font &font, const Point &p, bool variable = true, TextAlign align = TextAlign::top_left);
     Size measure_text(std::string_view message, const Font &font, bool variable = true);
     std::string wrap_text(std::string_view message, int32_t width, const Font &font, bool variable = true, bool words = true);
 
-    /*void outline_circle(const point &c, int32_t r);
-
-    */
     void blit(Surface *src, Rect src_r, Point dst_p);
     void blit(Surface *src, const Rect &src_r, const Point &dst_p, int transforms);
 
     void stretch_blit(Surface *src, const Rect &src_r, const Rect &dst_r);
     void stretch_blit(Surface *src, const Rect &src_r, const Rect &dst_r, int transforms);
 
+    void blit(Surface *src, const Rect &src_r, const Mat3 &transform, bool bilinear = false);
+
     void stretch_blit_vspan(Surface *src, Point uv, uint16_t sc, Point p, int16_t dc);
 
     void custom_blend(Surface *src, Rect r, Point p, std::function<void(uint8_t *psrc, uint8_t *pdest, int16_t c)> f);
@@ -231,7 +267,7 @@ namespace blit {
     void sprite(const Point &sprite, const Point &position, const Point &origin, float scale, uint8_t transform = 0);
     void sprite(uint16_t sprite, const Point &position, const Point &origin, float scale, uint8_t transform = 0);
 
-    //extern void texture_triangle(int32_t x1, int32_t y1, int32_t u1, int32_t v1, int32_t x2, int32_t y2, int32_t u2, int32_t v2, int32_t x3, int32_t y3, int32_t u3, int32_t v3);
+    void texture_triangle(Surface *src, TexturedVertex v1, TexturedVertex v2, TexturedVertex v3, bool perspective = false);
 
     /*
       blitting methods
@@ -16,35 +16,49 @@ namespace blit {
   TileMap::TileMap(uint8_t *tiles, uint8_t *transforms, Size bounds, Surface *sprites) : bounds(bounds), tiles(tiles), transforms(transforms), sprites(sprites) {
   }
 
-  TileMap *TileMap::load_tmx(const uint8_t *asset, Surface *sprites, int layer, int flags) {
-    auto map_struct = reinterpret_cast<const TMX *>(asset);
+  /**
+   * Create a new tilemap with 16-bit tile ids.
+   *
+   * \param[in] tiles
+   * \param[in] transforms
+   * \param[in] bounds Map bounds, must be a power of two
+   * \param[in] sprites
+   */
+  TileMap::TileMap(uint16_t *tiles, uint8_t *transforms, Size bounds, Surface *sprites) : bounds(bounds), tiles(nullptr), tiles16(tiles), transforms(transforms), sprites(sprites) {
+  }
 
+  static bool check_tmx(const TMX *map_struct) {
     if(memcmp(map_struct, "MTMX", 4) != 0 || map_struct->header_length != sizeof(TMX))
-      return nullptr;
-
-    // only 8 bit tiles supported
-    if(map_struct->flags & TMX_16Bit)
-      return nullptr;
+      return false;
 
     // power of two bounds required
     if((map_struct->width & (map_struct->width - 1)) || (map_struct->height & (map_struct->height - 1)))
-      return nullptr;
+      return false;
 
+    return true;
+  }
+
+  static TileMap load_tmx_layer(const TMX *map_struct, Surface *sprites, int layer, int flags) {
     auto layer_size = map_struct->width * map_struct->height;
+    bool is_16bit = map_struct->flags & TMX_16Bit;
+    auto tile_bytes = is_16bit ? 2 : 1;
+
+    auto layer_data = map_struct->data + layer_size * tile_bytes * layer;
 
     uint8_t *tile_data;
-    if(flags & copy_tiles) {
-      tile_data = new uint8_t[layer_size];
-      memcpy(tile_data, map_struct->data + layer_size * layer, layer_size);
+    if(flags & TileMap::copy_tiles) {
+      tile_data = is_16bit ? (uint8_t *)new uint16_t[layer_size] : new uint8_t[layer_size];
+      memcpy(tile_data, layer_data, layer_size * tile_bytes);
     } else {
-      tile_data = const_cast<uint8_t *>(map_struct->data + layer_size * layer);
+      tile_data = const_cast<uint8_t *>(layer_data);
     }
 
-    auto transform_base = map_struct->data + layer_size * map_struct->layers;
+    // transforms are always 8-bit, after the tiles of every layer
+    auto transform_base = map_struct->data + layer_size * tile_bytes * map_struct->layers;
 
     uint8_t *transform_data = nullptr;
 
-    if(flags & copy_transforms) {
+    if(flags & TileMap::copy_transforms) {
       transform_data = new uint8_t[layer_size]();
 
       if(map_struct->flags & TMX_Transforms)
@@ -53,12 +67,82 @@ namespace blit {
       transform_data = const_cast<uint8_t *>(transform_base + layer_size * layer);
     }
 
-    auto ret = new TileMap(tile_data, transform_data, Size(map_struct->width, map_struct->height), sprites);
-    ret->empty_tile_id = map_struct->empty_tile;
+    Size bounds(map_struct->width, map_struct->height);
+    TileMap ret = is_16bit ? TileMap((uint16_t *)tile_data, transform_data, bounds, sprites)
+                           : TileMap(tile_data, transform_data, bounds, sprites);
+    ret.empty_tile_id = map_struct->empty_tile;
 
     return ret;
   }
 
+  TileMap *TileMap::load_tmx(const uint8_t *asset, Surface *sprites, int layer, int flags) {
+    auto map_struct = reinterpret_cast<const TMX *>(asset);
+
+    if(!check_tmx(map_struct) || layer >= map_struct->layers)
+      return nullptr;
+
+    return new TileMap(load_tmx_layer(map_struct, sprites, layer, flags));
+  }
+
+  /**
+   * Load every layer of a map.
+   *
+   * By default the layers reference the tile and transform data of the asset
+   * directly, so nothing is copied out of flash.
+   *
+   * \param[in] asset Map data generated by the asset tools.
+   * \param[in] sprites Sprite sheet for all layers.
+   * \param[in] flags `TileMap::LoadFlags` to copy the data into RAM for editing.
+   * \return New stack of layers or `nullptr` if the map is invalid.
+   */
+  TileMapStack *TileMapStack::load_tmx(const uint8_t *asset, Surface *sprites, int flags) {
+    auto map_struct = reinterpret_cast<const TMX *>(asset);
+
+    if(!check_tmx(map_struct))
+      return nullptr;
+
+    auto ret = new TileMapStack;
+    ret->layers.reserve(map_struct->layers);
+
+    for(int i = 0; i < map_struct->layers; i++)
+      ret->layers.push_back(load_tmx_layer(map_struct, sprites, i, flags));
+
+    return ret;
+  }
+
+  /**
+   * Draw all layers to a specified destination surface, with clipping.
+   *
+   * Layers are drawn one scanline at a time, bottom layer first. Without a
+   * callback each layer uses its own transform, so they can scroll
+   * independently.
+   *
+   * \param[in] dest Destination surface.
+   * \param[in] viewport Clipping rectangle.
+   * \param[in] scanline_callback Functon called on every scanline, accepts the scanline y position, should return a transformation matrix for all layers.
+   */
+  void TileMapStack::draw(Surface *dest, Rect viewport, std::function<Mat3(uint8_t)> scanline_callback) {
+    viewport = dest->clip.intersection(viewport);
+
+    for (uint16_t y = viewport.y; y < viewport.y + viewport.h; y++) {
+      Vec2 swc(viewport.x, y);
+      Vec2 ewc(viewport.x + viewport.w, y);
+
+      if (scanline_callback) {
+        Mat3 custom_transform = scanline_callback(y);
+        swc *= custom_transform;
+        ewc *= custom_transform;
+      }
+
+      for (auto &layer : layers) {
+        if (scanline_callback)
+          layer.texture_span(dest, Point(viewport.x, y), viewport.w, swc, ewc);
+        else
+          layer.texture_span(dest, Point(viewport.x, y), viewport.w, swc * layer.transform, ewc * layer.transform);
+      }
+    }
+  }
+
   /**
    * TODO: Document
    *
@@ -97,11 +181,11 @@ namespace blit {
    * \param[in] p Point denoting the tile x/y position in the map.
    * \return Bitmask of flags for specified tile.
    */
-  uint8_t TileMap::tile_at(const Point &p) {
+  uint16_t TileMap::tile_at(const Point &p) {
     int32_t o = offset(p.x, p.y);
 
     if(o != -1)
-      return tiles[o];
+      return tile_id(o);
 
     return 0;
   }
@@ -171,73 +255,42 @@ namespace blit {
   }*/
 
   /**
-   * TODO: Document
+   * Draw a span of the tilemap, stepping linearly from one world coordinate
+   * to another.
    *
-   * \param[in] dest
-   * \param[in] s
-   * \param[in] c
-   * \param[in] swc
-   * \param[in] ewc
+   * \param[in] dest Destination surface.
+   * \param[in] s Position of the first pixel of the span in `dest`.
+   * \param[in] c Number of pixels in the span.
+   * \param[in] swc World coordinate of the first pixel.
+   * \param[in] ewc World coordinate after the last pixel.
    */
   void TileMap::texture_span(Surface *dest, Point s, unsigned int c, Vec2 swc, Vec2 ewc) {
-    Surface *src = sprites;
-
-    static const int fix_shift = 16;
-
-    Point wc(swc * (1 << fix_shift));
-    Point dwc(((ewc - swc) / float(c)) * (1 << fix_shift));
-    int32_t doff = dest->offset(s.x, s.y);
+    if (!c)
+      return;
 
-    do {
-      int16_t wcx = wc.x >> fix_shift;
-      int16_t wcy = wc.y >> fix_shift;
+    auto lookup = [](void *data, int32_t x, int32_t y, uint8_t &transform) {
+      auto map = (TileMap *)data;
+      int32_t toff = map->offset(x, y);
 
-      int32_t toff = offset(wcx >> 3, wcy >> 3);
+      if (toff == -1)
+        return int32_t(-1);
 
-      if (toff != -1 && tiles[toff] != empty_tile_id) {
-        uint8_t tile_id = tiles[toff];
-        uint8_t transform = transforms ? transforms[toff] : 0;
+      int32_t id = map->tile_id(toff);
+      if (id == map->empty_tile_id)
+        return int32_t(-1);
 
-        // coordinate within sprite
-        int u = wcx & 0b111;
-        int v = wcy & 0b111;
-
-        // if this tile has a transform then modify the uv coordinates
-        if (transform) {
-          v = (transform & 0b010) ? (7 - v) : v;
-          u = (transform & 0b100) ? (7 - u) : u;
-          if (transform & 0b001) { int tmp = u; u = v; v = tmp; }
-        }
-
-        // sprite sheet coordinates for top left corner of sprite
-        u += (tile_id & 0b1111) * 8;
-        v += (tile_id >> 4) * 8;
-
-        // draw as many pixels as possible
-        int count = 0;
-
-        do {
-          wc += dwc;
-          c--;
-          count++;
-        } while(c && (wc.x >> fix_shift) == wcx && (wc.y >> fix_shift) == wcy);
-
-        auto pen = src->get_pixel({u, v});
-        dest->pbf(&pen, dest, doff, count);
-
-        doff += count;
-
-        continue;
-      }
+      transform = map->transforms ? map->transforms[toff] : 0;
+      return id;
+    };
 
-      // skip to next tile
-      do {
-        wc += dwc;
-        doff++;
-        c--;
-      } while(c && (wc.x >> (fix_shift + 3)) == wcx >> 3 && (wc.y >> (fix_shift + 3)) == wcy >> 3);
+    Vec2 dwc = (ewc - swc) / float(c);
 
-    } while (c);
+    texture_tile_span(
+      dest, dest->offset(s.x, s.y), c, sprites,
+      int32_t(swc.x * 65536.0f), int32_t(swc.y * 65536.0f),
+      int32_t(dwc.x * 65536.0f), int32_t(dwc.y * 65536.0f),
+      0, tile_columns(), lookup, this
+    );
   }
 
 }
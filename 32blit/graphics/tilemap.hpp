@@ -1,6 +1,8 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
+#include <vector>
 
 #include "../32blit.hpp"
 #include "../types/size.hpp"
@@ -34,6 +36,7 @@ namespace blit {
     Size          bounds;
 
     uint8_t      *tiles;
+    uint16_t     *tiles16 = nullptr;  // tiles of maps with 16-bit ids, `tiles` is null for these
     uint8_t      *transforms;
     Surface  *sprites;
     Mat3          transform = Mat3::identity();
@@ -54,18 +57,33 @@ namespace blit {
     };
 
     TileMap(uint8_t *tiles, uint8_t *transforms, Size bounds, Surface *sprites);
+    TileMap(uint16_t *tiles, uint8_t *transforms, Size bounds, Surface *sprites);
 
     static TileMap *load_tmx(const uint8_t *asset, Surface *sprites, int layer = 0, int flags = copy_tiles | copy_transforms);
 
     inline int32_t offset(const Point &p) {return offset(p.x, p.y);} // __attribute__((always_inline));
     int32_t offset(int16_t x, int16_t y); // __attribute__((always_inline));
-    uint8_t tile_at(const Point &p); // __attribute__((always_inline));
+    uint16_t tile_at(const Point &p); // __attribute__((always_inline));
     uint8_t transform_at(const Point &p); // __attribute__((always_inline));
 
     void draw(Surface *dest, Rect viewport, std::function<Mat3(uint8_t)> scanline_callback = nullptr);
 
   //  void mipmap_texture_span(surface *dest, point s, uint16_t c, vec2 swc, vec2 ewc);
     void texture_span(Surface *dest, Point s, unsigned int c, Vec2 swc, Vec2 ewc);
+
+    inline uint16_t tile_id(int32_t offset) const {return tiles16 ? tiles16[offset] : tiles[offset];}
+
+    // 8-bit maps always have 16 tiles per row of the sprite sheet, 16-bit maps use the full width of the sheet
+    inline int32_t tile_columns() const {return tiles16 ? std::max(sprites->bounds.w / 8, 1) : 16;}
+  };
+
+  // All layers of a map, drawn bottom to top
+  struct TileMapStack {
+    std::vector<TileMap> layers;
+
+    static TileMapStack *load_tmx(const uint8_t *asset, Surface *sprites, int flags = 0);
+
+    void draw(Surface *dest, Rect viewport, std::function<Mat3(uint8_t)> scanline_callback = nullptr);
   };
 
 }
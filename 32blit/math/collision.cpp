@@ -0,0 +1,340 @@
+/*! \file collision.cpp
+    \brief Collision queries against tile grids and a broadphase for moving objects.
+*/
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#include "collision.hpp"
+#include "../graphics/tilemap.hpp"
+#include "../types/map.hpp"
+
+namespace blit {
+
+  /**
+   * View the flags of a map.
+   *
+   * \param[in] map
+   */
+  TileGrid::TileGrid(const Map &map) : bounds(map.bounds.w, map.bounds.h), flags(map.flags.data()) {
+  }
+
+  /**
+   * View a tilemap, with flags given by tile id.
+   *
+   * \param[in] map
+   * \param[in] tile_flags Flags for each tile id used by the map.
+   */
+  TileGrid::TileGrid(const TileMap &map, const uint8_t *tile_flags) : bounds(map.bounds), tiles(map.tiles), tiles16(map.tiles16), tile_flags(tile_flags) {
+  }
+
+  /**
+   * Check if any tile overlapping a rectangle has any of the flags in a mask.
+   *
+   * \param[in] r Rectangle in pixels.
+   * \param[in] mask Flags to check for.
+   * \return `true` as soon as a matching tile is found.
+   */
+  bool TileGrid::any_in_rect(const Rect &r, uint8_t mask) const {
+    if (r.empty())
+      return false;
+
+    int32_t x0 = r.x >> tile_shift, x1 = (r.x + r.w - 1) >> tile_shift;
+    int32_t y0 = r.y >> tile_shift, y1 = (r.y + r.h - 1) >> tile_shift;
+
+    if ((outside & mask) && (x0 < 0 || y0 < 0 || x1 >= bounds.w || y1 >= bounds.h))
+      return true;
+
+    x0 = std::max(x0, int32_t(0)); x1 = std::min(x1, bounds.w - 1);
+    y0 = std::max(y0, int32_t(0)); y1 = std::min(y1, bounds.h - 1);
+
+    for (int32_t y = y0; y <= y1; y++) {
+      int32_t i = x0 + y * bounds.w;
+
+      if (flags) {
+        for (const uint8_t *f = flags + i, *end = f + (x1 - x0); f <= end; f++) {
+          if (*f & mask)
+            return true;
+        }
+      } else {
+        for (int32_t x = x0; x <= x1; x++, i++) {
+          if (tile_flags[tiles16 ? tiles16[i] : tiles[i]] & mask)
+            return true;
+        }
+      }
+    }
+
+    return false;
+  }
+
+  /**
+   * Move a box through a grid, stopping at tiles with any of the flags in a
+   * mask.
+   *
+   * The box moves horizontally then vertically and only tiles it moves into
+   * are checked, so a box already overlapping a tile can move out of it.
+   * Movement is never skipped over a thin wall however far it goes.
+   *
+   * \param[in] grid
+   * \param[in] position Top left of the box, in pixels.
+   * \param[in] size Size of the box, in pixels.
+   * \param[in] delta Movement this step.
+   * \param[in] mask Flags of tiles that block the box.
+   * \return Where the box stopped and the tiles that stopped it.
+   */
+  TileSweep sweep_box(const TileGrid &grid, Vec2 position, Vec2 size, Vec2 delta, uint8_t mask) {
+    TileSweep ret;
+    ret.position = position;
+
+    const float tile_size = float(1 << grid.tile_shift);
+    const float inv_tile_size = 1.0f / tile_size;
+
+    // tile containing the start of an edge and tile before the end of one
+    auto first = [&](float v) { return int32_t(floorf(v * inv_tile_size)); };
+    auto last = [&](float v) { return int32_t(ceilf(v * inv_tile_size)) - 1; };
+
+    auto blocked = [&](int32_t x0, int32_t y0, int32_t x1, int32_t y1, Point &tile) {
+      for (int32_t y = y0; y <= y1; y++) {
+        for (int32_t x = x0; x <= x1; x++) {
+          if (grid.at(x, y) & mask) {
+            tile = Point(x, y);
+            return true;
+          }
+        }
+      }
+      return false;
+    };
+
+    if (delta.x != 0.0f) {
+      int32_t y0 = first(position.y), y1 = last(position.y + size.y);
+      float x = position.x + delta.x;
+
+      if (delta.x > 0.0f) {
+        for (int32_t c = last(position.x + size.x) + 1, end = last(x + size.x); c <= end; c++) {
+          if (blocked(c, y0, c, y1, ret.tile_x)) {
+            x = c * tile_size - size.x;
+            ret.hit_x = true;
+            break;
+          }
+        }
+      } else {
+        for (int32_t c = first(position.x) - 1, end = first(x); c >= end; c--) {
+          if (blocked(c, y0, c, y1, ret.tile_x)) {
+            x = (c + 1) * tile_size;
+            ret.hit_x = true;
+            break;
+          }
+        }
+      }
+
+      ret.position.x = x;
+    }
+
+    if (delta.y != 0.0f) {
+      int32_t x0 = first(ret.position.x), x1 = last(ret.position.x + size.x);
+      float y = position.y + delta.y;
+
+      if (delta.y > 0.0f) {
+        for (int32_t r = last(position.y + size.y) + 1, end = last(y + size.y); r <= end; r++) {
+          if (blocked(x0, r, x1, r, ret.tile_y)) {
+            y = r * tile_size - size.y;
+            ret.hit_y = true;
+            break;
+          }
+        }
+      } else {
+        for (int32_t r = first(position.y) - 1, end = first(y); r >= end; r--) {
+          if (blocked(x0, r, x1, r, ret.tile_y)) {
+            y = (r + 1) * tile_size;
+            ret.hit_y = true;
+            break;
+          }
+        }
+      }
+
+      ret.position.y = y;
+    }
+
+    return ret;
+  }
+
+  /**
+   * Find the first tile along a ray with any of the flags in a mask.
+   *
+   * Steps from tile to tile along the ray (DDA), so every tile the ray
+   * passes through is checked exactly once. A ray starting inside a
+   * matching tile hits it at a distance of 0 with no normal.
+   *
+   * \param[in] grid
+   * \param[in] origin Start of the ray, in pixels.
+   * \param[in] direction Direction of the ray, doesn't need to be normalised.
+   * \param[in] max_distance Length of the ray, in pixels.
+   * \param[in] mask Flags of tiles that stop the ray.
+   * \param[out] hit Details of the hit, if any.
+   * \return `true` if a tile was hit.
+   */
+  bool raycast(const TileGrid &grid, Vec2 origin, Vec2 direction, float max_distance, uint8_t mask, TileRayHit *hit) {
+    float length = direction.length();
+    if (length == 0.0f)
+      return false;
+
+    Vec2 d = direction / length;
+
+    const float tile_size = float(1 << grid.tile_shift);
+
+    int32_t x = int32_t(floorf(origin.x / tile_size));
+    int32_t y = int32_t(floorf(origin.y / tile_size));
+
+    int32_t step_x = d.x > 0.0f ? 1 : -1;
+    int32_t step_y = d.y > 0.0f ? 1 : -1;
+
+    // distance along the ray to cross a whole tile, and to the next tile edge
+    float delta_x = d.x != 0.0f ? tile_size / fabsf(d.x) : FLT_MAX;
+    float delta_y = d.y != 0.0f ? tile_size / fabsf(d.y) : FLT_MAX;
+
+    float next_x = d.x != 0.0f ? ((x + (step_x > 0 ? 1 : 0)) * tile_size - origin.x) / d.x : FLT_MAX;
+    float next_y = d.y != 0.0f ? ((y + (step_y > 0 ? 1 : 0)) * tile_size - origin.y) / d.y : FLT_MAX;
+
+    bool outside_matches = grid.outside & mask;
+
+    float t = 0.0f;
+    Vec2 normal(0.0f, 0.0f);
+
+    while (t <= max_distance) {
+      if (grid.at(x, y) & mask) {
+        if (hit) {
+          hit->tile = Point(x, y);
+          hit->point = origin + d * t;
+          hit->normal = normal;
+          hit->distance = t;
+        }
+        return true;
+      }
+
+      // left the grid and moving away from it
+      if (!outside_matches && (
+          (x < 0 && step_x < 0) || (x >= grid.bounds.w && step_x > 0) ||
+          (y < 0 && step_y < 0) || (y >= grid.bounds.h && step_y > 0)))
+        return false;
+
+      if (next_x < next_y) {
+        x += step_x;
+        t = next_x;
+        next_x += delta_x;
+        normal = Vec2(float(-step_x), 0.0f);
+      } else {
+        y += step_y;
+        t = next_y;
+        next_y += delta_y;
+        normal = Vec2(0.0f, float(-step_y));
+      }
+    }
+
+    return false;
+  }
+
+  /**
+   * Create a spatial hash.
+   *
+   * \param[in] cell_shift Cells are 1 << cell_shift pixels, ideally around the size of most objects.
+   * \param[in] bucket_count Number of buckets cells are hashed into, rounded up to a power of two.
+   */
+  SpatialHash::SpatialHash(uint8_t cell_shift, uint16_t bucket_count) : cell_shift(cell_shift) {
+    uint32_t count = 1;
+    while (count < bucket_count)
+      count <<= 1;
+
+    bucket_mask = count - 1;
+    buckets.assign(count, -1);
+  }
+
+  uint32_t SpatialHash::bucket(int32_t x, int32_t y) const {
+    return ((uint32_t(x) * 73856093u) ^ (uint32_t(y) * 19349663u)) & bucket_mask;
+  }
+
+  /**
+   * Remove all objects, keeping the memory allocated for them.
+   */
+  void SpatialHash::clear() {
+    std::fill(buckets.begin(), buckets.end(), -1);
+    entries.clear();
+    ids.clear();
+  }
+
+  /**
+   * Add an object to every cell its bounds overlap.
+   *
+   * \param[in] id Index of the object, should be small as storage is allocated up to the largest.
+   * \param[in] bounds
+   */
+  void SpatialHash::insert(uint16_t id, const Rect &bounds) {
+    if (id >= rects.size()) {
+      rects.resize(id + 1);
+      stamps.resize(id + 1, 0);
+    }
+
+    rects[id] = bounds;
+    ids.push_back(id);
+
+    int32_t x0 = bounds.x >> cell_shift, x1 = (bounds.x + std::max(bounds.w, int32_t(1)) - 1) >> cell_shift;
+    int32_t y0 = bounds.y >> cell_shift, y1 = (bounds.y + std::max(bounds.h, int32_t(1)) - 1) >> cell_shift;
+
+    for (int32_t y = y0; y <= y1; y++) {
+      for (int32_t x = x0; x <= x1; x++) {
+        auto &head = buckets[bucket(x, y)];
+        entries.push_back({id, head});
+        head = int32_t(entries.size() - 1);
+      }
+    }
+  }
+
+  /**
+   * Find the objects overlapping a rectangle.
+   *
+   * \param[in] r
+   * \param[out] result Ids of overlapping objects are appended to this, each only once.
+   */
+  void SpatialHash::query(const Rect &r, std::vector<uint16_t> &result) {
+    if (++stamp == 0) {
+      std::fill(stamps.begin(), stamps.end(), 0);
+      stamp = 1;
+    }
+
+    int32_t x0 = r.x >> cell_shift, x1 = (r.x + std::max(r.w, int32_t(1)) - 1) >> cell_shift;
+    int32_t y0 = r.y >> cell_shift, y1 = (r.y + std::max(r.h, int32_t(1)) - 1) >> cell_shift;
+
+    for (int32_t y = y0; y <= y1; y++) {
+      for (int32_t x = x0; x <= x1; x++) {
+        for (int32_t i = buckets[bucket(x, y)]; i != -1; i = entries[i].next) {
+          uint16_t id = entries[i].id;
+
+          if (stamps[id] == stamp)
+            continue;
+
+          stamps[id] = stamp;
+
+          auto &b = rects[id];
+          if (b.x < r.x + r.w && r.x < b.x + b.w && b.y < r.y + r.h && r.y < b.y + b.h)
+            result.push_back(id);
+        }
+      }
+    }
+  }
+
+  /**
+   * Find every pair of overlapping objects.
+   *
+   * \param[out] result Pairs are appended to this, each only once with the lower id first.
+   */
+  void SpatialHash::query_pairs(std::vector<std::pair<uint16_t, uint16_t>> &result) {
+    for (auto a : ids) {
+      pair_scratch.clear();
+      query(rects[a], pair_scratch);
+
+      for (auto b : pair_scratch) {
+        if (b > a)
+          result.emplace_back(a, b);
+      }
+    }
+  }
+}
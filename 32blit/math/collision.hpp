@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "../types/rect.hpp"
+#include "../types/size.hpp"
+#include "../types/vec2.hpp"
+
+namespace blit {
+  struct Map;
+  struct TileMap;
+
+  /**
+   * Read-only view of the collision flags of a grid of tiles.
+   *
+   * Flags either come straight from the grid (`Map::flags`) or are looked up
+   * by tile id (a table of flags for each id in the sprite sheet, for a
+   * `TileMap`). The grid must outlive the view.
+   */
+  struct TileGrid {
+    Size bounds;                        // size of the grid in tiles
+    uint8_t tile_shift = 3;             // tiles are 1 << tile_shift pixels
+    uint8_t outside = 0;                // flags of tiles outside the grid
+
+    const uint8_t *flags = nullptr;     // flags for each tile of the grid
+    const uint8_t *tiles = nullptr;     // or tile ids...
+    const uint16_t *tiles16 = nullptr;
+    const uint8_t *tile_flags = nullptr; // ...and flags for each tile id
+
+    TileGrid(const Map &map);
+    TileGrid(const TileMap &map, const uint8_t *tile_flags);
+
+    inline uint8_t at(int32_t x, int32_t y) const {
+      if (uint32_t(x) >= uint32_t(bounds.w) || uint32_t(y) >= uint32_t(bounds.h))
+        return outside;
+
+      int32_t i = x + y * bounds.w;
+
+      if (flags)
+        return flags[i];
+
+      return tile_flags[tiles16 ? tiles16[i] : tiles[i]];
+    }
+
+    bool any_in_rect(const Rect &r, uint8_t mask) const;
+  };
+
+  struct TileSweep {
+    Vec2 position;                // where the box stopped
+    bool hit_x = false;           // movement was blocked horizontally...
+    bool hit_y = false;           // ...and/or vertically
+    Point tile_x, tile_y;         // the tiles that blocked it
+  };
+
+  TileSweep sweep_box(const TileGrid &grid, Vec2 position, Vec2 size, Vec2 delta, uint8_t mask);
+
+  struct TileRayHit {
+    Point tile;                   // tile that was hit
+    Vec2 point;                   // where the ray entered it
+    Vec2 normal;                  // side of the tile that was hit
+    float distance = 0.0f;
+  };
+
+  bool raycast(const TileGrid &grid, Vec2 origin, Vec2 direction, float max_distance, uint8_t mask, TileRayHit *hit = nullptr);
+
+  /**
+   * Broadphase for moving objects.
+   *
+   * Objects are identified by an index chosen by the caller and bucketed by
+   * the cells of a uniform grid they cover. Cells are hashed so the world
+   * doesn't need bounds. Rebuild it each update with `clear` and `insert`.
+   */
+  class SpatialHash {
+  public:
+    SpatialHash(uint8_t cell_shift = 5, uint16_t bucket_count = 256);
+
+    void clear();
+    void insert(uint16_t id, const Rect &bounds);
+
+    void query(const Rect &r, std::vector<uint16_t> &result);
+    void query_pairs(std::vector<std::pair<uint16_t, uint16_t>> &result);
+
+  private:
+    struct Entry {
+      uint16_t id;
+      int32_t next;
+    };
+
+    uint32_t bucket(int32_t x, int32_t y) const;
+
+    uint8_t cell_shift;
+    uint32_t bucket_mask;
+
+    std::vector<int32_t> buckets;   // first entry of each bucket
+    std::vector<Entry> entries;
+    std::vector<uint16_t> ids;      // inserted ids
+    std::vector<Rect> rects;        // bounds of each id
+    std::vector<uint32_t> stamps;   // last query that returned each id
+    uint32_t stamp = 0;
+
+    std::vector<uint16_t> pair_scratch;
+  };
+}
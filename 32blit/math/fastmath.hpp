@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include "constants.hpp"
+
+namespace blit {
+
+  /**
+   * Approximations of common maths functions.
+   *
+   * These trade a little accuracy for speed and are meant to be chosen per
+   * call site where the result only has to be good to a fraction of a pixel,
+   * such as effects and animation. Maximum errors are measured over the
+   * documented ranges. On devices with a hardware square root `sqrtf` is
+   * already a single instruction, so `fastmath::sqrt` only helps on those
+   * without one.
+   */
+  namespace fastmath {
+
+    // reduce an angle to -pi..pi
+    inline float reduce_angle(float a) {
+      constexpr float inv_two_pi = 1.0f / (2.0f * pi);
+
+      // 2 * pi split so the first product is exact for small turn counts
+      constexpr float two_pi_hi = 6.28125f;
+      constexpr float two_pi_lo = 1.9353071795864769e-3f;
+
+      float turns = a * inv_two_pi;
+      float n = float(int32_t(turns + (turns < 0.0f ? -0.5f : 0.5f)));
+      return (a - n * two_pi_hi) - n * two_pi_lo;
+    }
+
+    // sine of an angle in -pi..pi
+    inline float sin_reduced(float x) {
+      // reflect into -pi/2..pi/2
+      if (x > pi / 2.0f)
+        x = pi - x;
+      else if (x < -pi / 2.0f)
+        x = -pi - x;
+
+      float x2 = x * x;
+      return x * (0.99999661674f + x2 * (-0.16664828602f + x2 * (0.00830632683f + x2 * -0.00018363689f)));
+    }
+
+    /**
+     * Sine, max absolute error 8e-7 for |a| < 1000.
+     *
+     * Reduced to a quarter turn and evaluated with a 7th order polynomial.
+     * Precision is lost as angles get larger, like any float range reduction.
+     *
+     * \param a Angle in radians.
+     */
+    inline float sin(float a) {
+      return sin_reduced(reduce_angle(a));
+    }
+
+    /**
+     * Cosine, max absolute error 8e-7 for |a| < 1000.
+     *
+     * \param a Angle in radians.
+     */
+    inline float cos(float a) {
+      // cos(x) = sin(pi/2 - |x|), already in range so it only rounds once
+      float x = reduce_angle(a);
+      return sin_reduced(pi / 2.0f - (x < 0.0f ? -x : x));
+    }
+
+    /**
+     * Arc tangent of y / x using the signs of both to find the quadrant, max
+     * absolute error 1.17e-5.
+     *
+     * \param y
+     * \param x
+     * \return Angle in radians in the range -pi..pi, 0 if both are 0.
+     */
+    inline float atan2(float y, float x) {
+      float ax = x < 0.0f ? -x : x;
+      float ay = y < 0.0f ? -y : y;
+
+      if (ax == 0.0f && ay == 0.0f)
+        return 0.0f;
+
+      // atan of 0..1 then fix up the octant
+      bool steep = ay > ax;
+      float z = steep ? ax / ay : ay / ax;
+      float z2 = z * z;
+      float r = z * (0.99986633989f + z2 * (-0.33030483809f + z2 * (0.18015933366f + z2 * (-0.08515628223f + z2 * 0.02084504753f))));
+
+      if (steep)
+        r = pi / 2.0f - r;
+      if (x < 0.0f)
+        r = pi - r;
+
+      return y < 0.0f ? -r : r;
+    }
+
+    /**
+     * Reciprocal square root, max relative error 4.7e-6 for positive normal
+     * numbers.
+     *
+     * Initial estimate from the float representation, refined by two
+     * Newton-Raphson steps.
+     *
+     * \param v
+     */
+    inline float invsqrt(float v) {
+      uint32_t i;
+      memcpy(&i, &v, sizeof(i));
+      i = 0x5F375A86 - (i >> 1);
+
+      float r;
+      memcpy(&r, &i, sizeof(r));
+
+      float half = v * 0.5f;
+      r = r * (1.5f - half * r * r);
+      // the same step written as a small correction, which loses less to rounding
+      r = r + r * (0.5f - half * r * r);
+      return r;
+    }
+
+    /**
+     * Square root, max relative error 5e-6 and 0 for numbers <= 0.
+     *
+     * \param v
+     */
+    inline float sqrt(float v) {
+      return v > 0.0f ? v * invsqrt(v) : 0.0f;
+    }
+  }
+
+}
@@ -55,4 +55,42 @@ namespace blit {
   Vec2 lerp(float value, Vec2 start, Vec2 end) {
     return ((end - start) * value) + start;
   }
-}
\ No newline at end of file
+
+  /**
+   * Fixed point version of `lerp(float, float, float, float, float)`
+   *
+   * @param value
+   * @param start
+   * @param end
+   * @param min
+   * @param max
+   * @return
+   */
+  Fixed lerp(Fixed value, Fixed start, Fixed end, Fixed min, Fixed max) {
+    value = value < start ? start : (value > end ? end : value);
+    return ((value / (end - start)) * (max - min)) + min;
+  }
+
+  /**
+   * Fixed point version of `lerp(float, float, float)`
+   *
+   * @param value
+   * @param start
+   * @param end
+   * @return
+   */
+  Fixed lerp(Fixed value, Fixed start, Fixed end) {
+    return (value - start) / (end - start);
+  }
+
+  /**
+   * Fixed point version of `lerp(float, Vec2, Vec2)`
+   *
+   * @param value
+   * @param start
+   * @param end
+   */
+  FVec2 lerp(Fixed value, FVec2 start, FVec2 end) {
+    return ((end - start) * value) + start;
+  }
+}
@@ -1,9 +1,14 @@
 #pragma once
 
+#include "../types/fvec2.hpp"
 #include "../types/vec2.hpp"
 namespace blit {
   float lerp(float value, float start, float end, float min, float max);
   float lerp(float value, float start, float end);
   Vec2 lerp(float value, float start, float end, Vec2 min, Vec2 max);
   Vec2 lerp(float value, Vec2 start, Vec2 end);
+
+  Fixed lerp(Fixed value, Fixed start, Fixed end, Fixed min, Fixed max);
+  Fixed lerp(Fixed value, Fixed start, Fixed end);
+  FVec2 lerp(Fixed value, FVec2 start, FVec2 end);
 }
\ No newline at end of file
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+namespace blit {
+
+  /**
+   * Q16.16 fixed point number, for maths on devices without an FPU.
+   *
+   * The range is about +/-32767 with a precision of 1/65536. Products and
+   * quotients are calculated in 64 bits so they don't overflow unless the
+   * result does. Ints convert implicitly, floats have to be converted with
+   * Fixed(1.5f) so they can't be truncated by accident.
+   *
+   * Ints outside the range and division by zero saturate to the largest
+   * positive or negative value, where a float would be infinite.
+   */
+  struct Fixed {
+    int32_t raw = 0;
+
+    constexpr Fixed() = default;
+    constexpr Fixed(int i) : raw(i > 32767 ? INT32_MAX : i < -32768 ? INT32_MIN : i * 65536) {}
+    explicit constexpr Fixed(float f) : raw(int32_t(f * 65536.0f + (f < 0.0f ? -0.5f : 0.5f))) {}
+
+    // stops floats implicitly truncating through Fixed(int), Fixed(10) * 0.5f would be 0
+    template<class T, typename std::enable_if<std::is_floating_point<T>::value, int>::type = 0>
+    constexpr Fixed(T) = delete;
+
+    static constexpr Fixed from_raw(int32_t raw) { Fixed f; f.raw = raw; return f; }
+
+    explicit constexpr operator float() const { return float(raw) / 65536.0f; }
+
+    /// Round down to an integer
+    constexpr int32_t to_int() const { return raw >> 16; }
+
+    inline Fixed& operator+= (const Fixed &a) { raw += a.raw; return *this; }
+    inline Fixed& operator-= (const Fixed &a) { raw -= a.raw; return *this; }
+    inline Fixed& operator*= (const Fixed &a) { raw = int32_t((int64_t(raw) * a.raw) >> 16); return *this; }
+    inline Fixed& operator/= (const Fixed &a) {
+      if (a.raw == 0)
+        raw = raw < 0 ? INT32_MIN : INT32_MAX;
+      else
+        raw = int32_t((int64_t(raw) * 65536) / a.raw);
+      return *this;
+    }
+  };
+
+  inline Fixed operator-  (Fixed lhs, const Fixed &rhs) { lhs -= rhs; return lhs; }
+  inline Fixed operator-  (const Fixed &rhs) { return Fixed::from_raw(-rhs.raw); }
+  inline Fixed operator+  (Fixed lhs, const Fixed &rhs) { lhs += rhs; return lhs; }
+  inline Fixed operator*  (Fixed lhs, const Fixed &rhs) { lhs *= rhs; return lhs; }
+  inline Fixed operator/  (Fixed lhs, const Fixed &rhs) { lhs /= rhs; return lhs; }
+
+  inline bool operator== (const Fixed &lhs, const Fixed &rhs) { return lhs.raw == rhs.raw; }
+  inline bool operator!= (const Fixed &lhs, const Fixed &rhs) { return lhs.raw != rhs.raw; }
+  inline bool operator<  (const Fixed &lhs, const Fixed &rhs) { return lhs.raw <  rhs.raw; }
+  inline bool operator>  (const Fixed &lhs, const Fixed &rhs) { return lhs.raw >  rhs.raw; }
+  inline bool operator<= (const Fixed &lhs, const Fixed &rhs) { return lhs.raw <= rhs.raw; }
+  inline bool operator>= (const Fixed &lhs, const Fixed &rhs) { return lhs.raw >= rhs.raw; }
+
+  constexpr Fixed fixed_pi = Fixed::from_raw(205887);
+
+  uint32_t isqrt(uint64_t v);
+
+  Fixed fixed_sqrt(Fixed a);
+  Fixed fixed_sin(Fixed a);
+  Fixed fixed_cos(Fixed a);
+  Fixed fixed_atan2(Fixed y, Fixed x);
+}
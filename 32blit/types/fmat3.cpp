@@ -0,0 +1,73 @@
+/*! \file fmat3.cpp
+*/
+#include "fmat3.hpp"
+#include "fvec2.hpp"
+
+namespace blit {
+
+  FMat3::FMat3(const Mat3 &m) :
+    v00(m.v00), v01(m.v01), v02(m.v02),
+    v10(m.v10), v11(m.v11), v12(m.v12),
+    v20(m.v20), v21(m.v21), v22(m.v22) {
+  }
+
+  FMat3::operator Mat3() const {
+    Mat3 m;
+    m.v00 = float(v00); m.v01 = float(v01); m.v02 = float(v02);
+    m.v10 = float(v10); m.v11 = float(v11); m.v12 = float(v12);
+    m.v20 = float(v20); m.v21 = float(v21); m.v22 = float(v22);
+    return m;
+  }
+
+  FMat3 FMat3::identity() {
+    FMat3 m;
+    m.v00 = 1; m.v11 = 1; m.v22 = 1;
+    return m;
+  }
+
+  FMat3 FMat3::rotation(Fixed a) {
+    Fixed c = fixed_cos(a);
+    Fixed s = fixed_sin(a);
+
+    FMat3 r = FMat3::identity();
+
+    r.v00 = c;
+    r.v01 = -s;
+    r.v10 = s;
+    r.v11 = c;
+
+    return r;
+  }
+
+  FMat3 FMat3::translation(FVec2 v) {
+    FMat3 r = FMat3::identity();
+    r.v02 = v.x; r.v12 = v.y;
+    return r;
+  }
+
+  FMat3 FMat3::scale(FVec2 v) {
+    FMat3 r = FMat3::identity();
+    r.v00 = v.x; r.v11 = v.y;
+    return r;
+  }
+
+  void FMat3::inverse() {
+    FMat3 m(*this);
+
+    Fixed invdet = Fixed(1) /
+      ( m.v00 * (m.v11 * m.v22 - m.v21 * m.v12) -
+        m.v01 * (m.v10 * m.v22 - m.v12 * m.v20) +
+        m.v02 * (m.v10 * m.v21 - m.v11 * m.v20) );
+
+    this->v00 = (m.v11 * m.v22 - m.v21 * m.v12) * invdet;
+    this->v01 = (m.v02 * m.v21 - m.v01 * m.v22) * invdet;
+    this->v02 = (m.v01 * m.v12 - m.v02 * m.v11) * invdet;
+    this->v10 = (m.v12 * m.v20 - m.v10 * m.v22) * invdet;
+    this->v11 = (m.v00 * m.v22 - m.v02 * m.v20) * invdet;
+    this->v12 = (m.v10 * m.v02 - m.v00 * m.v12) * invdet;
+    this->v20 = (m.v10 * m.v21 - m.v20 * m.v11) * invdet;
+    this->v21 = (m.v20 * m.v01 - m.v00 * m.v21) * invdet;
+    this->v22 = (m.v00 * m.v11 - m.v10 * m.v01) * invdet;
+  }
+
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "fixed.hpp"
+#include "mat3.hpp"
+
+namespace blit {
+  struct FVec2;
+
+  /// Fixed point version of `Mat3`
+  struct FMat3 {
+    Fixed v00, v01, v02;
+    Fixed v10, v11, v12;
+    Fixed v20, v21, v22;
+
+    FMat3() = default;
+    explicit FMat3(const Mat3 &m);
+
+    explicit operator Mat3() const;
+
+    inline  FMat3& operator*= (const FMat3 &m) {
+      Fixed r00 = this->v00 * m.v00 + this->v01 * m.v10 + this->v02 * m.v20;
+      Fixed r01 = this->v00 * m.v01 + this->v01 * m.v11 + this->v02 * m.v21;
+      Fixed r02 = this->v00 * m.v02 + this->v01 * m.v12 + this->v02 * m.v22;
+      Fixed r10 = this->v10 * m.v00 + this->v11 * m.v10 + this->v12 * m.v20;
+      Fixed r11 = this->v10 * m.v01 + this->v11 * m.v11 + this->v12 * m.v21;
+      Fixed r12 = this->v10 * m.v02 + this->v11 * m.v12 + this->v12 * m.v22;
+      Fixed r20 = this->v20 * m.v00 + this->v21 * m.v10 + this->v22 * m.v20;
+      Fixed r21 = this->v20 * m.v01 + this->v21 * m.v11 + this->v22 * m.v21;
+      Fixed r22 = this->v20 * m.v02 + this->v21 * m.v12 + this->v22 * m.v22;
+
+      this->v00 = r00; this->v01 = r01; this->v02 = r02;
+      this->v10 = r10; this->v11 = r11; this->v12 = r12;
+      this->v20 = r20; this->v21 = r21; this->v22 = r22;
+
+      return *this;
+    }
+
+    static FMat3 identity();
+    static FMat3 rotation(Fixed a);
+    static FMat3 translation(FVec2 v);
+    static FMat3 scale(FVec2 v);
+    void inverse();
+  };
+
+  inline FMat3 operator*  (FMat3 lhs, const FMat3 &m) { lhs *= m; return lhs; }
+
+}
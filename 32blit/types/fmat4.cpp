@@ -0,0 +1,129 @@
+/*! \file fmat4.cpp
+*/
+#include "fmat4.hpp"
+#include "fvec3.hpp"
+
+namespace blit {
+
+  FMat4::FMat4(const Mat4 &m) :
+    v00(m.v00), v01(m.v01), v02(m.v02), v03(m.v03),
+    v10(m.v10), v11(m.v11), v12(m.v12), v13(m.v13),
+    v20(m.v20), v21(m.v21), v22(m.v22), v23(m.v23),
+    v30(m.v30), v31(m.v31), v32(m.v32), v33(m.v33) {
+  }
+
+  FMat4::operator Mat4() const {
+    Mat4 m;
+    m.v00 = float(v00); m.v01 = float(v01); m.v02 = float(v02); m.v03 = float(v03);
+    m.v10 = float(v10); m.v11 = float(v11); m.v12 = float(v12); m.v13 = float(v13);
+    m.v20 = float(v20); m.v21 = float(v21); m.v22 = float(v22); m.v23 = float(v23);
+    m.v30 = float(v30); m.v31 = float(v31); m.v32 = float(v32); m.v33 = float(v33);
+    return m;
+  }
+
+  FMat4 FMat4::identity() {
+    FMat4 m;
+    m.v00 = 1; m.v11 = 1; m.v22 = 1; m.v33 = 1;
+    return m;
+  }
+
+  /**
+   * Rotation around an axis
+   *
+   * \param[in] a Angle in degrees, as for `Mat4::rotation`.
+   * \param[in] v Axis of rotation.
+   */
+  FMat4 FMat4::rotation(Fixed a, FVec3 v) {
+    v.normalize();
+
+    a = a * fixed_pi / 180;
+
+    Fixed c = fixed_cos(a);
+    Fixed s = fixed_sin(a);
+    Fixed t = Fixed(1) - c;
+
+    FMat4 r = FMat4::identity();
+
+    r.v00 = v.x * v.x * t + c;
+    r.v01 = v.x * v.y * t - v.z * s;
+    r.v02 = v.x * v.z * t + v.y * s;
+    r.v10 = v.y * v.x * t + v.z * s;
+    r.v11 = v.y * v.y * t + c;
+    r.v12 = v.y * v.z * t - v.x * s;
+    r.v20 = v.z * v.x * t - v.y * s;
+    r.v21 = v.z * v.y * t + v.x * s;
+    r.v22 = v.z * v.z * t + c;
+
+    return r;
+  }
+
+  FMat4 FMat4::translation(FVec3 v) {
+    FMat4 r = FMat4::identity();
+    r.v03 = v.x; r.v13 = v.y; r.v23 = v.z;
+    return r;
+  }
+
+  FMat4 FMat4::scale(FVec3 v) {
+    FMat4 r = FMat4::identity();
+    r.v00 = v.x; r.v11 = v.y; r.v22 = v.z;
+    return r;
+  }
+
+  /**
+   * Perspective projection, see `Mat4::perspective`
+   *
+   * \param[in] fov Vertical field of view in degrees.
+   * \param[in] aspect Width / height of the viewport.
+   * \param[in] znear Distance to the near plane, must be > 0.
+   * \param[in] zfar Distance to the far plane.
+   */
+  FMat4 FMat4::perspective(Fixed fov, Fixed aspect, Fixed znear, Fixed zfar) {
+    Fixed half = fov * fixed_pi / 360;
+    Fixed f = fixed_cos(half) / fixed_sin(half);
+
+    FMat4 r;
+    r.v00 = f / aspect;
+    r.v11 = f;
+    r.v22 = (zfar + znear) / (znear - zfar);
+    r.v23 = (Fixed(2) * zfar * znear) / (znear - zfar);
+    r.v32 = -1;
+
+    return r;
+  }
+
+  void FMat4::inverse() {
+    FMat4 m(*this);
+
+    Fixed s0 = m.v00 * m.v11 - m.v10 * m.v01;
+    Fixed s1 = m.v00 * m.v12 - m.v10 * m.v02;
+    Fixed s2 = m.v00 * m.v13 - m.v10 * m.v03;
+    Fixed s3 = m.v01 * m.v12 - m.v11 * m.v02;
+    Fixed s4 = m.v01 * m.v13 - m.v11 * m.v03;
+    Fixed s5 = m.v02 * m.v13 - m.v12 * m.v03;
+    Fixed c5 = m.v22 * m.v33 - m.v32 * m.v23;
+    Fixed c4 = m.v21 * m.v33 - m.v31 * m.v23;
+    Fixed c3 = m.v21 * m.v32 - m.v31 * m.v22;
+    Fixed c2 = m.v20 * m.v33 - m.v30 * m.v23;
+    Fixed c1 = m.v20 * m.v32 - m.v30 * m.v22;
+    Fixed c0 = m.v20 * m.v31 - m.v30 * m.v21;
+
+    Fixed invdet = Fixed(1) / (s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0);
+
+    this->v00 = (m.v11 * c5 - m.v12 * c4 + m.v13 * c3) * invdet;
+    this->v01 = (-m.v01 * c5 + m.v02 * c4 - m.v03 * c3) * invdet;
+    this->v02 = (m.v31 * s5 - m.v32 * s4 + m.v33 * s3) * invdet;
+    this->v03 = (-m.v21 * s5 + m.v22 * s4 - m.v23 * s3) * invdet;
+    this->v10 = (-m.v10 * c5 + m.v12 * c2 - m.v13 * c1) * invdet;
+    this->v11 = (m.v00 * c5 - m.v02 * c2 + m.v03 * c1) * invdet;
+    this->v12 = (-m.v30 * s5 + m.v32 * s2 - m.v33 * s1) * invdet;
+    this->v13 = (m.v20 * s5 - m.v22 * s2 + m.v23 * s1) * invdet;
+    this->v20 = (m.v10 * c4 - m.v11 * c2 + m.v13 * c0) * invdet;
+    this->v21 = (-m.v00 * c4 + m.v01 * c2 - m.v03 * c0) * invdet;
+    this->v22 = (m.v30 * s4 - m.v31 * s2 + m.v33 * s0) * invdet;
+    this->v23 = (-m.v20 * s4 + m.v21 * s2 - m.v23 * s0) * invdet;
+    this->v30 = (-m.v10 * c3 + m.v11 * c1 - m.v12 * c0) * invdet;
+    this->v31 = (m.v00 * c3 - m.v01 * c1 + m.v02 * c0) * invdet;
+    this->v32 = (-m.v30 * s3 + m.v31 * s1 - m.v32 * s0) * invdet;
+    this->v33 = (m.v20 * s3 - m.v21 * s1 + m.v22 * s0) * invdet;
+  }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "fixed.hpp"
+#include "mat4.hpp"
+
+namespace blit {
+
+  struct FVec3;
+
+  /// Fixed point version of `Mat4`
+  struct FMat4 {
+    Fixed v00, v01, v02, v03;
+    Fixed v10, v11, v12, v13;
+    Fixed v20, v21, v22, v23;
+    Fixed v30, v31, v32, v33;
+
+    FMat4() = default;
+    explicit FMat4(const Mat4 &m);
+
+    explicit operator Mat4() const;
+
+    inline  FMat4& operator*= (const FMat4 &m) {
+      Fixed r00 = this->v00 * m.v00 + this->v01 * m.v10 + this->v02 * m.v20 + this->v03 * m.v30;
+      Fixed r01 = this->v00 * m.v01 + this->v01 * m.v11 + this->v02 * m.v21 + this->v03 * m.v31;
+      Fixed r02 = this->v00 * m.v02 + this->v01 * m.v12 + this->v02 * m.v22 + this->v03 * m.v32;
+      Fixed r03 = this->v00 * m.v03 + this->v01 * m.v13 + this->v02 * m.v23 + this->v03 * m.v33;
+      Fixed r10 = this->v10 * m.v00 + this->v11 * m.v10 + this->v12 * m.v20 + this->v13 * m.v30;
+      Fixed r11 = this->v10 * m.v01 + this->v11 * m.v11 + this->v12 * m.v21 + this->v13 * m.v31;
+      Fixed r12 = this->v10 * m.v02 + this->v11 * m.v12 + this->v12 * m.v22 + this->v13 * m.v32;
+      Fixed r13 = this->v10 * m.v03 + this->v11 * m.v13 + this->v12 * m.v23 + this->v13 * m.v33;
+      Fixed r20 = this->v20 * m.v00 + this->v21 * m.v10 + this->v22 * m.v20 + this->v23 * m.v30;
+      Fixed r21 = this->v20 * m.v01 + this->v21 * m.v11 + this->v22 * m.v21 + this->v23 * m.v31;
+      Fixed r22 = this->v20 * m.v02 + this->v21 * m.v12 + this->v22 * m.v22 + this->v23 * m.v32;
+      Fixed r23 = this->v20 * m.v03 + this->v21 * m.v13 + this->v22 * m.v23 + this->v23 * m.v33;
+      Fixed r30 = this->v30 * m.v00 + this->v31 * m.v10 + this->v32 * m.v20 + this->v33 * m.v30;
+      Fixed r31 = this->v30 * m.v01 + this->v31 * m.v11 + this->v32 * m.v21 + this->v33 * m.v31;
+      Fixed r32 = this->v30 * m.v02 + this->v31 * m.v12 + this->v32 * m.v22 + this->v33 * m.v32;
+      Fixed r33 = this->v30 * m.v03 + this->v31 * m.v13 + this->v32 * m.v23 + this->v33 * m.v33;
+
+      this->v00 = r00; this->v01 = r01; this->v02 = r02; this->v03 = r03;
+      this->v10 = r10; this->v11 = r11; this->v12 = r12; this->v13 = r13;
+      this->v20 = r20; this->v21 = r21; this->v22 = r22; this->v23 = r23;
+      this->v30 = r30; this->v31 = r31; this->v32 = r32; this->v33 = r33;
+
+      return *this;
+    }
+
+    static FMat4 identity();
+    static FMat4 rotation(Fixed a, FVec3 v);
+    static FMat4 translation(FVec3 v);
+    static FMat4 scale(FVec3 v);
+    static FMat4 perspective(Fixed fov, Fixed aspect, Fixed znear, Fixed zfar);
+    void inverse();
+  };
+
+  inline FMat4 operator*  (FMat4 lhs, const FMat4 &m) { lhs *= m; return lhs; }
+}
@@ -0,0 +1,56 @@
+/*! \file fvec2.cpp
+*/
+#include "fvec2.hpp"
+#include "fmat3.hpp"
+
+namespace blit {
+
+  void FVec2::transform(const FMat3 &m) {
+    Fixed tx = x; Fixed ty = y;
+    this->x = (m.v00 * tx + m.v01 * ty + m.v02);
+    this->y = (m.v10 * tx + m.v11 * ty + m.v12);
+  }
+
+  /**
+   * Divide vector by its length
+   */
+  void FVec2::normalize() {
+    Fixed d = this->length();
+    if (d.raw == 0)
+      return;
+
+    x /= d; y /= d;
+  }
+
+  /**
+   * Return length of vector, without overflowing for large components
+   *
+   * \return length
+   */
+  Fixed FVec2::length() const {
+    return Fixed::from_raw(int32_t(isqrt(uint64_t(int64_t(x.raw) * x.raw) + uint64_t(int64_t(y.raw) * y.raw))));
+  }
+
+  /**
+   * Rotate the vector
+   *
+   * \param a angle of rotation (radians)
+   */
+  void FVec2::rotate(Fixed a) {
+    Fixed c = fixed_cos(a);
+    Fixed s = fixed_sin(a);
+    Fixed rx = this->x * c - this->y * s;
+    Fixed ry = this->x * s + this->y * c;
+    this->x = rx;
+    this->y = ry;
+  }
+
+  Fixed FVec2::angle(FVec2 o) const {
+    return fixed_atan2(this->cross(o), this->dot(o));
+  }
+
+  Fixed FVec2::angle_to(FVec2 o) const {
+    return fixed_atan2(this->y - o.y, this->x - o.x);
+  }
+
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "fixed.hpp"
+#include "vec2.hpp"
+
+namespace blit {
+
+  struct FMat3;
+
+  /// Fixed point version of `Vec2`
+  struct FVec2 {
+    Fixed x;
+    Fixed y;
+
+    explicit constexpr FVec2(const Fixed x = 0, const Fixed y = 0) : x(x), y(y) {}
+    explicit constexpr FVec2(const Vec2 &v) : x(v.x), y(v.y) {}
+
+    explicit operator Vec2() const { return Vec2(float(x), float(y)); }
+
+    inline FVec2& operator-= (const FVec2 &a) { x -= a.x; y -= a.y; return *this; }
+    inline FVec2& operator+= (const FVec2 &a) { x += a.x; y += a.y; return *this; }
+    inline FVec2& operator*= (const Fixed a)  { x *= a;   y *= a;   return *this; }
+    inline FVec2& operator*= (const FMat3 &a) { this->transform(a); return *this; }
+    inline FVec2& operator*= (const FVec2 &a) { x *= a.x; y *= a.y; return *this; }
+    inline FVec2& operator/= (const Fixed a)  { x /= a;   y /= a;   return *this; }
+    inline FVec2& operator/= (const FVec2 &a) { x /= a.x; y /= a.y; return *this; }
+
+    void   transform(const FMat3 &m);
+
+    void   normalize();
+    Fixed  length() const;
+
+    inline Fixed  cross(const FVec2 &a) const { return Fixed::from_raw(int32_t((int64_t(x.raw) * a.y.raw - int64_t(y.raw) * a.x.raw) >> 16)); }
+    inline Fixed  dot(const FVec2 &a) const { return Fixed::from_raw(int32_t((int64_t(x.raw) * a.x.raw + int64_t(y.raw) * a.y.raw) >> 16)); }
+
+    void   rotate(Fixed a);
+
+    Fixed  angle(FVec2 o) const;
+    Fixed  angle_to(FVec2 o) const;
+  };
+
+  inline FVec2 operator-  (FVec2 lhs, const FVec2 &rhs) { lhs -= rhs; return lhs; }
+  inline FVec2 operator-  (const FVec2 &rhs) { return FVec2(-rhs.x, -rhs.y); }
+  inline FVec2 operator+  (FVec2 lhs, const FVec2 &rhs) { lhs += rhs; return lhs; }
+  inline FVec2 operator*  (FVec2 lhs, const Fixed a) { lhs *= a; return lhs; }
+  inline FVec2 operator*  (FVec2 lhs, const FMat3 &a) { lhs *= a; return lhs; }
+  inline FVec2 operator*  (FVec2 lhs, const FVec2 &rhs) { lhs *= rhs; return lhs; }
+  inline FVec2 operator/  (FVec2 lhs, const Fixed a) { lhs /= a; return lhs; }
+  inline FVec2 operator/  (FVec2 lhs, const FVec2 &rhs) { lhs /= rhs; return lhs; }
+
+}
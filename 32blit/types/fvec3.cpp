@@ -0,0 +1,35 @@
+/*! \file fvec3.cpp
+*/
+#include "fvec3.hpp"
+#include "fmat4.hpp"
+
+namespace blit {
+
+  void FVec3::transform(const FMat4 &m) {
+    Fixed w = m.v30 * this->x + m.v31 * this->y + m.v32 * this->z + m.v33;
+    Fixed tx = x; Fixed ty = y; Fixed tz = z;
+    this->x = (m.v00 * tx + m.v01 * ty + m.v02 * tz + m.v03) / w;
+    this->y = (m.v10 * tx + m.v11 * ty + m.v12 * tz + m.v13) / w;
+    this->z = (m.v20 * tx + m.v21 * ty + m.v22 * tz + m.v23) / w;
+  }
+
+  void FVec3::normalize() {
+    Fixed d = this->length();
+    if (d.raw == 0)
+      return;
+
+    x /= d; y /= d; z /= d;
+  }
+
+  Fixed FVec3::length() const {
+    uint64_t sq = uint64_t(int64_t(x.raw) * x.raw) + uint64_t(int64_t(y.raw) * y.raw) + uint64_t(int64_t(z.raw) * z.raw);
+    return Fixed::from_raw(int32_t(isqrt(sq)));
+  }
+
+  FVec3 FVec3::cross(const FVec3 &a) const { return FVec3(y * a.z - z * a.y, z * a.x - x * a.z, x * a.y - y * a.x); }
+
+  Fixed FVec3::dot(const FVec3 &a) const {
+    return Fixed::from_raw(int32_t((int64_t(x.raw) * a.x.raw + int64_t(y.raw) * a.y.raw + int64_t(z.raw) * a.z.raw) >> 16));
+  }
+
+}
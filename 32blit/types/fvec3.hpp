@@ -0,0 +1,45 @@
+#pragma once
+
+#include "fixed.hpp"
+#include "vec3.hpp"
+
+namespace blit {
+
+  struct FMat4;
+
+  /// Fixed point version of `Vec3`
+  struct FVec3 {
+    Fixed x;
+    Fixed y;
+    Fixed z;
+
+    constexpr FVec3(const Fixed x = 0, const Fixed y = 0, const Fixed z = 0) : x(x), y(y), z(z) {}
+    explicit constexpr FVec3(const Vec3 &v) : x(v.x), y(v.y), z(v.z) {}
+
+    explicit operator Vec3() const { return Vec3(float(x), float(y), float(z)); }
+
+    inline FVec3& operator-= (const FVec3 &a) { x -= a.x; y -= a.y; z -= a.z; return *this; }
+    inline FVec3& operator+= (const FVec3 &a) { x += a.x; y += a.y; z += a.z; return *this; }
+    inline FVec3& operator*= (const Fixed a)  { x *= a;   y *= a;   z *= a;   return *this; }
+    inline FVec3& operator*= (const FMat4 &a) { this->transform(a); return *this; }
+    inline FVec3& operator*= (const FVec3 &a) { x *= a.x; y *= a.y; z *= a.z; return *this; }
+    inline FVec3& operator/= (const Fixed a)  { x /= a;   y /= a;   z /= a;   return *this; }
+    inline FVec3& operator/= (const FVec3 &a) { x /= a.x; y /= a.y; z /= a.z; return *this; }
+
+    void   transform(const FMat4 &m);
+    void   normalize();
+    Fixed  length() const;
+    FVec3  cross(const FVec3 &a) const;
+    Fixed  dot(const FVec3 &a) const;
+  };
+
+  inline FVec3 operator-  (FVec3 lhs, const FVec3 &rhs) { lhs -= rhs; return lhs; }
+  inline FVec3 operator-  (const FVec3 &rhs) { return FVec3(-rhs.x, -rhs.y, -rhs.z); }
+  inline FVec3 operator+  (FVec3 lhs, const FVec3 &rhs) { lhs += rhs; return lhs; }
+  inline FVec3 operator*  (FVec3 lhs, const Fixed a) { lhs *= a; return lhs; }
+  inline FVec3 operator*  (FVec3 lhs, const FMat4 &a) { lhs *= a; return lhs; }
+  inline FVec3 operator*  (FVec3 lhs, const FVec3 &rhs) { lhs *= rhs; return lhs; }
+  inline FVec3 operator/  (FVec3 lhs, const Fixed a) { lhs /= a; return lhs; }
+  inline FVec3 operator/  (FVec3 lhs, const FVec3 &rhs) { lhs /= rhs; return lhs; }
+
+}
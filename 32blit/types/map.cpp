@@ -1,6 +1,8 @@
 /*! \file mat.cpp
 */
 #include <algorithm>
+#include <climits>
+#include <cmath>
 #include "map.hpp"
 
 namespace blit {
@@ -29,63 +31,131 @@ namespace blit {
   }
 
   void MapLayer::mipmap_texture_span(Surface *dest, Point s, uint16_t c, Surface *sprites, Vec2 swc, Vec2 ewc) {
+    if (sprites->mipmaps.empty()) {
+      texture_span(dest, s, c, sprites, swc, ewc);
+      return;
+    }
+
     // calculate the mipmap index to use for drawing
     float span_length = (ewc - swc).length();
     float mipmap = ((span_length / float(c)) / 2.0f);
-    uint16_t mipmap_index = floorf(mipmap);
+    uint16_t mipmap_index = mipmap > 0.0f ? floorf(mipmap) : 0;
     uint8_t blend = (mipmap - floorf(mipmap)) * 255;
 
-    if (mipmap_index >= sprites->mipmaps.size()) {
-        mipmap_index = int32_t(sprites->mipmaps.size()) - 1 < 0 ? 0 : uint16_t(sprites->mipmaps.size() - 1);
-    }
+    if (mipmap_index >= sprites->mipmaps.size())
+      mipmap_index = uint16_t(sprites->mipmaps.size() - 1);
+
+    uint8_t alpha = dest->alpha;
 
-    dest->alpha = 255;
     texture_span(dest, s, c, sprites->mipmaps[mipmap_index], swc, ewc, mipmap_index);
 
     if (++mipmap_index < sprites->mipmaps.size()) {
       dest->alpha = blend;
       texture_span(dest, s, c, sprites->mipmaps[mipmap_index], swc, ewc, mipmap_index);
     }
+
+    dest->alpha = alpha;
   }
 
   void MapLayer::texture_span(Surface *dest, Point s, uint16_t c, Surface *sprites, Vec2 swc, Vec2 ewc, uint8_t mipmap_index) {
-    BlitBlendFunc bbf = dest->bbf;
+    if (!c)
+      return;
 
-    int world_size = map->bounds.w * 8;
-    int tile_size = 8 >> mipmap_index;
+    auto lookup = [](void *data, int32_t x, int32_t y, uint8_t &transform) {
+      auto layer = (MapLayer *)data;
+      int32_t ti = layer->map->tile_index(Point(x, y));
+
+      if (ti == -1)
+        return int32_t(-1);
+
+      transform = size_t(ti) < layer->transforms.size() ? layer->transforms[ti] : 0;
+      return int32_t(layer->tiles[ti]) - 1;
+    };
 
-    Vec2 wc = swc;
     Vec2 dwc = (ewc - swc) / float(c);
-    for (int x = s.x; x < s.x + c; x++) {
-      if (wc.x >= 0 && wc.x < world_size && wc.y >= 0 && wc.y < world_size) {
-        Point pt(wc.x / 8, wc.y / 8); // tile point
 
-        int16_t tile_id = tile_at(pt) - 1;
+    texture_tile_span(
+      dest, dest->offset(s.x, s.y), c, sprites,
+      int32_t(swc.x * 65536.0f), int32_t(swc.y * 65536.0f),
+      int32_t(dwc.x * 65536.0f), int32_t(dwc.y * 65536.0f),
+      mipmap_index, 16, lookup, this
+    );
+  }
 
-        if (tile_id != -1) {
-          Point sp(
-            (tile_id & 0b1111) * tile_size,
-            (tile_id / 16) * tile_size
-          ); // sprite sheet coordinates
+  // number of steps of d from w before the 8 pixel tile changes
+  static uint32_t steps_in_tile(int32_t w, int32_t d) {
+    const int tile_shift = 16 + 3;
 
-          Point uv(
-            (uint8_t(wc.x) & 0b111) >> mipmap_index,
-            (uint8_t(wc.y) & 0b111) >> mipmap_index
-          ); // texture coordinates
+    if (d > 0)
+      return ((1 << tile_shift) - (w & ((1 << tile_shift) - 1)) + d - 1) / d;
 
-          // apply uv transform for tile
-          uint8_t transform = transform_at(pt);
-          if (transform & 0b010) { uv.y = (tile_size - 1) - uv.y; }
-          if (transform & 0b100) { uv.x = (tile_size - 1) - uv.x; }
-          if (transform & 0b001) { uint8_t tmp = uv.x; uv.x = uv.y; uv.y = tmp; }
+    if (d < 0)
+      return (w & ((1 << tile_shift) - 1)) / -d + 1;
 
-          Point t = sp + uv;
+    return UINT32_MAX;
+  }
 
-          bbf(sprites, sprites->offset(t), dest, dest->offset(x, s.y), 1, 1);
+  /**
+   * Draw a span of 8x8 tiles at an arbitrary scale and angle.
+   *
+   * World coordinates are stepped in 16.16 fixed point and the tile is only
+   * looked up when the span moves into a new one. Each tile's part of the
+   * span is drawn with a single call to the destination's affine blend,
+   * with the tile transform folded into the texture coordinates.
+   *
+   * \param[in] dest Destination surface.
+   * \param[in] doff Offset of the first pixel in the destination.
+   * \param[in] cnt Number of pixels to draw.
+   * \param[in] sprites Sprite sheet, or one of its mipmaps.
+   * \param[in] wx World x coordinate of the first pixel in 16.16 fixed point.
+   * \param[in] wy World y coordinate of the first pixel in 16.16 fixed point.
+   * \param[in] dwx Step in world x per pixel.
+   * \param[in] dwy Step in world y per pixel.
+   * \param[in] mipmap_index Mipmap level of `sprites`, tiles are 8 >> mipmap_index pixels.
+   * \param[in] columns Tiles per row of `sprites`, tile ids are numbered left to right then top to bottom.
+   * \param[in] lookup Function to find the tile at a tile coordinate.
+   * \param[in] data Passed to `lookup`.
+   */
+  void texture_tile_span(Surface *dest, uint32_t doff, uint32_t cnt, Surface *sprites, int32_t wx, int32_t wy, int32_t dwx, int32_t dwy, uint8_t mipmap_index, int32_t columns, TileSpanLookup lookup, void *data) {
+    const int tile_shift = 16 + 3;
+    const int tile_size = 8 >> mipmap_index;
+    const int32_t tile_mask = (1 << tile_shift) - 1;
+    const int32_t tile_max = (tile_size << 16) - 1;
+
+    while (cnt) {
+      int32_t tx = wx >> tile_shift;
+      int32_t ty = wy >> tile_shift;
+
+      uint32_t len = std::min({steps_in_tile(wx, dwx), steps_in_tile(wy, dwy), cnt});
+
+      uint8_t transform = 0;
+      int32_t tile_id = tile_size ? lookup(data, tx, ty, transform) : -1;
+      Rect src_r((tile_id % columns) * tile_size, (tile_id / columns) * tile_size, tile_size, tile_size);
+
+      if (tile_id >= 0 && src_r.x + src_r.w <= sprites->bounds.w && src_r.y + src_r.h <= sprites->bounds.h) {
+        // texture coordinates of the first and last pixel inside the tile
+        int32_t lx = wx & tile_mask, ly = wy & tile_mask;
+        int32_t su = lx >> mipmap_index, sv = ly >> mipmap_index;
+        int32_t eu = (lx + int32_t(len - 1) * dwx) >> mipmap_index;
+        int32_t ev = (ly + int32_t(len - 1) * dwy) >> mipmap_index;
+
+        if (transform & 0b010) { sv = tile_max - sv; ev = tile_max - ev; }
+        if (transform & 0b100) { su = tile_max - su; eu = tile_max - eu; }
+        if (transform & 0b001) { std::swap(su, sv); std::swap(eu, ev); }
+
+        int32_t du = 0, dv = 0;
+        if (len > 1) {
+          du = (eu - su) / int32_t(len - 1);
+          dv = (ev - sv) / int32_t(len - 1);
         }
+
+        dest->abf(sprites, src_r, dest, doff, len, su + (src_r.x << 16), sv + (src_r.y << 16), du, dv, false);
       }
 
-      wc += dwc;
+      doff += len;
+      cnt -= len;
+      wx += int32_t(len) * dwx;
+      wy += int32_t(len) * dwy;
     }
   }
 
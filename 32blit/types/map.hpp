@@ -11,6 +11,12 @@
 namespace blit {
   struct Map;
 
+  // finds the sprite index and transform of the tile at x, y for
+  // texture_tile_span, returns -1 if there is no tile
+  using TileSpanLookup = int32_t(*)(void *data, int32_t x, int32_t y, uint8_t &transform);
+
+  void texture_tile_span(Surface *dest, uint32_t doff, uint32_t cnt, Surface *sprites, int32_t wx, int32_t wy, int32_t dwx, int32_t dwy, uint8_t mipmap_index, int32_t columns, TileSpanLookup lookup, void *data);
+
   struct MapLayer {
     Map *map;
 
@@ -58,6 +58,28 @@ namespace blit {
     return r;
   }
 
+  /**
+   * Perspective projection looking down -z, mapping the visible depth range
+   * to -1 (near) .. 1 (far)
+   *
+   * \param[in] fov Vertical field of view in degrees.
+   * \param[in] aspect Width / height of the viewport.
+   * \param[in] znear Distance to the near plane, must be > 0.
+   * \param[in] zfar Distance to the far plane.
+   */
+  Mat4 Mat4::perspective(float fov, float aspect, float znear, float zfar) {
+    float f = 1.0f / tanf(fov * (blit::pi / 180.0f) * 0.5f);
+
+    Mat4 r;
+    r.v00 = f / aspect;
+    r.v11 = f;
+    r.v22 = (zfar + znear) / (znear - zfar);
+    r.v23 = (2.0f * zfar * znear) / (znear - zfar);
+    r.v32 = -1.0f;
+
+    return r;
+  }
+
   void Mat4::inverse() {
     Mat4 m(*this);
 
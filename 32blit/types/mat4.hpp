@@ -42,6 +42,7 @@ namespace blit {
     static Mat4 rotation(float a, Vec3 v);
     static Mat4 translation(Vec3 v);
     static Mat4 scale(Vec3 v);
+    static Mat4 perspective(float fov, float aspect, float znear, float zfar);
     void inverse();
   };
 
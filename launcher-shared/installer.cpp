@@ -0,0 +1,224 @@
+#include <algorithm>
+#include <cstring>
+
+#include "installer.hpp"
+
+void BlitInstaller::init(InstallerFlash &flash, uint8_t *buffer, uint32_t buffer_size, uint32_t stream_len, bool relocatable, uint32_t reloc_base, OffsetCallback get_offset) {
+  this->flash = &flash;
+  this->buffer = buffer;
+  this->buffer_size = buffer_size;
+  this->stream_len = stream_len;
+  this->reloc_base = reloc_base;
+  this->get_offset = get_offset;
+
+  buffer_used = 0;
+  stream_offset = 0;
+  word_used = 0;
+  num_relocs = 0;
+  relocation_offsets.clear();
+  cur_reloc = 0;
+  reloc_byte = reloc_carry = 0;
+  data_len = data_written = 0;
+  flash_offset = ~0u;
+
+  if(relocatable)
+    state = State::Header;
+  else if(!start_data())
+    state = State::Error;
+  else
+    state = stream_len ? State::Data : State::Done;
+}
+
+bool BlitInstaller::write(const uint8_t *data, uint32_t len) {
+  // don't read past the end of the file
+  len = std::min(len, stream_len - stream_offset);
+
+  while(len && (state == State::Header || state == State::Relocs)) {
+    // collect a word
+    auto copy_len = std::min(len, 4 - word_used);
+    memcpy(word_buf + word_used, data, copy_len);
+    word_used += copy_len;
+    data += copy_len;
+    len -= copy_len;
+    stream_offset += copy_len;
+
+    if(word_used < 4)
+      break;
+
+    word_used = 0;
+
+    uint32_t word;
+    memcpy(&word, word_buf, 4);
+
+    if(state == State::Header) {
+      if(stream_offset == 4) {
+        if(word != 0x4F4C4552 /*RELO*/) {
+          state = State::Error;
+          return false;
+        }
+        continue;
+      }
+
+      num_relocs = word;
+
+      if(num_relocs > (stream_len - 8) / 4) {
+        state = State::Error;
+        return false;
+      }
+
+      relocation_offsets.reserve(num_relocs);
+      state = State::Relocs;
+    } else
+      relocation_offsets.push_back(word - reloc_base);
+
+    if(relocation_offsets.size() == num_relocs) {
+      if(!start_data()) {
+        state = State::Error;
+        return false;
+      }
+      state = State::Data;
+    }
+  }
+
+  if(state == State::Error)
+    return false;
+
+  while(len && state == State::Data) {
+    auto copy_len = std::min(len, buffer_size - buffer_used);
+    memcpy(buffer + buffer_used, data, copy_len);
+    buffer_used += copy_len;
+    data += copy_len;
+    len -= copy_len;
+    stream_offset += copy_len;
+
+    // write if full or end of file
+    if(buffer_used == buffer_size || stream_offset == stream_len) {
+      if(!flush_buffer()) {
+        state = State::Error;
+        return false;
+      }
+    }
+  }
+
+  if(stream_offset == stream_len && state == State::Data)
+    state = State::Done;
+
+  return true;
+}
+
+bool BlitInstaller::is_complete() const {
+  return state == State::Done;
+}
+
+uint32_t BlitInstaller::get_stream_offset() const {
+  return stream_offset;
+}
+
+uint32_t BlitInstaller::get_stream_length() const {
+  return stream_len;
+}
+
+uint32_t BlitInstaller::get_data_length() const {
+  return data_len;
+}
+
+uint32_t BlitInstaller::get_flash_offset() const {
+  return flash_offset;
+}
+
+bool BlitInstaller::start_data() {
+  data_len = stream_len - stream_offset;
+
+  flash_offset = get_offset(data_len);
+
+  if(flash_offset == ~0u || flash_offset % flash->get_erase_size())
+    return false;
+
+  // relocations are applied in order as the data streams past, any out of order or out of range would leave the image corrupt
+  uint32_t min_offset = 0;
+  for(auto &off : relocation_offsets) {
+    if(off < min_offset || off > data_len || data_len - off < 4)
+      return false;
+
+    min_offset = off + 4;
+  }
+
+  erased_end = flash_offset;
+
+  return true;
+}
+
+bool BlitInstaller::flush_buffer() {
+  auto offset = flash_offset + data_written;
+  auto len = buffer_used;
+
+  apply_relocs(data_written, buffer, len);
+
+  // pad the last page
+  auto program_size = flash->get_program_size();
+  auto padded_len = ((len + program_size - 1) / program_size) * program_size;
+
+  if(padded_len > buffer_size)
+    return false;
+
+  memset(buffer + len, 0xFF, padded_len - len);
+
+  // erase as we go instead of all at the start
+  while(erased_end < offset + padded_len) {
+    if(!flash->erase(erased_end))
+      return false;
+
+    erased_end += flash->get_erase_size();
+  }
+
+  if(!flash->program(offset, buffer, padded_len))
+    return false;
+
+  // verify
+  uint8_t verify_buf[256];
+
+  for(uint32_t off = 0; off < len; off += sizeof(verify_buf)) {
+    auto verify_len = std::min(len - off, uint32_t(sizeof(verify_buf)));
+
+    if(!flash->read(offset + off, verify_buf, verify_len) || memcmp(verify_buf, buffer + off, verify_len) != 0)
+      return false;
+  }
+
+  data_written += len;
+  buffer_used = 0;
+
+  return true;
+}
+
+// apply relocations to a chunk of a file, offsets have been checked by start_data
+void BlitInstaller::apply_relocs(uint32_t data_offset, uint8_t *data, uint32_t len) {
+  auto end = data_offset + len;
+
+  for(; cur_reloc < relocation_offsets.size(); cur_reloc++) {
+    auto off = relocation_offsets[cur_reloc];
+
+    if(off >= end)
+      break;
+
+    if(reloc_byte == 0 && off + 4 <= end) {
+      uint32_t val;
+      memcpy(&val, data + off - data_offset, 4);
+      val += flash_offset;
+      memcpy(data + off - data_offset, &val, 4);
+      continue;
+    }
+
+    // split across chunks, add a byte at a time and carry into the next chunk
+    for(; reloc_byte < 4 && off + reloc_byte < end; reloc_byte++) {
+      auto &b = data[off + reloc_byte - data_offset];
+      uint32_t sum = b + ((flash_offset >> (reloc_byte * 8)) & 0xFF) + reloc_carry;
+      b = uint8_t(sum);
+      reloc_carry = sum >> 8;
+    }
+
+    if(reloc_byte < 4)
+      break;
+
+    reloc_byte = reloc_carry = 0;
+  }
+}
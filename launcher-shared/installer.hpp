@@ -0,0 +1,72 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// platform-specific flash access used by BlitInstaller
+class InstallerFlash {
+public:
+  virtual ~InstallerFlash() = default;
+
+  // size of an erase block, offsets passed to erase are aligned to this
+  virtual uint32_t get_erase_size() const = 0;
+  // size of a program page, program lengths are a multiple of this
+  virtual uint32_t get_program_size() const = 0;
+
+  virtual bool erase(uint32_t offset) = 0;
+  virtual bool program(uint32_t offset, const uint8_t *data, uint32_t len) = 0;
+  virtual bool read(uint32_t offset, uint8_t *data, uint32_t len) = 0;
+};
+
+// writes a .blit to flash as it is received, applying relocations and erasing only as far as has been written
+class BlitInstaller final {
+public:
+  // called once the data length is known (after relocations), should return the flash offset or ~0 on failure
+  using OffsetCallback = std::function<uint32_t(uint32_t data_len)>;
+
+  void init(InstallerFlash &flash, uint8_t *buffer, uint32_t buffer_size, uint32_t stream_len, bool relocatable, uint32_t reloc_base, OffsetCallback get_offset);
+
+  // data can be any length, returns false on error
+  bool write(const uint8_t *data, uint32_t len);
+
+  bool is_complete() const;
+
+  // bytes of the stream (including relocations) consumed
+  uint32_t get_stream_offset() const;
+  uint32_t get_stream_length() const;
+
+  // length of the data written to flash
+  uint32_t get_data_length() const;
+  uint32_t get_flash_offset() const;
+
+private:
+  enum class State {Header, Relocs, Data, Done, Error};
+
+  bool start_data();
+  bool flush_buffer();
+  void apply_relocs(uint32_t data_offset, uint8_t *data, uint32_t len);
+
+  InstallerFlash *flash = nullptr;
+  OffsetCallback get_offset;
+
+  State state = State::Error;
+
+  uint8_t *buffer = nullptr;
+  uint32_t buffer_size = 0, buffer_used = 0;
+
+  uint32_t stream_len = 0, stream_offset = 0;
+
+  // RELO header
+  uint32_t reloc_base = 0;
+  uint8_t word_buf[4];
+  uint32_t word_used = 0;
+  uint32_t num_relocs = 0;
+  std::vector<uint32_t> relocation_offsets;
+  size_t cur_reloc = 0;
+  // progress through a relocation split between two buffers
+  uint32_t reloc_byte = 0, reloc_carry = 0;
+
+  uint32_t data_len = 0, data_written = 0;
+  uint32_t flash_offset = ~0u;
+  uint32_t erased_end = 0;
+};
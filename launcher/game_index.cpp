@@ -0,0 +1,134 @@
+#include <algorithm>
+#include <cstring>
+
+#include "game_index.hpp"
+
+#include "engine/api_private.hpp"
+#include "engine/file.hpp"
+
+using namespace blit;
+
+static const char index_magic[8]{'B', 'L', 'I', 'N', 'D', 'E', 'X', '2'};
+
+// name length, size, can_launch, metadata offset and title length
+static const uint32_t min_entry_size = 1 + 4 + 1 + 4 + 1;
+
+static std::string get_index_path(const std::string &directory) {
+  return directory == "/" ? ".launcher-index" : directory + "/.launcher-index";
+}
+
+bool read_game_index(const std::string &directory, std::vector<GameIndexEntry> &entries) {
+  entries.clear();
+
+  File file(get_index_path(directory));
+
+  if(!file.is_open())
+    return false;
+
+  auto length = file.get_length();
+
+  if(length < sizeof(index_magic) + 8)
+    return false;
+
+  auto buf = new uint8_t[length];
+
+  if(file.read(0, length, (char *)buf) != int32_t(length) || memcmp(buf, index_magic, sizeof(index_magic)) != 0) {
+    delete[] buf;
+    return false;
+  }
+
+  uint32_t offset = sizeof(index_magic);
+
+  // can_launch depends on the firmware, so an index from another version is stale
+  uint16_t version_major, version_minor;
+  memcpy(&version_major, buf + offset, 2);
+  memcpy(&version_minor, buf + offset + 2, 2);
+  offset += 4;
+
+  uint32_t count;
+  memcpy(&count, buf + offset, 4);
+  offset += 4;
+
+  // also keeps a corrupt count from reserving too much
+  if(version_major != api.version_major || version_minor != api.version_minor || count > (length - offset) / min_entry_size) {
+    delete[] buf;
+    return false;
+  }
+
+  auto read_string = [&](std::string &str) {
+    if(offset + 1 > length || offset + 1 + buf[offset] > length)
+      return false;
+
+    str.assign((const char *)buf + offset + 1, buf[offset]);
+    offset += 1 + buf[offset];
+    return true;
+  };
+
+  entries.reserve(count);
+
+  for(uint32_t i = 0; i < count; i++) {
+    GameIndexEntry entry;
+
+    if(!read_string(entry.name) || offset + 9 > length)
+      break;
+
+    memcpy(&entry.size, buf + offset, 4);
+    entry.can_launch = buf[offset + 4];
+    memcpy(&entry.metadata_offset, buf + offset + 5, 4);
+    offset += 9;
+
+    if(!read_string(entry.title))
+      break;
+
+    entries.push_back(entry);
+  }
+
+  delete[] buf;
+
+  // truncated, assume the whole thing is bad
+  if(entries.size() != count) {
+    entries.clear();
+    return false;
+  }
+
+  return true;
+}
+
+bool write_game_index(const std::string &directory, const std::vector<GameIndexEntry> &entries) {
+  std::vector<uint8_t> buf(index_magic, index_magic + sizeof(index_magic));
+
+  auto write_u32 = [&buf](uint32_t val) {
+    auto ptr = (uint8_t *)&val;
+    buf.insert(buf.end(), ptr, ptr + 4);
+  };
+
+  auto write_string = [&buf](const std::string &str) {
+    auto len = std::min(str.length(), size_t(255));
+    buf.push_back(len);
+    buf.insert(buf.end(), str.begin(), str.begin() + len);
+  };
+
+  auto write_u16 = [&buf](uint16_t val) {
+    auto ptr = (uint8_t *)&val;
+    buf.insert(buf.end(), ptr, ptr + 2);
+  };
+
+  write_u16(api.version_major);
+  write_u16(api.version_minor);
+  write_u32(entries.size());
+
+  for(auto &entry : entries) {
+    write_string(entry.name);
+    write_u32(entry.size);
+    buf.push_back(entry.can_launch);
+    write_u32(entry.metadata_offset);
+    write_string(entry.title);
+  }
+
+  File file(get_index_path(directory), OpenMode::write);
+
+  if(!file.is_open())
+    return false;
+
+  return file.write(0, buf.size(), (const char *)buf.data()) == int32_t(buf.size());
+}
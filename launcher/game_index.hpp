@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// cached per-directory file info, so that the launcher doesn't need to open every file to build the list
+struct GameIndexEntry {
+  std::string name;
+  uint32_t size;
+
+  uint8_t can_launch; // CanLaunchResult
+  uint32_t metadata_offset; // offset of BLITMETA in the file, 0 if none
+  std::string title;
+};
+
+bool read_game_index(const std::string &directory, std::vector<GameIndexEntry> &entries);
+bool write_game_index(const std::string &directory, const std::vector<GameIndexEntry> &entries);
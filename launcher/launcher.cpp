@@ -13,6 +13,7 @@
 #include "executable.hpp"
 #include "metadata.hpp"
 #include "dialog.hpp"
+#include "game_index.hpp"
 
 #include "theme.hpp"
 
@@ -42,13 +43,40 @@ static Point game_actions_offset(game_info_offset.x + 128 + 8, 28);
 static float directory_list_scroll_offset = 0.0f;
 
 static std::vector<GameInfo> game_list;
+static std::string game_list_directory;
+static bool game_list_index_dirty = false;
+static std::vector<GameIndexEntry> invalid_files; // not listed, but kept in the index so they aren't checked again
 static std::list<DirectoryInfo> directory_list;
 static std::list<DirectoryInfo>::iterator current_directory;
 
 static SortBy file_sort = SortBy::name;
 
 static GameInfo selected_game;
-static BlitGameMetadata selected_game_metadata;
+static BlitGameMetadata selected_game_metadata; // surfaces are owned by the cache
+static bool selected_game_metadata_pending = false;
+static uint32_t selected_game_changed_time = 0;
+
+// recently decoded metadata/images, so scrolling back and forth doesn't reload them
+struct CachedMetadata {
+  std::string filename;
+  uint32_t size = 0;
+  bool loaded = false;
+  uint32_t last_used = 0;
+  BlitGameMetadata metadata;
+};
+
+#ifdef PICO_BUILD
+static const int metadata_cache_size = 3;
+#else
+static const int metadata_cache_size = 5;
+#endif
+static const int metadata_prefetch_distance = (metadata_cache_size - 1) / 2;
+
+// how long the selection has to stay the same before loading, avoids loading everything when scrolling quickly
+static const uint32_t metadata_load_delay_ms = 100;
+
+static CachedMetadata metadata_cache[metadata_cache_size];
+static uint32_t metadata_cache_counter = 0;
 
 static Surface *spritesheet;
 static Surface *screenshot;
@@ -82,7 +110,18 @@ static void insertion_sort(Iterator first, Iterator last, Compare comp) {
   }
 }
 
-static bool parse_file_metadata(const std::string &filename, BlitGameMetadata &metadata, bool unpack_images = false) {
+static std::string get_file_ext(const std::string &filename) {
+  auto last_dot = filename.find_last_of('.');
+
+  auto ext = last_dot == std::string::npos ? "" : filename.substr(last_dot + 1);
+
+  for(auto &c : ext)
+    c = tolower(c);
+
+  return ext;
+}
+
+static bool parse_file_metadata(const std::string &filename, BlitGameMetadata &metadata, bool unpack_images = false, uint32_t *metadata_offset = nullptr) {
   blit::File f(filename);
 
   if(!f.is_open())
@@ -91,24 +130,36 @@ static bool parse_file_metadata(const std::string &filename, BlitGameMetadata &m
   uint32_t offset = 0;
 
   uint8_t buf[sizeof(BlitGameHeader)];
-  auto read = f.read(offset, sizeof(buf), (char *)&buf);
+  int32_t read = 0;
 
-  // skip relocation data
-  if(memcmp(buf, "RELO", 4) == 0) {
-    uint32_t num_relocs;
-    f.read(4, 4, (char *)&num_relocs);
+  if(metadata_offset && *metadata_offset) {
+    // already know where the metadata is
+    offset = *metadata_offset;
+    read = f.read(offset, 10, (char *)buf);
+  }
 
-    offset = num_relocs * 4 + 8;
-    // re-read header
+  // no offset, or it was wrong
+  if(read < 10 || memcmp(buf, "BLITMETA", 8) != 0) {
+    offset = 0;
     read = f.read(offset, sizeof(buf), (char *)&buf);
-  }
 
-  // game header - skip to metadata
-  if(memcmp(buf, "BLITMETA", 8) != 0) {
-    auto &header = *(BlitGameHeader *)buf;
-    if(read == sizeof(BlitGameHeader) && header.magic == blit_game_magic) {
-      offset += (header.end & 0x1FFFFFF);
-      read = f.read(offset, 10, (char *)buf);
+    // skip relocation data
+    if(memcmp(buf, "RELO", 4) == 0) {
+      uint32_t num_relocs;
+      f.read(4, 4, (char *)&num_relocs);
+
+      offset = num_relocs * 4 + 8;
+      // re-read header
+      read = f.read(offset, sizeof(buf), (char *)&buf);
+    }
+
+    // game header - skip to metadata
+    if(memcmp(buf, "BLITMETA", 8) != 0) {
+      auto &header = *(BlitGameHeader *)buf;
+      if(read == sizeof(BlitGameHeader) && header.magic == blit_game_magic) {
+        offset += (header.end & 0x1FFFFFF);
+        read = f.read(offset, 10, (char *)buf);
+      }
     }
   }
 
@@ -121,6 +172,9 @@ static bool parse_file_metadata(const std::string &filename, BlitGameMetadata &m
 
     parse_metadata(reinterpret_cast<char *>(metadata_buf), metadata_len, metadata, unpack_images);
 
+    if(metadata_offset)
+      *metadata_offset = offset;
+
     return true;
   }
 
@@ -131,6 +185,11 @@ static void sort_file_list() {
     using Iterator = std::vector<GameInfo>::iterator;
     using Compare = bool(const GameInfo &, const GameInfo &);
 
+    // keep the same file selected
+    std::string selected_filename;
+    if(selected_menu_item < (int)game_list.size())
+      selected_filename = game_list[selected_menu_item].filename;
+
     if (file_sort == SortBy::name) {
       // Sort by filename
       insertion_sort<Iterator, Compare>(game_list.begin(), game_list.end(), [](const auto &a, const auto &b) { return a.title < b.title; });
@@ -140,11 +199,134 @@ static void sort_file_list() {
       // Sort by filesize
       insertion_sort<Iterator, Compare>(game_list.begin(), game_list.end(), [](const auto &a, const auto &b) { return a.size < b.size; });
     }
+
+    for(auto it = game_list.begin(); it != game_list.end(); ++it) {
+      if(it->filename == selected_filename) {
+        selected_menu_item = it - game_list.begin();
+        break;
+      }
+    }
+}
+
+// reads the title/compatibility for a file that wasn't in the index
+static void load_game_info_metadata(GameInfo &game) {
+  if(!game.metadata_pending)
+    return;
+
+  game.metadata_pending = false;
+  game_list_index_dirty = true;
+
+  BlitGameMetadata meta;
+
+  if(game.type == GameType::game) {
+    auto result = api.can_launch(game.filename.c_str());
+    game.can_launch = result == CanLaunchResult::Success;
+
+    // only the extension was checked when listing, hide anything that isn't actually a .blit
+    if(!game.can_launch && result != CanLaunchResult::IncompatibleBlit) {
+      auto slash = game.filename.find_last_of('/');
+
+      GameIndexEntry entry;
+      entry.name = slash == std::string::npos ? game.filename : game.filename.substr(slash + 1);
+      entry.size = game.size;
+      entry.can_launch = uint8_t(result);
+      entry.metadata_offset = 0;
+      invalid_files.push_back(entry);
+
+      game.invalid = true;
+      return;
+    }
+
+    if(parse_file_metadata(game.filename, meta, false, &game.metadata_offset))
+      game.title = meta.title;
+  } else if(game.type == GameType::file) {
+    // check for a metadata file (fall back to handler's metadata)
+    auto meta_filename = game.filename + ".blmeta";
+    if(parse_file_metadata(meta_filename, meta))
+      game.title = meta.title;
+  }
+}
+
+// drop anything load_game_info_metadata found to be invalid
+static void remove_invalid_games() {
+  for(auto it = game_list.begin(); it != game_list.end();) {
+    if(!it->invalid) {
+      ++it;
+      continue;
+    }
+
+    // keep the same item selected
+    if(it - game_list.begin() < selected_menu_item)
+      selected_menu_item--;
+
+    it = game_list.erase(it);
+  }
+
+  int total_items = (int)game_list.size();
+  if(selected_menu_item >= total_items)
+    selected_menu_item = std::max(0, total_items - 1);
+}
+
+static void save_game_list_index() {
+  if(!game_list_index_dirty || game_list_directory == "flash:")
+    return;
+
+  std::vector<GameIndexEntry> entries;
+  entries.reserve(game_list.size());
+
+  for(auto &game : game_list) {
+    if(game.metadata_pending || game.invalid || game.type == GameType::screenshot)
+      continue;
+
+    auto slash = game.filename.find_last_of('/');
+
+    GameIndexEntry entry;
+    entry.name = slash == std::string::npos ? game.filename : game.filename.substr(slash + 1);
+    entry.size = game.size;
+    entry.can_launch = uint8_t(game.can_launch ? CanLaunchResult::Success : CanLaunchResult::IncompatibleBlit);
+    entry.metadata_offset = game.metadata_offset;
+    entry.title = game.title;
+    entries.push_back(entry);
+  }
+
+  entries.insert(entries.end(), invalid_files.begin(), invalid_files.end());
+
+  write_game_index(game_list_directory, entries);
+  game_list_index_dirty = false;
+}
+
+// fill in some of the files that weren't in the index, limited to a time budget so the list can still scroll
+static void load_pending_metadata(uint32_t budget_us) {
+  auto start = now_us();
+  bool any_pending = false;
+
+  for(auto &game : game_list) {
+    if(!game.metadata_pending)
+      continue;
+
+    if(us_diff(start, now_us()) >= budget_us) {
+      any_pending = true;
+      break;
+    }
+
+    load_game_info_metadata(game);
+  }
+
+  remove_invalid_games();
+
+  if(!any_pending && game_list_index_dirty) {
+    // titles may have changed
+    sort_file_list();
+    save_game_list_index();
+  }
 }
 
 static void load_file_list(const std::string &directory) {
 
   game_list.clear();
+  game_list_directory = directory;
+  game_list_index_dirty = false;
+  invalid_files.clear();
 
   auto files = list_files(directory, [&](auto &file) {
     if(file.flags & FileFlags::directory)
@@ -153,35 +335,27 @@ static void load_file_list(const std::string &directory) {
     if(file.name[0] == '.') // hidden file
       return false;
 
-    auto path = directory == "/" ? file.name : directory + "/" + file.name;
-    auto res = api.can_launch(path.c_str());
-
-    if(res == CanLaunchResult::UnknownType) {
-      // special case for images
-      auto last_dot = file.name.find_last_of('.');
-
-      auto ext = last_dot == std::string::npos ? "" : file.name.substr(last_dot + 1);
+    // images are always listed, invalid .blits are removed once they've been checked
+    auto ext = get_file_ext(file.name);
 
-      for(auto &c : ext)
-        c = tolower(c);
+    if(ext == "blit" || ext == "bmp" || ext == "blim")
+      return true;
 
-      if(ext == "bmp" || ext == "blim")
-        return true;
-    }
-
-    // will filter incompatible later
-    return res == CanLaunchResult::Success || res == CanLaunchResult::IncompatibleBlit;
+    // anything else needs a handler, this only checks the extension so doesn't need to open the file
+    auto path = directory == "/" ? file.name : directory + "/" + file.name;
+    return api.can_launch(path.c_str()) == CanLaunchResult::Success;
   });
 
+  // cached info from the last time this directory was listed
+  std::vector<GameIndexEntry> index;
+  if(directory != "flash:")
+    read_game_index(directory, index);
+
   game_list.reserve(files.size()); // worst case
+  unsigned int index_matches = 0;
 
   for(auto &file : files) {
-    auto last_dot = file.name.find_last_of('.');
-
-    auto ext = last_dot == std::string::npos ? "" : file.name.substr(last_dot + 1);
-
-    for(auto &c : ext)
-      c = tolower(c);
+    auto ext = get_file_ext(file.name);
 
     GameInfo game;
     game.title = file.name.substr(0, file.name.length() - ext.length() - 1);
@@ -190,13 +364,7 @@ static void load_file_list(const std::string &directory) {
 
     if(ext == "blit") {
       game.type = GameType::game;
-      game.can_launch = api.can_launch(game.filename.c_str()) == CanLaunchResult::Success;
-
-      // check for metadata
-      BlitGameMetadata meta;
-      if(parse_file_metadata(game.filename, meta))
-        game.title = meta.title;
-
+      game.metadata_pending = true;
     } else  if(ext == "bmp" || ext == "blim") {
       game.type = GameType::screenshot;
 
@@ -208,17 +376,37 @@ static void load_file_list(const std::string &directory) {
       strncpy(game.ext, ext.c_str(), 5);
       game.ext[4] = 0;
       game.can_launch = true;
+      game.metadata_pending = true;
+    }
 
-      // check for a metadata file (fall back to handler's metadata)
-      BlitGameMetadata meta;
-      auto meta_filename = game.filename + ".blmeta";
-      if(parse_file_metadata(meta_filename, meta))
-        game.title = meta.title;
+    if(game.metadata_pending) {
+      auto it = std::find_if(index.begin(), index.end(), [&file](auto &entry) {
+        return entry.name == file.name && entry.size == file.size;
+      });
+
+      if(it != index.end()) {
+        index_matches++;
+
+        if(it->can_launch != uint8_t(CanLaunchResult::Success) && it->can_launch != uint8_t(CanLaunchResult::IncompatibleBlit)) {
+          invalid_files.push_back(*it);
+          continue;
+        }
+
+        game.metadata_pending = false;
+        game.can_launch = it->can_launch == uint8_t(CanLaunchResult::Success);
+        game.metadata_offset = it->metadata_offset;
+        game.title = it->title;
+      } else
+        game_list_index_dirty = true;
     }
 
     game_list.push_back(game);
   }
 
+  // removed files
+  if(index_matches != index.size())
+    game_list_index_dirty = true;
+
   int total_items = (int)game_list.size();
   if(selected_menu_item >= total_items)
     selected_menu_item = std::max(0, total_items - 1);
@@ -260,29 +448,116 @@ static void load_directory_list(const std::string &directory) {
   }
 }
 
+static CachedMetadata *find_cached_metadata(const GameInfo &game) {
+  for(auto &entry : metadata_cache) {
+    if(entry.last_used && entry.filename == game.filename && entry.size == game.size) {
+      entry.last_used = ++metadata_cache_counter;
+      return &entry;
+    }
+  }
+
+  return nullptr;
+}
+
+static void remove_cached_metadata(const std::string &filename) {
+  for(auto &entry : metadata_cache) {
+    if(entry.last_used && entry.filename == filename) {
+      entry.metadata.free_surfaces();
+      entry = CachedMetadata();
+    }
+  }
+}
+
+static void clear_metadata_cache() {
+  for(auto &entry : metadata_cache) {
+    entry.metadata.free_surfaces();
+    entry = CachedMetadata();
+  }
+
+  selected_game_metadata = BlitGameMetadata();
+}
+
+static CachedMetadata *load_game_metadata(GameInfo &game) {
+  // find an empty slot or the least recently used one, never replacing the current selection
+  CachedMetadata *entry = nullptr;
+
+  for(auto &e : metadata_cache) {
+    if(e.last_used && e.filename == selected_game.filename)
+      continue;
+
+    if(!entry || e.last_used < entry->last_used)
+      entry = &e;
+  }
+
+  entry->metadata.free_surfaces();
+  *entry = CachedMetadata();
+
+  entry->filename = game.filename;
+  entry->size = game.size;
+  entry->last_used = ++metadata_cache_counter;
+
+  auto &metadata = entry->metadata;
+
+  if(game.type == GameType::file) {
+    // not a .blit - look for a metadata file
+    auto meta_filename = game.filename + ".blmeta";
+    if(!parse_file_metadata(meta_filename, metadata, true)) {
+      // fallback to handler metadata/placeholders
+      auto handler_meta = (char *)api.get_type_handler_metadata(game.ext);
+      auto len = *reinterpret_cast<uint16_t *>(handler_meta + 8);
+      parse_metadata(handler_meta + 10, len, metadata, true);
+
+      metadata.description = "Launches with: " + metadata.title;
+      metadata.title = game.title;
+      metadata.author = "";
+      metadata.version = "";
+    }
+    entry->loaded = true;
+  } else if(game.type == GameType::game)
+    entry->loaded = parse_file_metadata(game.filename, metadata, true, &game.metadata_offset);
+
+  return entry;
+}
+
+static void set_selected_game_metadata(const CachedMetadata *cached) {
+  selected_game_metadata_pending = false;
+
+  // no valid metadata, reset
+  if(!cached->loaded)
+    selected_game_metadata = BlitGameMetadata();
+  else
+    selected_game_metadata = cached->metadata;
+}
+
 static void load_current_game_metadata() {
-  bool loaded = false;
+  selected_game_metadata_pending = false;
+  selected_game_changed_time = now();
+
+  // the selection moves to the next item if this one turns out to be invalid
+  while(!game_list.empty()) {
+    load_game_info_metadata(game_list[selected_menu_item]);
+
+    if(!game_list[selected_menu_item].invalid)
+      break;
+
+    remove_invalid_games();
+  }
 
   if(!game_list.empty()) {
     selected_game = game_list[selected_menu_item];
 
-    if(selected_game.type == GameType::file) {
-      // not a .blit - look for a metadata file
-      auto meta_filename = selected_game.filename + ".blmeta";
-      if(!parse_file_metadata(meta_filename, selected_game_metadata, true)) {
-        // fallback to handler metadata/placeholders
-        auto handler_meta = (char *)api.get_type_handler_metadata(selected_game.ext);
-        auto len = *reinterpret_cast<uint16_t *>(handler_meta + 8);
-        parse_metadata(handler_meta + 10, len, selected_game_metadata, true);
+    if(selected_game.type != GameType::screenshot) {
+      auto cached = find_cached_metadata(selected_game);
 
-        selected_game_metadata.description = "Launches with: " + selected_game_metadata.title;
+      if(cached)
+        set_selected_game_metadata(cached);
+      else {
+        // show what we already know until the full metadata is loaded
+        selected_game_metadata = BlitGameMetadata();
         selected_game_metadata.title = selected_game.title;
-        selected_game_metadata.author = "";
-        selected_game_metadata.version = "";
+        selected_game_metadata_pending = true;
       }
-      loaded = true;
-    } else
-      loaded = parse_file_metadata(selected_game.filename, selected_game_metadata, true);
+    }
   }
 
 #ifndef PICO_BUILD
@@ -305,10 +580,39 @@ static void load_current_game_metadata() {
   }
 #endif
 
-  // no valid metadata, reset
-  if(!loaded) {
-    selected_game_metadata.free_surfaces();
+  if(game_list.empty() || selected_game.type == GameType::screenshot)
     selected_game_metadata = BlitGameMetadata();
+}
+
+// loads at most one item per call, the current selection first then its neighbours
+static void load_queued_metadata() {
+  if(game_list.empty() || now() - selected_game_changed_time < metadata_load_delay_ms)
+    return;
+
+  if(selected_game_metadata_pending) {
+    set_selected_game_metadata(load_game_metadata(game_list[selected_menu_item]));
+    return;
+  }
+
+  int total_items = (int)game_list.size();
+
+  for(int i = 1; i <= metadata_prefetch_distance; i++) {
+    for(int dir : {1, -1}) {
+      auto &game = game_list[(selected_menu_item + i * dir + total_items) % total_items];
+
+      if(game.type == GameType::screenshot || find_cached_metadata(game))
+        continue;
+
+      load_game_info_metadata(game);
+
+      if(game.invalid) {
+        remove_invalid_games();
+        return;
+      }
+
+      load_game_metadata(game);
+      return;
+    }
   }
 }
 
@@ -331,6 +635,7 @@ static void delete_current_game() {
         api.erase_game(std::stoi(selected_game.filename.substr(7)) * qspi_flash_sector_size);
 
       ::remove_file(selected_game.filename);
+      remove_cached_metadata(selected_game.filename);
 
       load_file_list(current_directory->name);
       load_current_game_metadata();
@@ -339,6 +644,8 @@ static void delete_current_game() {
 }
 
 static void init_lists() {
+  clear_metadata_cache();
+
   load_directory_list("/");
   current_directory = directory_list.begin();
 
@@ -757,11 +1064,16 @@ void update(uint32_t time) {
   if(game_list.empty())
     return;
 
+  // fill in titles for anything that wasn't in the index
+  load_pending_metadata(5000);
+
   // load metadata for selected item
   if(selected_menu_item != old_menu_item) {
     load_current_game_metadata();
   }
 
+  load_queued_metadata();
+
   // paranoid bail out if you're browsing screenshots full screen and come across a game
   if(selected_game.type != GameType::screenshot && current_screen == Screen::screenshot) {
     current_screen = Screen::main;
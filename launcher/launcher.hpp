@@ -32,6 +32,13 @@ struct GameInfo {
   uint32_t size;
 
   std::string filename;
+
+  // title/compatibility still need to be read from the file
+  bool metadata_pending = false;
+  uint32_t metadata_offset = 0;
+
+  // not a valid .blit, removed from the list once it's been checked
+  bool invalid = false;
 };
 
 struct DirectoryInfo {
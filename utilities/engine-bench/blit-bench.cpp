@@ -0,0 +1,107 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include "engine-bench.hpp"
+
+using namespace blit;
+
+static const int sprite_size = 32;
+// big enough for the sprite at any angle
+static const int frame_size = 46;
+static const int num_frames = 8;
+
+static uint8_t sprite_data[sprite_size * sprite_size * 4];
+static uint8_t frame_data[frame_size * num_frames * frame_size * 4];
+
+static uint8_t check_data[2][sprite_size * 2 * sprite_size * 2 * 3];
+
+static Surface sprite(sprite_data, PixelFormat::RGBA, Size(sprite_size, sprite_size));
+static Surface frames(frame_data, PixelFormat::RGBA, Size(frame_size * num_frames, frame_size));
+
+static void init_sprite() {
+  // a round ship shaped thing with a transparent background
+  for(int y = 0; y < sprite_size; y++) {
+    for(int x = 0; x < sprite_size; x++) {
+      int dx = x * 2 - sprite_size + 1, dy = y * 2 - sprite_size + 1;
+      bool inside = dx * dx + dy * dy < sprite_size * sprite_size;
+      sprite.pen = inside ? Pen(x * 8, y * 8, 255 - x * 4, 255) : Pen(0, 0, 0, 0);
+      sprite.pixel(Point(x, y));
+    }
+  }
+}
+
+static Mat3 rotate_about_centre(float angle, Vec2 pos, float scale = 1.0f) {
+  return Mat3::translation(pos) * Mat3::rotation(angle) * Mat3::scale(Vec2(scale, scale)) * Mat3::translation(Vec2(-sprite_size / 2.0f, -sprite_size / 2.0f));
+}
+
+void blit_checks() {
+  init_sprite();
+
+  Surface a(check_data[0], PixelFormat::RGB, Size(sprite_size * 2, sprite_size * 2));
+  Surface b(check_data[1], PixelFormat::RGB, Size(sprite_size * 2, sprite_size * 2));
+
+  auto clear = [&a, &b]() {
+    a.pen = b.pen = Pen(20, 40, 60);
+    a.clear();
+    b.clear();
+  };
+
+  // without rotation or scale the affine path should match the plain blit
+  clear();
+  a.blit(&sprite, sprite.clip, Point(5, 7));
+  b.blit(&sprite, sprite.clip, Mat3::translation(Vec2(5.0f, 7.0f)));
+  check("affine blit translation", memcmp(check_data[0], check_data[1], sizeof(check_data[0])) == 0);
+
+  // a half turn is the same as flipping both ways
+  clear();
+  a.blit(&sprite, sprite.clip, Point(5, 7), SpriteTransform::R180);
+  b.blit(&sprite, sprite.clip, rotate_about_centre(pi, Vec2(5.0f + sprite_size / 2.0f, 7.0f + sprite_size / 2.0f)));
+  check("affine blit half turn", memcmp(check_data[0], check_data[1], sizeof(check_data[0])) == 0);
+
+  // integer scale matches stretch_blit
+  clear();
+  a.stretch_blit(&sprite, sprite.clip, Rect(0, 0, sprite_size * 2, sprite_size * 2));
+  b.blit(&sprite, sprite.clip, Mat3::scale(Vec2(2.0f, 2.0f)));
+  check("affine blit scale", memcmp(check_data[0], check_data[1], sizeof(check_data[0])) == 0);
+}
+
+void blit_bench() {
+  char name[64];
+  const char *format = screen.format == PixelFormat::RGB565 ? "RGB565" : "RGB";
+
+  init_sprite();
+
+  // the alternative to rotating at runtime: a strip of frames rotated in advance
+  frames.pen = Pen(0, 0, 0, 0);
+  frames.clear();
+  for(int i = 0; i < num_frames; i++) {
+    float angle = pi * 2.0f * i / num_frames;
+    frames.blit(&sprite, sprite.clip, rotate_about_centre(angle, Vec2(i * frame_size + frame_size / 2.0f, frame_size / 2.0f)));
+  }
+
+  const int iterations = 1000;
+
+  // spread over the screen so it isn't all cache hits on one spot
+  auto sprite_pos = [](int i) {
+    return Vec2(float((i * 37) % (screen.bounds.w - frame_size) + frame_size / 2), float((i * 23) % (screen.bounds.h - frame_size) + frame_size / 2));
+  };
+
+  snprintf(name, sizeof(name), "pre-rotated RGBA %ix%i to %s", frame_size, frame_size, format);
+  bench(name, iterations, [&sprite_pos](int i) {
+    Vec2 pos = sprite_pos(i);
+    screen.blit(&frames, Rect((i % num_frames) * frame_size, 0, frame_size, frame_size), Point(int(pos.x) - frame_size / 2, int(pos.y) - frame_size / 2));
+  });
+
+  for(auto bilinear : {false, true}) {
+    snprintf(name, sizeof(name), "affine RGBA %ix%i to %s rotated%s", sprite_size, sprite_size, format, bilinear ? " bilinear" : "");
+    bench(name, iterations, [&sprite_pos, bilinear](int i) {
+      screen.blit(&sprite, sprite.clip, rotate_about_centre(i * 0.1f, sprite_pos(i)), bilinear);
+    });
+  }
+
+  snprintf(name, sizeof(name), "affine RGBA %ix%i to %s rotated 2x", sprite_size, sprite_size, format);
+  bench(name, iterations / 4, [&sprite_pos](int i) {
+    screen.blit(&sprite, sprite.clip, rotate_about_centre(i * 0.1f, sprite_pos(i), 2.0f));
+  });
+}
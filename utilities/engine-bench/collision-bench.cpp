@@ -0,0 +1,172 @@
+#include <algorithm>
+#include <cstdio>
+#include <utility>
+#include <vector>
+
+#include "engine-bench.hpp"
+#include "graphics/collision_mask.hpp"
+#include "math/collision.hpp"
+
+using namespace blit;
+
+static const int grid_size = 128; // tiles
+static const int world_size = grid_size * 8;
+static const int entity_size = 12;
+
+static uint8_t grid_tiles[grid_size * grid_size];
+static uint8_t tile_flags[256];
+
+struct Entity {
+  Vec2 pos, vel;
+};
+
+// fixed sequence so every run does the same work
+static uint32_t rand_state;
+static int32_t rand_range(int32_t max) {
+  rand_state = rand_state * 1664525u + 1013904223u;
+  return int32_t((rand_state >> 8) % uint32_t(max));
+}
+
+// walls around the edge and scattered blocks, tile 1 is solid
+static void init_grid() {
+  rand_state = 1;
+  tile_flags[1] = 1;
+
+  for(int y = 0; y < grid_size; y++) {
+    for(int x = 0; x < grid_size; x++) {
+      bool edge = x == 0 || y == 0 || x == grid_size - 1 || y == grid_size - 1;
+      grid_tiles[x + y * grid_size] = edge || rand_range(16) == 0 ? 1 : 0;
+    }
+  }
+}
+
+static std::vector<Entity> make_entities(int count) {
+  std::vector<Entity> entities(count);
+  for(auto &e : entities) {
+    e.pos = Vec2(float(rand_range(world_size - 32) + 8), float(rand_range(world_size - 32) + 8));
+    e.vel = Vec2(float(rand_range(9) - 4), float(rand_range(9) - 4));
+  }
+  return entities;
+}
+
+static Rect entity_rect(const Entity &e) {
+  return Rect(int32_t(e.pos.x), int32_t(e.pos.y), entity_size, entity_size);
+}
+
+static std::vector<std::pair<uint16_t, uint16_t>> brute_force_pairs(const std::vector<Entity> &entities) {
+  std::vector<std::pair<uint16_t, uint16_t>> pairs;
+
+  for(size_t a = 0; a < entities.size(); a++) {
+    auto ra = entity_rect(entities[a]);
+    for(size_t b = a + 1; b < entities.size(); b++) {
+      auto rb = entity_rect(entities[b]);
+      if(ra.x < rb.x + rb.w && rb.x < ra.x + ra.w && ra.y < rb.y + rb.h && rb.y < ra.y + ra.h)
+        pairs.emplace_back(uint16_t(a), uint16_t(b));
+    }
+  }
+  return pairs;
+}
+
+void collision_checks() {
+  init_grid();
+
+  // the broadphase finds the same pairs as testing every pair
+  auto entities = make_entities(2000);
+
+  SpatialHash hash;
+  for(size_t i = 0; i < entities.size(); i++)
+    hash.insert(uint16_t(i), entity_rect(entities[i]));
+
+  std::vector<std::pair<uint16_t, uint16_t>> pairs;
+  hash.query_pairs(pairs);
+  std::sort(pairs.begin(), pairs.end());
+
+  auto expected = brute_force_pairs(entities);
+  check("spatial hash pairs", !expected.empty() && pairs == expected);
+
+  // a box moving many tiles in one step still stops at a one tile wall
+  uint8_t wall_tiles[16 * 16]{};
+  for(int y = 0; y < 16; y++)
+    wall_tiles[10 + y * 16] = 1;
+
+  TileMap wall_map(wall_tiles, nullptr, Size(16, 16), nullptr);
+  TileGrid wall(wall_map, tile_flags);
+
+  auto sweep = sweep_box(wall, Vec2(4.0f, 20.0f), Vec2(6.0f, 6.0f), Vec2(100.0f, 3.0f), 1);
+  check("sweep_box fast wall", sweep.hit_x && !sweep.hit_y && sweep.position.x == 74.0f && sweep.position.y == 23.0f && sweep.tile_x == Point(10, 2));
+
+  sweep = sweep_box(wall, Vec2(100.0f, 20.0f), Vec2(6.0f, 6.0f), Vec2(-90.0f, 0.0f), 1);
+  check("sweep_box fast wall left", sweep.hit_x && sweep.position.x == 88.0f);
+
+  // masks are solid where blit draws, for every transform of a sprite that isn't square
+  static uint8_t sheet_data[32 * 32 * 4], drawn_data[16 * 16 * 3];
+  Surface sheet(sheet_data, PixelFormat::RGBA, Size(32, 32));
+  Surface drawn(drawn_data, PixelFormat::RGB, Size(16, 16));
+
+  for(int y = 0; y < 32; y++) {
+    for(int x = 0; x < 32; x++) {
+      sheet.pen = rand_range(3) ? Pen(255, 255, 255, 255) : Pen(0, 0, 0, 0);
+      sheet.pixel(Point(x, y));
+    }
+  }
+
+  Rect sprite(2, 3, 12, 5);
+  CollisionMask mask(&sheet, sprite);
+
+  bool same = true;
+  for(uint8_t transform = 0; transform < 8; transform++) {
+    drawn.pen = Pen(0, 0, 0);
+    drawn.clear();
+    drawn.blit(&sheet, sprite, Point(0, 0), transform);
+
+    for(int y = 0; y < 16; y++) {
+      for(int x = 0; x < 16; x++)
+        same = same && mask.get(Point(x, y), transform) == (drawn_data[(x + y * 16) * 3] != 0);
+    }
+  }
+  check("collision mask matches blit", same);
+}
+
+void collision_bench() {
+  char name[64];
+
+  init_grid();
+
+  TileMap map(grid_tiles, nullptr, Size(grid_size, grid_size), nullptr);
+  TileGrid grid(map, tile_flags);
+
+  SpatialHash hash(4, 4096);
+  std::vector<std::pair<uint16_t, uint16_t>> pairs;
+
+  // an update of a game with thousands of moving objects: move against the tiles, then find who touches who
+  for(int count : {1000, 4000}) {
+    auto entities = make_entities(count);
+
+    snprintf(name, sizeof(name), "sweep_box %i entities", count);
+    bench(name, 20, [&](int i) {
+      for(auto &e : entities) {
+        auto sweep = sweep_box(grid, e.pos, Vec2(entity_size, entity_size), e.vel, 1);
+        e.pos = sweep.position;
+        if(sweep.hit_x) e.vel.x = -e.vel.x;
+        if(sweep.hit_y) e.vel.y = -e.vel.y;
+      }
+    });
+
+    snprintf(name, sizeof(name), "spatial hash %i entities", count);
+    bench(name, 20, [&](int i) {
+      hash.clear();
+      for(size_t j = 0; j < entities.size(); j++)
+        hash.insert(uint16_t(j), entity_rect(entities[j]));
+
+      pairs.clear();
+      hash.query_pairs(pairs);
+      bench_sink = pairs.size();
+    });
+
+    // what the broadphase saves
+    snprintf(name, sizeof(name), "brute force pairs %i entities", count);
+    bench(name, 2, [&](int i) {
+      bench_sink = brute_force_pairs(entities).size();
+    });
+  }
+}
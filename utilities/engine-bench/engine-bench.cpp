@@ -0,0 +1,75 @@
+#include <chrono>
+#include <cstdio>
+
+#include "engine-bench.hpp"
+
+using namespace blit;
+
+volatile uint32_t bench_sink;
+
+static int passed = 0, failed = 0;
+static uint32_t bench_time_us = 0;
+
+bool check(const char *name, bool pass) {
+  debugf("%s %s\n", pass ? "PASS" : "FAIL", name);
+
+  if(pass)
+    passed++;
+  else
+    failed++;
+
+  return pass;
+}
+
+uint32_t bench_us() {
+#if defined(TARGET_32BLIT_HW) || defined(PICO_BUILD)
+  return now_us();
+#else
+  // --headless/--uncapped replace now_us with a virtual timer
+  auto now = std::chrono::steady_clock::now().time_since_epoch();
+  return uint32_t(std::chrono::duration_cast<std::chrono::microseconds>(now).count());
+#endif
+}
+
+void init() {
+  set_screen_mode(ScreenMode::hires);
+
+  blit_checks();
+  collision_checks();
+  filter_checks();
+  fixed_checks();
+  fastmath_checks();
+  installer_checks();
+  primitive_checks();
+
+  uint32_t start = bench_us();
+  blit_bench();
+  collision_bench();
+  filter_bench();
+  fixed_bench();
+  fastmath_bench();
+  installer_bench();
+  primitive_bench();
+  bench_time_us = us_diff(start, bench_us());
+
+  debugf("%i passed, %i failed\n", passed, failed);
+}
+
+void render(uint32_t time) {
+  screen.pen = Pen(0, 0, 0);
+  screen.clear();
+
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%i passed, %i failed", passed, failed);
+
+  screen.pen = failed ? Pen(255, 0, 0) : Pen(0, 255, 0);
+  screen.text(buf, minimal_font, Point(5, 5));
+
+  snprintf(buf, sizeof(buf), "Benchmarks took %u ms", unsigned(bench_time_us / 1000));
+  screen.pen = Pen(255, 255, 255);
+  screen.text(buf, minimal_font, Point(5, 15));
+  screen.text("Results are printed to the debug output.", minimal_font, Point(5, 25));
+}
+
+void update(uint32_t time) {
+}
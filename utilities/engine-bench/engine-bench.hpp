@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+
+#include "32blit.hpp"
+
+// prints "PASS name" or "FAIL name", CI looks for the FAILs
+bool check(const char *name, bool pass);
+
+// wall clock time in us, even when the SDL build is running on a virtual timer
+uint32_t bench_us();
+
+// print the time per call of func(i)
+template<class F>
+void bench(const char *name, int iterations, F func) {
+  uint32_t start = bench_us();
+  for(int i = 0; i < iterations; i++)
+    func(i);
+  uint32_t elapsed = blit::us_diff(start, bench_us());
+
+  uint32_t ns = uint64_t(elapsed) * 1000 / iterations;
+  blit::debugf("BENCH %s: %u.%03u us\n", name, unsigned(ns / 1000), unsigned(ns % 1000));
+}
+
+// results go here so the benchmarks aren't optimised out
+extern volatile uint32_t bench_sink;
+
+void blit_checks();
+void blit_bench();
+
+void collision_checks();
+void collision_bench();
+
+void filter_checks();
+void filter_bench();
+
+void fixed_checks();
+void fixed_bench();
+
+void fastmath_checks();
+void fastmath_bench();
+
+void installer_checks();
+void installer_bench();
+
+void primitive_checks();
+void primitive_bench();
@@ -0,0 +1,84 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#include "engine-bench.hpp"
+#include "math/fastmath.hpp"
+
+using namespace blit;
+
+static const int num_values = 256;
+
+static float angles[num_values];
+static float positives[num_values];
+
+static void init_values() {
+  for(int i = 0; i < num_values; i++) {
+    angles[i] = (i - num_values / 2 + 0.5f) * (20.0f / num_values);
+    positives[i] = (i + 1) * (100.0f / num_values);
+  }
+}
+
+// checks the error against libm in double precision and prints it
+static bool check_error(const char *name, double err, double bound) {
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%s error %.3g < %.3g", name, err, bound);
+  return check(buf, err < bound);
+}
+
+void fastmath_checks() {
+  const int steps = 200000;
+
+  double sin_err = 0.0, cos_err = 0.0;
+  for(int i = 0; i <= steps; i++) {
+    float a = -1000.0f + 2000.0f * float(i) / steps;
+    sin_err = std::max(sin_err, std::fabs(double(fastmath::sin(a)) - std::sin(double(a))));
+    cos_err = std::max(cos_err, std::fabs(double(fastmath::cos(a)) - std::cos(double(a))));
+  }
+  check_error("fastmath::sin", sin_err, 8e-7);
+  check_error("fastmath::cos", cos_err, 8e-7);
+
+  double atan_err = 0.0;
+  for(int i = 0; i < steps; i++) {
+    // all the way round the circle at a few radii
+    float t = 2.0f * pi * float(i) / steps;
+    float r = float(1 << (i % 8)) * 0.25f;
+    float y = r * std::sin(t), x = r * std::cos(t);
+    atan_err = std::max(atan_err, std::fabs(double(fastmath::atan2(y, x)) - std::atan2(double(y), double(x))));
+  }
+  check_error("fastmath::atan2", atan_err, 1.17e-5);
+  check("fastmath::atan2 origin", fastmath::atan2(0.0f, 0.0f) == 0.0f);
+
+  double invsqrt_err = 0.0;
+  for(int i = 0; i < steps; i++) {
+    // several octaves, the estimate repeats every factor of 4
+    float v = std::ldexp(1.0f + 3.0f * float(i) / steps, (i % 40) - 20);
+    double ref = 1.0 / std::sqrt(double(v));
+    invsqrt_err = std::max(invsqrt_err, std::fabs(double(fastmath::invsqrt(v)) - ref) / ref);
+  }
+  check_error("fastmath::invsqrt", invsqrt_err, 4.7e-6);
+  check("fastmath::sqrt <= 0", fastmath::sqrt(0.0f) == 0.0f && fastmath::sqrt(-1.0f) == 0.0f);
+}
+
+void fastmath_bench() {
+  init_values();
+
+  const int iterations = 100000;
+  const int mask = num_values - 1;
+
+  // fastmath calls are inline, libm calls may not be
+  bench("fastmath::sin", iterations, [](int i) {bench_sink = uint32_t(int32_t(fastmath::sin(angles[i & mask]) * 65536.0f));});
+  bench("sinf", iterations, [](int i) {bench_sink = uint32_t(int32_t(std::sin(angles[i & mask]) * 65536.0f));});
+
+  bench("fastmath::cos", iterations, [](int i) {bench_sink = uint32_t(int32_t(fastmath::cos(angles[i & mask]) * 65536.0f));});
+  bench("cosf", iterations, [](int i) {bench_sink = uint32_t(int32_t(std::cos(angles[i & mask]) * 65536.0f));});
+
+  bench("fastmath::atan2", iterations, [](int i) {bench_sink = uint32_t(int32_t(fastmath::atan2(angles[i & mask], angles[(i + 7) & mask]) * 65536.0f));});
+  bench("atan2f", iterations, [](int i) {bench_sink = uint32_t(int32_t(std::atan2(angles[i & mask], angles[(i + 7) & mask]) * 65536.0f));});
+
+  bench("fastmath::invsqrt", iterations, [](int i) {bench_sink = uint32_t(int32_t(fastmath::invsqrt(positives[i & mask]) * 65536.0f));});
+  bench("1 / sqrtf", iterations, [](int i) {bench_sink = uint32_t(int32_t(1.0f / std::sqrt(positives[i & mask]) * 65536.0f));});
+
+  bench("fastmath::sqrt", iterations, [](int i) {bench_sink = uint32_t(int32_t(fastmath::sqrt(positives[i & mask]) * 65536.0f));});
+  bench("sqrtf", iterations, [](int i) {bench_sink = uint32_t(int32_t(std::sqrt(positives[i & mask]) * 65536.0f));});
+}
@@ -0,0 +1,157 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "engine-bench.hpp"
+
+using namespace blit;
+
+static const int test_w = 32, test_h = 16;
+
+static uint8_t test_data[test_w * test_h * 4];
+static uint8_t expected_data[test_w * test_h * 3];
+
+static bool all_pixels(Surface &s, const Pen &p) {
+  for(int y = 0; y < test_h; y++) {
+    for(int x = 0; x < test_w; x++) {
+      Pen got = s.get_pixel(Point(x, y));
+      if(got.r != p.r || got.g != p.g || got.b != p.b)
+        return false;
+    }
+  }
+
+  return true;
+}
+
+// straightforward box blur, rows then columns, rounding after each
+static void reference_box_blur(uint8_t *data, int radius) {
+  uint8_t tmp[test_w * test_h * 3];
+  int n = radius * 2 + 1;
+
+  for(int y = 0; y < test_h; y++) {
+    for(int x = 0; x < test_w; x++) {
+      for(int c = 0; c < 3; c++) {
+        int sum = 0;
+        for(int i = x - radius; i <= x + radius; i++)
+          sum += data[(y * test_w + std::min(std::max(i, 0), test_w - 1)) * 3 + c];
+        tmp[(y * test_w + x) * 3 + c] = (sum + n / 2) / n;
+      }
+    }
+  }
+
+  for(int y = 0; y < test_h; y++) {
+    for(int x = 0; x < test_w; x++) {
+      for(int c = 0; c < 3; c++) {
+        int sum = 0;
+        for(int i = y - radius; i <= y + radius; i++)
+          sum += tmp[(std::min(std::max(i, 0), test_h - 1) * test_w + x) * 3 + c];
+        data[(y * test_w + x) * 3 + c] = (sum + n / 2) / n;
+      }
+    }
+  }
+}
+
+void filter_checks() {
+  static const int radii[]{1, 2, 10, 64, 100, 120, 2047};
+  static const Pen colours[]{{255, 255, 255}, {0, 0, 0}, {128, 128, 128}, {255, 128, 1}};
+  static const PixelFormat formats[]{PixelFormat::RGB, PixelFormat::RGBA, PixelFormat::RGB565};
+  static const char *format_names[]{"RGB", "RGBA", "RGB565"};
+
+  char name[64];
+
+  // blurring a flat image shouldn't change it
+  for(int f = 0; f < 3; f++) {
+    Surface s(test_data, formats[f], Size(test_w, test_h));
+
+    for(auto &radius : radii) {
+      bool ok = true;
+      for(auto &colour : colours) {
+        s.pen = colour;
+        s.clear();
+        Pen flat = s.get_pixel(Point(0, 0)); // RGB565 loses some bits
+
+        box_blur(&s, s.clip, radius, 3);
+        ok = ok && all_pixels(s, flat);
+      }
+
+      snprintf(name, sizeof(name), "box_blur flat %s radius %i", format_names[f], radius);
+      check(name, ok);
+    }
+
+    bool ok = true;
+    for(auto &colour : colours) {
+      s.pen = colour;
+      s.clear();
+      Pen flat = s.get_pixel(Point(0, 0));
+
+      gaussian_blur(&s, s.clip, 40.0f);
+      ok = ok && all_pixels(s, flat);
+    }
+
+    snprintf(name, sizeof(name), "gaussian_blur flat %s", format_names[f]);
+    check(name, ok);
+  }
+
+  // compare a pattern against the slow version
+  Surface s(test_data, PixelFormat::RGB, Size(test_w, test_h));
+
+  for(auto &radius : radii) {
+    for(int i = 0; i < test_w * test_h * 3; i++)
+      test_data[i] = (i * 97 + (i / 7) * 31) & 0xFF;
+
+    memcpy(expected_data, test_data, sizeof(expected_data));
+
+    box_blur(&s, s.clip, radius);
+    reference_box_blur(expected_data, radius);
+
+    snprintf(name, sizeof(name), "box_blur pattern radius %i", radius);
+    check(name, memcmp(test_data, expected_data, sizeof(expected_data)) == 0);
+  }
+
+  // dithering from a rect hanging off the source only reads the part inside it
+  static uint16_t dither_data[2][(test_w + 8) * (test_h + 8)];
+  Surface dither_a((uint8_t *)dither_data[0], PixelFormat::RGB565, Size(test_w + 8, test_h + 8));
+  Surface dither_b((uint8_t *)dither_data[1], PixelFormat::RGB565, Size(test_w + 8, test_h + 8));
+
+  dither_a.pen = dither_b.pen = Pen(0, 0, 0);
+  dither_a.clear();
+  dither_b.clear();
+
+  dither(&s, Rect(-4, -3, test_w + 8, test_h + 8), &dither_a, Point(0, 0));
+  dither(&s, s.clip, &dither_b, Point(4, 3));
+  check("dither clipped source", memcmp(dither_data[0], dither_data[1], sizeof(dither_data[0])) == 0);
+}
+
+void filter_bench() {
+  char name[64];
+  const char *format = screen.format == PixelFormat::RGB565 ? "RGB565" : "RGB";
+
+  auto fill = [](int) {
+    for(int y = 0; y < screen.bounds.h; y++) {
+      for(int x = 0; x < screen.bounds.w; x++) {
+        screen.pen = Pen(x, y, x ^ y);
+        screen.pixel(Point(x, y));
+      }
+    }
+  };
+
+  fill(0);
+
+  for(auto radius : {1, 4, 32}) {
+    snprintf(name, sizeof(name), "box_blur screen %s radius %i", format, radius);
+    bench(name, 10, [radius](int) {box_blur(&screen, screen.clip, radius);});
+  }
+
+  snprintf(name, sizeof(name), "gaussian_blur screen %s sigma 3", format);
+  bench(name, 10, [](int) {gaussian_blur(&screen, screen.clip, 3.0f);});
+
+  snprintf(name, sizeof(name), "color_matrix screen %s sepia", format);
+  auto sepia = ColorMatrix::sepia();
+  bench(name, 10, [&sepia](int) {color_matrix(&screen, screen.clip, sepia);});
+
+  snprintf(name, sizeof(name), "tint screen %s", format);
+  bench(name, 10, [](int) {tint(&screen, screen.clip, Pen(255, 128, 0));});
+
+  snprintf(name, sizeof(name), "fade screen %s", format);
+  bench(name, 10, [](int) {fade(&screen, screen.clip, 200);});
+}
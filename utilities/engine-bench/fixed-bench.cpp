@@ -0,0 +1,100 @@
+#include <cmath>
+#include <cstdio>
+#include <type_traits>
+
+#include "engine-bench.hpp"
+
+using namespace blit;
+
+// floats have to be converted explicitly, an implicit conversion would truncate through Fixed(int)
+static_assert(!std::is_convertible<float, Fixed>::value, "float implicitly converts to Fixed");
+static_assert(!std::is_convertible<double, Fixed>::value, "double implicitly converts to Fixed");
+static_assert(std::is_convertible<int, Fixed>::value, "int doesn't convert to Fixed");
+static_assert(std::is_constructible<Fixed, float>::value, "Fixed can't be constructed from float");
+
+static const int num_values = 256;
+
+static Fixed fixed_values[num_values];
+static float float_values[num_values];
+
+static void init_values() {
+  // spread over -100 to 100, avoiding 0 for the divisions
+  for(int i = 0; i < num_values; i++) {
+    float_values[i] = (i - num_values / 2 + 0.5f) * (200.0f / num_values);
+    fixed_values[i] = Fixed(float_values[i]);
+  }
+}
+
+// largest error of f over n steps from start to end, compared with the float reference
+template<class F, class R>
+static float max_error(float start, float end, int n, F f, R reference) {
+  float max_err = 0.0f;
+  for(int i = 0; i <= n; i++) {
+    float v = start + (end - start) * i / n;
+    float err = std::fabs(float(f(Fixed(v))) - reference(float(Fixed(v))));
+    max_err = std::max(max_err, err);
+  }
+  return max_err;
+}
+
+void fixed_checks() {
+  check("fixed int ops", Fixed(10) * 2 == Fixed(20) && Fixed(10) / 4 == Fixed(2.5f) && 3 + Fixed(1) == Fixed(4));
+  check("fixed float ctor", Fixed(10) * Fixed(0.5f) == Fixed(5) && Fixed(-0.5f).raw == -32768);
+  check("fixed round trip", float(Fixed(1.25f)) == 1.25f && Fixed(-2.75f).to_int() == -3);
+
+  // products and quotients shouldn't overflow in the intermediate
+  check("fixed mul range", Fixed(30000) * Fixed(0.5f) == Fixed(15000));
+  check("fixed div range", Fixed(30000) / Fixed(1000) == Fixed(30));
+
+  // saturate instead of trapping or wrapping
+  check("fixed div zero", (Fixed(5) / Fixed()).raw == INT32_MAX && (Fixed(-5) / Fixed()).raw == INT32_MIN);
+  check("fixed int range", Fixed(40000).raw == INT32_MAX && Fixed(-40000).raw == INT32_MIN && Fixed(-32768).raw == INT32_MIN && Fixed(32767).to_int() == 32767);
+
+  check("fixed_sqrt exact", fixed_sqrt(Fixed(4)) == Fixed(2) && fixed_sqrt(Fixed(0.25f)) == Fixed(0.5f) && fixed_sqrt(Fixed(-1)) == Fixed());
+
+  float err = max_error(0.0f, 32000.0f, 10000, fixed_sqrt, [](float v) {return std::sqrt(v);});
+  check("fixed_sqrt accuracy", err <= 1.0f / 65536.0f);
+
+  err = max_error(-100.0f, 100.0f, 10000, fixed_sin, [](float v) {return std::sin(v);});
+  check("fixed_sin accuracy", err < 1.0f / 20000.0f);
+
+  err = max_error(-100.0f, 100.0f, 10000, fixed_cos, [](float v) {return std::cos(v);});
+  check("fixed_cos accuracy", err < 1.0f / 20000.0f);
+
+  float atan_err = 0.0f;
+  for(int y = -50; y <= 50; y++) {
+    for(int x = -50; x <= 50; x++) {
+      float got = float(fixed_atan2(Fixed(y), Fixed(x)));
+      atan_err = std::max(atan_err, std::fabs(got - std::atan2(float(y), float(x))));
+    }
+  }
+  check("fixed_atan2 accuracy", atan_err < 1.0f / 20000.0f);
+}
+
+void fixed_bench() {
+  init_values();
+
+  const int iterations = 100000;
+  const int mask = num_values - 1;
+
+  bench("Fixed +", iterations, [](int i) {bench_sink = (fixed_values[i & mask] + fixed_values[(i + 1) & mask]).raw;});
+  bench("float +", iterations, [](int i) {bench_sink = uint32_t(int32_t(float_values[i & mask] + float_values[(i + 1) & mask]));});
+
+  bench("Fixed *", iterations, [](int i) {bench_sink = (fixed_values[i & mask] * fixed_values[(i + 1) & mask]).raw;});
+  bench("float *", iterations, [](int i) {bench_sink = uint32_t(int32_t(float_values[i & mask] * float_values[(i + 1) & mask]));});
+
+  bench("Fixed /", iterations, [](int i) {bench_sink = (fixed_values[i & mask] / fixed_values[(i + 1) & mask]).raw;});
+  bench("float /", iterations, [](int i) {bench_sink = uint32_t(int32_t(float_values[i & mask] / float_values[(i + 1) & mask]));});
+
+  bench("fixed_sqrt", iterations, [](int i) {bench_sink = fixed_sqrt(fixed_values[i & mask]).raw;});
+  bench("sqrtf", iterations, [](int i) {bench_sink = uint32_t(int32_t(std::sqrt(std::fabs(float_values[i & mask]))));});
+
+  bench("fixed_sin", iterations, [](int i) {bench_sink = fixed_sin(fixed_values[i & mask]).raw;});
+  bench("sinf", iterations, [](int i) {bench_sink = uint32_t(int32_t(std::sin(float_values[i & mask]) * 65536.0f));});
+
+  bench("fixed_cos", iterations, [](int i) {bench_sink = fixed_cos(fixed_values[i & mask]).raw;});
+  bench("cosf", iterations, [](int i) {bench_sink = uint32_t(int32_t(std::cos(float_values[i & mask]) * 65536.0f));});
+
+  bench("fixed_atan2", iterations, [](int i) {bench_sink = fixed_atan2(fixed_values[i & mask], fixed_values[(i + 7) & mask]).raw;});
+  bench("atan2f", iterations, [](int i) {bench_sink = uint32_t(int32_t(std::atan2(float_values[i & mask], float_values[(i + 7) & mask]) * 65536.0f));});
+}
@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "engine-bench.hpp"
+#include "installer.hpp"
+
+using namespace blit;
+
+// flash in RAM that fails like the real thing: programming needs erased bytes and erases are block aligned
+class MemoryFlash final : public InstallerFlash {
+public:
+  MemoryFlash(uint32_t size) : data(size, 0) {}
+
+  uint32_t get_erase_size() const override {return 4096;}
+  uint32_t get_program_size() const override {return 256;}
+
+  bool erase(uint32_t offset) override {
+    if(offset % get_erase_size() || offset + get_erase_size() > data.size())
+      return false;
+
+    memset(data.data() + offset, 0xFF, get_erase_size());
+    erases++;
+    return true;
+  }
+
+  bool program(uint32_t offset, const uint8_t *buf, uint32_t len) override {
+    if(offset % get_program_size() || len % get_program_size() || offset + len > data.size())
+      return false;
+
+    for(uint32_t i = 0; i < len; i++) {
+      if(data[offset + i] != 0xFF)
+        return false;
+      data[offset + i] = buf[i];
+    }
+    return true;
+  }
+
+  bool read(uint32_t offset, uint8_t *buf, uint32_t len) override {
+    if(offset + len > data.size())
+      return false;
+
+    memcpy(buf, data.data() + offset, len);
+    return true;
+  }
+
+  std::vector<uint8_t> data;
+  int erases = 0;
+};
+
+static const uint32_t flash_size = 32 * 1024;
+static const uint32_t install_offset = 8192;
+static const uint32_t reloc_base = 0x90000000;
+
+static const int buffer_size = 1024;
+static uint8_t install_buffer[buffer_size];
+
+// RELO header + relocations + data
+static std::vector<uint8_t> make_blit(const std::vector<uint8_t> &data, const std::vector<uint32_t> &relocs) {
+  std::vector<uint8_t> ret;
+
+  auto write_u32 = [&ret](uint32_t val) {
+    auto ptr = (uint8_t *)&val;
+    ret.insert(ret.end(), ptr, ptr + 4);
+  };
+
+  write_u32(0x4F4C4552); // RELO
+  write_u32(relocs.size());
+
+  for(auto &reloc : relocs)
+    write_u32(reloc + reloc_base);
+
+  ret.insert(ret.end(), data.begin(), data.end());
+  return ret;
+}
+
+static std::vector<uint8_t> make_data(uint32_t len) {
+  std::vector<uint8_t> data(len);
+  for(uint32_t i = 0; i < len; i++)
+    data[i] = uint8_t(i * 7 + (i >> 8));
+  return data;
+}
+
+// feed the file in awkward chunk sizes, like USB packets
+static bool install(MemoryFlash &flash, const std::vector<uint8_t> &file, bool relocatable, uint32_t chunk_size = 61) {
+  BlitInstaller installer;
+  installer.init(flash, install_buffer, buffer_size, file.size(), relocatable, reloc_base, [](uint32_t) {return install_offset;});
+
+  for(uint32_t off = 0; off < file.size(); off += chunk_size) {
+    if(!installer.write(file.data() + off, std::min(chunk_size, uint32_t(file.size()) - off)))
+      return false;
+  }
+
+  return installer.is_complete() && installer.get_flash_offset() == install_offset;
+}
+
+static bool flash_matches(const MemoryFlash &flash, const std::vector<uint8_t> &data) {
+  return memcmp(flash.data.data() + install_offset, data.data(), data.size()) == 0;
+}
+
+void installer_checks() {
+  auto data = make_data(5000);
+
+  {
+    MemoryFlash flash(flash_size);
+    check("installer plain", install(flash, data, false) && flash_matches(flash, data) && flash.erases == 2);
+  }
+
+  // relocations on and across buffer boundaries, with carries through the split bytes
+  std::vector<uint32_t> relocs{0, 4, 1021, 2046, 3071, 4092, 4996};
+  for(auto &reloc : relocs) {
+    data[reloc + 1] = 0xF0;
+    data[reloc + 2] = 0xFF;
+  }
+
+  auto expected = data;
+  for(auto &reloc : relocs) {
+    uint32_t val;
+    memcpy(&val, expected.data() + reloc, 4);
+    val += install_offset;
+    memcpy(expected.data() + reloc, &val, 4);
+  }
+
+  for(uint32_t chunk : {1u, 61u, 1024u, 5000u}) {
+    MemoryFlash flash(flash_size);
+    char name[64];
+    snprintf(name, sizeof(name), "installer relocs, %u byte writes", unsigned(chunk));
+    check(name, install(flash, make_blit(data, relocs), true, chunk) && flash_matches(flash, expected));
+  }
+
+  // bad relocations have to fail before anything is erased
+  {
+    MemoryFlash flash(flash_size);
+    bool ok = install(flash, make_blit(data, {8, 4}), true);
+    check("installer unsorted relocs", !ok && flash.erases == 0);
+  }
+
+  {
+    MemoryFlash flash(flash_size);
+    bool ok = install(flash, make_blit(data, {4998}), true);
+    check("installer reloc past end", !ok && flash.erases == 0);
+  }
+
+  {
+    MemoryFlash flash(flash_size);
+    bool ok = install(flash, make_blit(data, {0x7FFFFFFF}), true);
+    check("installer reloc before base", !ok && flash.erases == 0);
+  }
+
+  {
+    MemoryFlash flash(flash_size);
+    auto file = make_blit(data, {});
+    uint32_t huge = 0x40000001; // * 4 overflows
+    memcpy(file.data() + 4, &huge, 4);
+    check("installer reloc count", !install(flash, file, true));
+  }
+}
+
+void installer_bench() {
+  MemoryFlash flash(flash_size);
+
+  std::vector<uint32_t> relocs;
+  for(uint32_t off = 0; off < 16384; off += 64)
+    relocs.push_back(off);
+
+  auto file = make_blit(make_data(16384), relocs);
+
+  bench("install 16K, 256 relocs", 20, [&](int i) {bench_sink = install(flash, file, true, 64);});
+}
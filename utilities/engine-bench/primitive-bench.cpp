@@ -0,0 +1,184 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "engine-bench.hpp"
+#include "graphics/mesh.hpp"
+
+using namespace blit;
+
+static const int test_size = 64;
+
+static uint8_t test_data[test_size * test_size * 3];
+static Surface test_surface(test_data, PixelFormat::RGB, Size(test_size, test_size));
+
+static void clear_test() {
+  test_surface.pen = Pen(0, 0, 0);
+  test_surface.clear();
+}
+
+static int count_filled() {
+  int count = 0;
+  for(int i = 0; i < test_size * test_size; i++)
+    count += test_data[i * 3] != 0;
+  return count;
+}
+
+static uint8_t texture_data[64 * 64 * 3];
+static Surface texture(texture_data, PixelFormat::RGB, Size(64, 64));
+
+static void init_texture() {
+  for(int y = 0; y < 64; y++) {
+    for(int x = 0; x < 64; x++) {
+      // never black, so count_filled sees every pixel
+      texture.pen = Pen(x * 4 | 1, y * 4, (x ^ y) * 4);
+      texture.pixel(Point(x, y));
+    }
+  }
+}
+
+static std::vector<Point> circle_points(int count, Point centre, float radius) {
+  std::vector<Point> points;
+  for(int i = 0; i < count; i++) {
+    float a = pi * 2.0f * i / count;
+    points.push_back(centre + Point(int(std::cos(a) * radius), int(std::sin(a) * radius)));
+  }
+  return points;
+}
+
+void primitive_checks() {
+  // more points than fit in the stack edge table
+  auto points = circle_points(40, Point(32, 32), 30.0f);
+
+  clear_test();
+  test_surface.pen = Pen(255, 255, 255);
+  test_surface.polygon(points);
+  int filled = count_filled();
+
+  std::vector<uint8_t> scratch(Surface::polygon_scratch_size(points.size()));
+  clear_test();
+  test_surface.pen = Pen(255, 255, 255);
+  test_surface.polygon(points.data(), points.size(), FillRule::even_odd, false, scratch.data(), scratch.size());
+
+  // roughly pi * 30^2
+  check("polygon 40 points", filled > 2600 && filled < 2900 && count_filled() == filled);
+
+  // texture_triangle offset by half a pixel covers the same pixels as triangle
+  init_texture();
+
+  static const Point tris[][3]{
+    {{2, 3}, {60, 10}, {20, 61}},
+    {{0, 0}, {63, 0}, {0, 63}},
+    {{50, 5}, {5, 30}, {58, 58}},
+  };
+
+  bool same = true;
+  for(auto &tri : tris) {
+    for(bool perspective : {false, true}) {
+      uint8_t flat_data[sizeof(test_data)];
+
+      clear_test();
+      test_surface.pen = Pen(255, 255, 255);
+      test_surface.triangle(tri[0], tri[1], tri[2]);
+      memcpy(flat_data, test_data, sizeof(test_data));
+
+      clear_test();
+      TexturedVertex v[3];
+      for(int i = 0; i < 3; i++) {
+        v[i].pos = Vec2(tri[i].x + 0.5f, tri[i].y + 0.5f);
+        v[i].uv = Vec2(float(tri[i].x), float(tri[i].y));
+        v[i].w = 1.0f + i * 0.5f;
+      }
+      test_surface.texture_triangle(&texture, v[0], v[1], v[2], perspective);
+
+      for(int i = 0; i < test_size * test_size; i++)
+        same = same && (flat_data[i * 3] != 0) == (test_data[i * 3] != 0);
+    }
+  }
+  check("texture_triangle coverage", same);
+
+  // depth tested quads should still fill every pixel, including the 2x2 pixels sharing a value at half resolution
+  auto quad = [](float z0, float z1, Pen pen) {
+    test_surface.pen = pen;
+    TexturedVertex tl{Vec2(0.0f, 0.0f), Vec2(), 1.0f, z0}, tr{Vec2(64.0f, 0.0f), Vec2(), 1.0f, z1};
+    TexturedVertex bl{Vec2(0.0f, 64.0f), Vec2(), 1.0f, z0}, br{Vec2(64.0f, 64.0f), Vec2(), 1.0f, z1};
+    test_surface.texture_triangle(nullptr, tl, tr, bl);
+    test_surface.texture_triangle(nullptr, tr, br, bl);
+  };
+
+  auto count_pen = [](Pen pen) {
+    int count = 0;
+    for(int i = 0; i < test_size * test_size; i++)
+      count += test_data[i * 3] == pen.r && test_data[i * 3 + 1] == pen.g;
+    return count;
+  };
+
+  for(bool half_res : {false, true}) {
+    DepthBuffer depth(test_surface.bounds, half_res);
+    test_surface.depth = &depth;
+
+    const char *res = half_res ? "half" : "full";
+    char name[64];
+
+    for(float slope : {0.0f, 0.3f}) {
+      clear_test();
+      depth.clear();
+      quad(0.5f - slope, 0.5f + slope, Pen(255, 255, 255));
+      snprintf(name, sizeof(name), "depth fill %s res %s", res, slope == 0.0f ? "flat" : "sloped");
+      check(name, count_filled() == test_size * test_size);
+    }
+
+    // nearer covers, further is hidden
+    clear_test();
+    depth.clear();
+    quad(0.6f, 0.6f, Pen(255, 0, 0));
+    quad(0.4f, 0.4f, Pen(0, 255, 0));
+    quad(0.5f, 0.5f, Pen(0, 0, 255));
+    snprintf(name, sizeof(name), "depth occlusion %s res", res);
+    check(name, count_pen(Pen(0, 255, 0)) == test_size * test_size);
+
+    test_surface.depth = nullptr;
+  }
+}
+
+void primitive_bench() {
+  char name[64];
+  const char *format = screen.format == PixelFormat::RGB565 ? "RGB565" : "RGB";
+
+  for(int count : {8, 32, 64}) {
+    auto points = circle_points(count, Point(screen.bounds.w / 2, screen.bounds.h / 2), 100.0f);
+
+    snprintf(name, sizeof(name), "polygon %i points r100 %s", count, format);
+    bench(name, 100, [&points](int i) {
+      screen.pen = Pen(i, 255 - i, 128);
+      screen.polygon(points);
+    });
+  }
+
+  init_texture();
+
+  // fill rate, a 64x64 texture stretched over a quad of two triangles
+  for(int size : {32, 128}) {
+    for(bool perspective : {false, true}) {
+      snprintf(name, sizeof(name), "texture_triangle %ix%i quad %s%s", size, size, format, perspective ? " perspective" : "");
+
+      uint32_t start = bench_us();
+      const int iterations = size > 32 ? 50 : 500;
+
+      for(int i = 0; i < iterations; i++) {
+        Vec2 pos(float(i * 7 % (screen.bounds.w - size)), float(i * 3 % (screen.bounds.h - size)));
+
+        TexturedVertex tl{pos, Vec2(0.0f, 0.0f), 1.0f}, tr{pos + Vec2(float(size), 0.0f), Vec2(64.0f, 0.0f), 2.0f};
+        TexturedVertex bl{pos + Vec2(0.0f, float(size)), Vec2(0.0f, 64.0f), 1.0f}, br{pos + Vec2(float(size), float(size)), Vec2(64.0f, 64.0f), 2.0f};
+
+        screen.texture_triangle(&texture, tl, tr, bl, perspective);
+        screen.texture_triangle(&texture, tr, br, bl, perspective);
+      }
+
+      uint32_t elapsed = us_diff(start, bench_us());
+      uint32_t pixels = uint32_t(size * size) * iterations;
+      debugf("BENCH %s: %u pixels/ms\n", name, unsigned(uint64_t(pixels) * 1000 / (elapsed ? elapsed : 1)));
+    }
+  }
+}